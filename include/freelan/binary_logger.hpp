@@ -0,0 +1,350 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file binary_logger.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A binary logger class.
+ */
+
+#ifndef FREELAN_BINARY_LOGGER_HPP
+#define FREELAN_BINARY_LOGGER_HPP
+
+#include "logger.hpp"
+
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/array.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace freelan
+{
+	class binary_log_record;
+
+	/**
+	 * \brief A logger that writes binary records to a memory-mapped ring file.
+	 *
+	 * Format strings are registered once and stored in the file. A record only
+	 * holds a timestamp, the identifier of its format and its raw arguments:
+	 * nothing is formatted when logging. The records are rendered later, by a
+	 * binary_log_reader.
+	 *
+	 * Format strings use "{}" as a placeholder for each argument.
+	 *
+	 * When the ring is full, the oldest records are overwritten.
+	 *
+	 * binary_logger instances are thread-safe.
+	 */
+	class binary_logger : private boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief The format identifier type.
+			 */
+			typedef boost::uint16_t format_id_type;
+
+			/**
+			 * \brief The default ring capacity, in bytes.
+			 */
+			static const size_t DEFAULT_CAPACITY;
+
+			/**
+			 * \brief The maximum count of formats.
+			 */
+			static const size_t MAX_FORMATS = 1024;
+
+			/**
+			 * \brief The maximum length of a format string.
+			 */
+			static const size_t MAX_FORMAT_LENGTH = 252;
+
+			/**
+			 * \brief Create a new binary logger.
+			 * \param path The path of the ring file. The file is created or truncated.
+			 * \param capacity The capacity of the ring, in bytes.
+			 *
+			 * On error, an exception is thrown.
+			 */
+			binary_logger(const std::string& path, size_t capacity = DEFAULT_CAPACITY);
+
+			/**
+			 * \brief Register a format.
+			 * \param level The log level of the records that use this format.
+			 * \param format The format string. Longer format strings are truncated.
+			 * \return The format identifier.
+			 *
+			 * If the format table is full, a std::runtime_error is thrown.
+			 */
+			format_id_type register_format(log_level level, const std::string& format);
+
+			/**
+			 * \brief Start a record.
+			 * \param format_id The format identifier, as returned by register_format().
+			 * \return The record. It is written to the ring when it is destroyed.
+			 */
+			binary_log_record operator()(format_id_type format_id);
+
+		private:
+
+			void write(const void*, size_t);
+			void read_ring(boost::uint64_t, void*, size_t) const;
+			void write_ring(boost::uint64_t, const void*, size_t);
+
+			boost::interprocess::file_mapping m_file_mapping;
+			boost::interprocess::mapped_region m_region;
+			size_t m_capacity;
+			boost::mutex m_mutex;
+
+			friend class binary_log_record;
+	};
+
+	/**
+	 * \brief A binary log record being built.
+	 *
+	 * Arguments that do not fit in the record are dropped.
+	 */
+	class binary_log_record
+	{
+		public:
+
+			/**
+			 * \brief The maximum size of a record, in bytes.
+			 */
+			static const size_t MAX_SIZE = 512;
+
+			/**
+			 * \brief The argument types.
+			 */
+			enum argument_type
+			{
+				BA_INTEGER, /**< \brief A signed integer. */
+				BA_UNSIGNED, /**< \brief An unsigned integer. */
+				BA_BOOLEAN, /**< \brief A boolean. */
+				BA_DOUBLE, /**< \brief A floating point number. */
+				BA_STRING, /**< \brief A string. */
+				BA_IPV4_ADDRESS, /**< \brief An IPv4 address. */
+				BA_IPV6_ADDRESS, /**< \brief An IPv6 address. */
+				BA_IPV4_ENDPOINT, /**< \brief An IPv4 endpoint. */
+				BA_IPV6_ENDPOINT, /**< \brief An IPv6 endpoint. */
+				BA_DURATION /**< \brief A duration. */
+			};
+
+			/**
+			 * \brief Transfer a record.
+			 * \param other The record to transfer. It will write nothing once the call completes.
+			 */
+			binary_log_record(const binary_log_record& other);
+
+			/**
+			 * \brief Write the record.
+			 */
+			~binary_log_record();
+
+			/**
+			 * \brief Add a signed integer argument.
+			 * \param value The value.
+			 * \return The record.
+			 */
+			binary_log_record& operator<<(int value);
+
+			/**
+			 * \brief Add a signed integer argument.
+			 * \param value The value.
+			 * \return The record.
+			 */
+			binary_log_record& operator<<(long value);
+
+			/**
+			 * \brief Add an unsigned integer argument.
+			 * \param value The value.
+			 * \return The record.
+			 */
+			binary_log_record& operator<<(unsigned int value);
+
+			/**
+			 * \brief Add an unsigned integer argument.
+			 * \param value The value.
+			 * \return The record.
+			 */
+			binary_log_record& operator<<(unsigned long value);
+
+			/**
+			 * \brief Add a boolean argument.
+			 * \param value The value.
+			 * \return The record.
+			 */
+			binary_log_record& operator<<(bool value);
+
+			/**
+			 * \brief Add a floating point argument.
+			 * \param value The value.
+			 * \return The record.
+			 */
+			binary_log_record& operator<<(double value);
+
+			/**
+			 * \brief Add a string argument.
+			 * \param value The value.
+			 * \return The record.
+			 */
+			binary_log_record& operator<<(const char* value);
+
+			/**
+			 * \brief Add a string argument.
+			 * \param value The value.
+			 * \return The record.
+			 */
+			binary_log_record& operator<<(const std::string& value);
+
+			/**
+			 * \brief Add an address argument.
+			 * \param value The value.
+			 * \return The record.
+			 */
+			binary_log_record& operator<<(const boost::asio::ip::address& value);
+
+			/**
+			 * \brief Add an endpoint argument.
+			 * \param value The value.
+			 * \return The record.
+			 */
+			binary_log_record& operator<<(const boost::asio::ip::udp::endpoint& value);
+
+			/**
+			 * \brief Add a duration argument.
+			 * \param value The value.
+			 * \return The record.
+			 */
+			binary_log_record& operator<<(const boost::posix_time::time_duration& value);
+
+		private:
+
+			binary_log_record(binary_logger&, binary_logger::format_id_type);
+			binary_log_record& operator=(const binary_log_record&);
+
+			bool begin_argument(argument_type, size_t);
+			void append(const void*, size_t);
+
+			mutable binary_logger* m_logger;
+			boost::array<boost::uint8_t, MAX_SIZE> m_buffer;
+			size_t m_size;
+
+			friend class binary_logger;
+	};
+
+	/**
+	 * \brief A decoded binary log entry.
+	 */
+	struct binary_log_entry
+	{
+		/**
+		 * \brief The timestamp.
+		 */
+		boost::posix_time::ptime timestamp;
+
+		/**
+		 * \brief The log level.
+		 */
+		log_level level;
+
+		/**
+		 * \brief The rendered message.
+		 */
+		std::string message;
+	};
+
+	/**
+	 * \brief A class that decodes the ring file written by a binary_logger.
+	 */
+	class binary_log_reader : private boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief The entry handler type.
+			 */
+			typedef boost::function<void (const binary_log_entry&)> entry_handler_type;
+
+			/**
+			 * \brief Open a ring file.
+			 * \param path The path of the ring file.
+			 *
+			 * On error, an exception is thrown.
+			 */
+			explicit binary_log_reader(const std::string& path);
+
+			/**
+			 * \brief Decode all the records, from the oldest to the newest.
+			 * \param handler The handler to call for each record.
+			 */
+			void read(entry_handler_type handler) const;
+
+		private:
+
+			struct format
+			{
+				log_level level;
+				std::string text;
+			};
+
+			void read_ring(boost::uint64_t, void*, size_t) const;
+			std::string render(const format&, const boost::uint8_t*, size_t) const;
+
+			boost::interprocess::file_mapping m_file_mapping;
+			boost::interprocess::mapped_region m_region;
+			size_t m_capacity;
+			std::vector<format> m_formats;
+	};
+
+	inline binary_log_record binary_logger::operator()(format_id_type format_id)
+	{
+		return binary_log_record(*this, format_id);
+	}
+}
+
+#endif /* FREELAN_BINARY_LOGGER_HPP */
@@ -242,8 +242,47 @@ namespace freelan
 
 		/**
 		 * \brief The hello timeout.
+		 *
+		 * If adaptive_hello_timeout is set, this is only the timeout for the hosts whose round-trip time is unknown.
 		 */
 		boost::posix_time::time_duration hello_timeout;
+
+		/**
+		 * \brief Whether the hello timeout of every host is derived from its round-trip time.
+		 */
+		bool adaptive_hello_timeout;
+
+		/**
+		 * \brief The minimum adaptive hello timeout.
+		 */
+		boost::posix_time::time_duration min_hello_timeout;
+
+		/**
+		 * \brief The maximum adaptive hello timeout, including the backoff after unanswered hellos.
+		 */
+		boost::posix_time::time_duration max_hello_timeout;
+
+		/**
+		 * \brief The interval between two path quality probes sent to every established host. A null duration disables the probing.
+		 *
+		 * Probes are sent on FSCP channel #1: hosts that don't support them will ignore them.
+		 */
+		boost::posix_time::time_duration path_probe_interval;
+
+		/**
+		 * \brief The maximum count of handshakes in progress. 0 means no limit.
+		 */
+		unsigned int max_pending_handshakes;
+
+		/**
+		 * \brief The count of handshake messages accepted per second from a same address. 0 means no limit.
+		 */
+		unsigned int handshake_rate_limit;
+
+		/**
+		 * \brief The time during which a certificate that failed validation is ignored from the same address. A null duration disables the cooldown.
+		 */
+		boost::posix_time::time_duration validation_failure_cooldown;
 	};
 
 	/**
@@ -315,6 +354,16 @@ namespace freelan
 		 */
 		certificate_validation_callback_type certificate_validation_callback;
 
+		/**
+		 * \brief The count of threads dedicated to certificate validation.
+		 *
+		 * If 0, certificates are validated synchronously in the io_service thread.
+		 * Otherwise, certificate_validation_callback is called from the validation threads.
+		 *
+		 * The threads are started when the core is opened: core::apply_configuration() does not change this value.
+		 */
+		unsigned int certificate_validation_threads;
+
 		/**
 		 * \brief The certificate authorities.
 		 */
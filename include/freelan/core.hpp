@@ -47,10 +47,13 @@
 #define FREELAN_CORE_HPP
 
 #include <vector>
+#include <map>
 
 #include <boost/asio.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/exception_ptr.hpp>
 
 #include <cryptoplus/x509/store.hpp>
 #include <cryptoplus/x509/store_context.hpp>
@@ -62,7 +65,14 @@
 
 #include "configuration.hpp"
 #include "switch.hpp"
+#include "handshake_governor.hpp"
+#include "rtt_estimator.hpp"
+#include "path_prober.hpp"
 #include "logger.hpp"
+#include "binary_logger.hpp"
+#include "metrics.hpp"
+#include "frame_tracer.hpp"
+#include "handler_allocator.hpp"
 
 namespace freelan
 {
@@ -115,6 +125,21 @@ namespace freelan
 			 */
 			static const boost::posix_time::time_duration DYNAMIC_CONTACT_PERIOD;
 
+			/**
+			 * \brief The time allowed to a handshake to complete once the HELLO exchange succeeded.
+			 */
+			static const boost::posix_time::time_duration HANDSHAKE_TIMEOUT;
+
+			/**
+			 * \brief The maximum count of dynamic contact periods between two contact requests for the same certificate.
+			 */
+			static const unsigned int DYNAMIC_CONTACT_MAX_INTERVAL;
+
+			/**
+			 * \brief The maximum count of certificates in a single contact request.
+			 */
+			static const size_t DYNAMIC_CONTACT_BATCH_SIZE;
+
 			/**
 			 * \brief The default service.
 			 */
@@ -135,6 +160,45 @@ namespace freelan
 			 */
 			typedef boost::function<void ()> close_callback;
 
+			/**
+			 * \brief The stages of the opening.
+			 */
+			enum open_stage
+			{
+				OS_RESOLUTION, /**< \brief The listen endpoint resolution. */
+				OS_SERVER_CONFIGURATION, /**< \brief The server login and configuration retrieval. */
+				OS_CA_STORE, /**< \brief The CA store build. */
+				OS_TAP_ADAPTER, /**< \brief The tap adapter opening. */
+				OS_SERVER, /**< \brief The FSCP server opening. */
+				OS_FINALIZATION, /**< \brief The final steps: contact loop and tap adapter configuration. */
+				OS_COUNT /**< \brief The count of stages. */
+			};
+
+			/**
+			 * \brief The opening timings.
+			 */
+			struct open_timings
+			{
+				/**
+				 * \brief The duration of each stage.
+				 *
+				 * Skipped stages have a null duration.
+				 */
+				boost::array<boost::posix_time::time_duration, OS_COUNT> stages;
+
+				/**
+				 * \brief The total duration of the opening.
+				 */
+				boost::posix_time::time_duration total;
+			};
+
+			/**
+			 * \brief The asynchronous open handler type.
+			 *
+			 * The exception pointer is null on success.
+			 */
+			typedef boost::function<void (boost::exception_ptr, const open_timings&)> async_open_handler;
+
 			/**
 			 * \brief A session established callback.
 			 * \param host The host with which a session is established.
@@ -147,6 +211,17 @@ namespace freelan
 			 */
 			typedef boost::function<void (const ep_type& host)> session_lost_callback;
 
+			/**
+			 * \brief The round-trip time callback type.
+			 */
+			typedef boost::function<void (const ep_type& host, const rtt_estimator& estimator)> round_trip_time_callback;
+
+			/**
+			 * \brief A frame callback.
+			 * \param frame The ethernet frame.
+			 */
+			typedef boost::function<void (boost::asio::const_buffer frame)> frame_callback;
+
 			/**
 			 * \brief The constructor.
 			 * \param io_service The io_service to bind to.
@@ -155,6 +230,11 @@ namespace freelan
 			 */
 			core(boost::asio::io_service& io_service, const freelan::configuration& configuration, const freelan::logger& _logger);
 
+			/**
+			 * \brief The destructor.
+			 */
+			~core();
+
 			/**
 			 * \brief Get the configuration.
 			 * \return The current configuration.
@@ -195,6 +275,16 @@ namespace freelan
 			 */
 			freelan::logger& logger();
 
+			/**
+			 * \brief Get the metrics registry.
+			 * \return The metrics registry.
+			 *
+			 * The core, its switch, its logger and its server client register
+			 * their metrics there. Export them with a metrics_exporter or take
+			 * snapshots directly.
+			 */
+			metrics_registry& metrics();
+
 			/**
 			 * \brief Set the configuration update callback.
 			 * \param callback The callback.
@@ -233,16 +323,127 @@ namespace freelan
 			 */
 			void set_session_lost_callback(session_lost_callback callback);
 
+			/**
+			 * \brief Set the round-trip time callback.
+			 * \param callback The callback.
+			 *
+			 * This callback is called whenever the round-trip time estimation of a host changes.
+			 */
+			void set_round_trip_time_callback(round_trip_time_callback callback);
+
+			/**
+			 * \brief Get the round-trip time estimation of a host.
+			 * \param host The host.
+			 * \return The estimation, if the host was greeted recently.
+			 *
+			 * Must be called from the io_service thread.
+			 */
+			boost::optional<rtt_estimator> get_round_trip_time(const ep_type& host) const;
+
+			/**
+			 * \brief Get the path quality to a host.
+			 * \param host The host.
+			 * \return The path quality, if the host has an established session and path probing is enabled.
+			 *
+			 * Must be called from the io_service thread.
+			 *
+			 * See fscp_configuration::path_probe_interval.
+			 */
+			boost::optional<path_quality> get_path_quality(const ep_type& host) const;
+
+			/**
+			 * \brief Set the binary logger.
+			 * \param _binary_logger The binary logger. If null, binary logging is disabled.
+			 *
+			 * Session and error events are recorded in the binary logger, without any formatting.
+			 *
+			 * Must be called before the core is opened.
+			 */
+			void set_binary_logger(boost::shared_ptr<binary_logger> _binary_logger);
+
+			/**
+			 * \brief Enable or disable the frame tracing.
+			 * \param sampling_interval One frame every sampling_interval is traced. 0 disables the tracing.
+			 *
+			 * Traced frames are timestamped at every stage of the data path and the
+			 * latencies are recorded in the metrics registry. See frame_tracer.
+			 *
+			 * Must be called before the core is opened.
+			 */
+			void set_frame_tracing(unsigned int sampling_interval);
+
+			/**
+			 * \brief Attach an in-memory frame port to the switch.
+			 * \param callback The callback to call for every ethernet frame the switch sends to the port. If null, the port is detached.
+			 *
+			 * The port belongs to the same group as the tap adapter and can be used
+			 * instead of it, for instance to exercise the data path without root
+			 * privileges. Frames are sent through the port with inject_frame().
+			 *
+			 * The callback is called from the io_service thread and the frame is
+			 * only valid during the call.
+			 */
+			void set_frame_callback(frame_callback callback);
+
+			/**
+			 * \brief Send an ethernet frame through the in-memory frame port.
+			 * \param frame The ethernet frame.
+			 *
+			 * The frame is handled as if it was read from the tap adapter.
+			 *
+			 * Must be called from the io_service thread. Calling this method while no frame callback is set is undefined behavior.
+			 */
+			void inject_frame(boost::asio::const_buffer frame);
+
 			/**
 			 * \brief Open the current core instance.
 			 */
 			void open();
 
+			/**
+			 * \brief Open the current core instance asynchronously.
+			 * \param handler The handler to call when the opening completes or fails.
+			 *
+			 * The independent stages (listen endpoint resolution, CA store build,
+			 * tap adapter opening and server login) run concurrently. Blocking
+			 * stages run in dedicated threads and report back to the io_service
+			 * thread. Stage failures are reported to the handler once all running
+			 * stages have completed.
+			 *
+			 * \warning The io_service must be running for the handler to be called.
+			 */
+			void async_open(async_open_handler handler);
+
+			/**
+			 * \brief Get the name of an open stage.
+			 * \param stage The stage.
+			 * \return The name of the stage.
+			 */
+			static const char* open_stage_name(open_stage stage);
+
 			/**
 			 * \brief Close the current core instance.
 			 */
 			void close();
 
+			/**
+			 * \brief Apply a new configuration without closing the current core instance.
+			 * \param configuration The new configuration.
+			 *
+			 * The new configuration is compared to the current one and the
+			 * differences are applied in place: new contacts are contacted right
+			 * away, the never contact list, the switch settings, the handshake
+			 * limits, the server settings, the certificate material and the
+			 * ARP/DHCP proxies are updated. Existing sessions and learned
+			 * ethernet addresses are kept.
+			 *
+			 * The settings that cannot change while the core is open (the listen
+			 * endpoint, the server activation, the count of certificate validation
+			 * threads, the tap adapter activation and addresses) keep their
+			 * current values: a warning is logged when they differ.
+			 */
+			void apply_configuration(const freelan::configuration& configuration);
+
 			/**
 			 * \brief Add a log entry to the attached logger.
 			 * \param level The log level of the entry. If level is inferior to the
@@ -261,11 +462,13 @@ namespace freelan
 			// The running flag
 			volatile bool m_running;
 			void do_close();
+			void do_apply_configuration(const freelan::configuration&);
 
 			// FSCP methods
 			void async_greet(const ep_type&);
 			bool on_hello_request(const ep_type&, bool);
 			void on_hello_response(const ep_type&, const boost::posix_time::time_duration&, bool);
+			boost::posix_time::time_duration get_hello_timeout(const ep_type&) const;
 			bool on_presentation(const ep_type&, cert_type, cert_type, bool);
 			bool on_session_request(const ep_type&, bool);
 			void on_session_established(const ep_type&);
@@ -274,6 +477,8 @@ namespace freelan
 			bool on_contact_request(const ep_type&, cert_type, const ep_type&);
 			void on_contact(const ep_type&, cert_type, const ep_type&);
 			void on_ethernet_data(const ep_type&, boost::asio::const_buffer);
+			void send_ethernet_data(const ep_type&, boost::asio::const_buffer);
+			void on_probe_data(const ep_type&, boost::asio::const_buffer);
 			void on_network_error(const ep_type&, const boost::system::error_code&);
 
 			// Tap adapter methods
@@ -281,11 +486,14 @@ namespace freelan
 
 			// Other methods
 			void do_greet(const ep_type& ep);
+			void set_pending_greet(const ep_type&, const boost::posix_time::time_duration&);
+			bool is_pending_greet(const ep_type&) const;
+			void purge_pending_greets();
 			void do_greet(const boost::system::error_code&, boost::asio::ip::udp::resolver::iterator, const freelan::fscp_configuration::endpoint&);
 			void do_contact();
 			void do_contact(const fscp_configuration::endpoint&);
 			void do_dynamic_contact();
-			void do_dynamic_contact(cert_type cert);
+			void do_dynamic_contact(const cert_list_type&);
 			void do_periodic_contact(const boost::system::error_code&);
 			void do_periodic_dynamic_contact(const boost::system::error_code&);
 			void do_check_configuration(const boost::system::error_code&);
@@ -295,6 +503,111 @@ namespace freelan
 			freelan::logger m_logger;
 			cert_list_type m_last_dynamic_contact_list_from_server;
 
+			// Metrics
+			metrics_registry m_metrics;
+			histogram& m_handshake_duration_histogram;
+			histogram& m_hello_rtt_histogram;
+			histogram& m_presentation_validation_duration_histogram;
+			histogram& m_tap_adapter_read_size_histogram;
+			counter& m_sessions_established_counter;
+			counter& m_sessions_lost_counter;
+			gauge& m_sessions_gauge;
+			counter& m_endpoint_received_frames_counter;
+			counter& m_endpoint_received_bytes_counter;
+			counter& m_endpoint_sent_frames_counter;
+			counter& m_endpoint_sent_bytes_counter;
+			gauge& m_pending_greets_gauge;
+			gauge& m_pending_handshakes_gauge;
+			void update_pending_gauges();
+			boost::scoped_ptr<frame_tracer> m_frame_tracer;
+
+			// Dynamic contact
+			struct certificate_less
+			{
+				bool operator()(const cert_type&, const cert_type&) const;
+			};
+
+			struct dynamic_contact_state
+			{
+				dynamic_contact_state() : interval(1), skip(0) {}
+
+				unsigned int interval;
+				unsigned int skip;
+			};
+
+			typedef std::map<cert_type, dynamic_contact_state, certificate_less> dynamic_contact_state_map_type;
+			dynamic_contact_state_map_type m_dynamic_contact_state_map;
+
+			// In-flight greetings and handshakes, with their expiration date
+			typedef std::map<ep_type, boost::posix_time::ptime> pending_greet_map_type;
+			pending_greet_map_type m_pending_greet_map;
+
+			// Round-trip time estimations, per host
+			typedef std::map<ep_type, rtt_estimator> rtt_estimator_map_type;
+			rtt_estimator_map_type m_rtt_estimator_map;
+
+			// Admission control for incoming handshakes
+			handshake_governor m_handshake_governor;
+
+			// The never contact list, laid out for fast membership tests
+			ip_network_address_list m_never_contact_list;
+
+			// CA store
+			struct ca_store_key
+			{
+				cert_list_type certificate_authority_list;
+				security_configuration::crl_list_type certificate_revocation_list_list;
+				security_configuration::certificate_revocation_validation_method_type certificate_revocation_validation_method;
+			};
+
+			static ca_store_key make_ca_store_key(const security_configuration&);
+			static bool is_same_ca_store_key(const ca_store_key&, const ca_store_key&);
+			static cryptoplus::x509::store create_ca_store(const ca_store_key&);
+			bool refresh_ca_store();
+			cryptoplus::x509::store get_ca_store(freelan::logger&);
+			void install_ca_store(cryptoplus::x509::store, const ca_store_key&);
+
+			// Opening
+			struct open_context
+			{
+				open_context(async_open_handler _handler) :
+					handler(_handler),
+					start_time(boost::posix_time::microsec_clock::universal_time()),
+					started(0),
+					completed(0),
+					tap_adapter_opened(false)
+				{
+				}
+
+				async_open_handler handler;
+				boost::posix_time::ptime start_time;
+				boost::array<boost::posix_time::ptime, OS_COUNT> stage_start;
+				open_timings timings;
+				unsigned int started;
+				unsigned int completed;
+				boost::exception_ptr error;
+				cryptoplus::x509::store ca_store;
+				ca_store_key ca_key;
+				bool tap_adapter_opened;
+			};
+
+			void resolve_listen_endpoint();
+			void check_configuration();
+			void start_contact_loop();
+			void configure_tap_adapter();
+			void configure_proxies();
+			void start_open_stage(boost::shared_ptr<open_context>, open_stage, boost::function<void ()>, bool, bool self_completing = false);
+			void skip_open_stage(boost::shared_ptr<open_context>, open_stage);
+			void run_open_stage(boost::shared_ptr<open_context>, open_stage, boost::function<void ()>, bool);
+			void on_open_stage_done(boost::shared_ptr<open_context>, open_stage, boost::exception_ptr);
+			void advance_open(boost::shared_ptr<open_context>);
+			void abort_open(boost::shared_ptr<open_context>);
+			void async_resolve_listen_endpoint(boost::shared_ptr<open_context>);
+			void on_listen_endpoint_resolved(boost::shared_ptr<open_context>, const boost::system::error_code&, boost::asio::ip::udp::resolver::iterator);
+			void build_open_ca_store(boost::shared_ptr<open_context>);
+			void open_server();
+			void finalize_open();
+
 			// FSCP
 			void create_server();
 			boost::optional<ep_type> m_listen_endpoint;
@@ -302,11 +615,26 @@ namespace freelan
 			boost::asio::ip::udp::resolver m_resolver;
 			boost::asio::deadline_timer m_contact_timer;
 			boost::asio::deadline_timer m_dynamic_contact_timer;
+			handler_allocator m_contact_timer_allocator;
+			handler_allocator m_dynamic_contact_timer_allocator;
+
+			// Path probing
+			void start_path_probing();
+			void do_periodic_path_probing(const boost::system::error_code&);
+
+			typedef std::map<ep_type, path_prober> path_prober_map_type;
+			path_prober_map_type m_path_prober_map;
+			boost::asio::deadline_timer m_path_probe_timer;
+			handler_allocator m_path_probe_timer_allocator;
 
 			// Tap adapter
 			void create_tap_adapter();
+			void open_tap_adapter();
+			void release_tap_adapter_switch_port();
 			boost::scoped_ptr<asiotap::tap_adapter> m_tap_adapter;
 			boost::array<unsigned char, 65536> m_tap_adapter_buffer;
+			handler_allocator m_tap_adapter_read_allocator;
+			bool m_tap_adapter_configured;
 
 			// User callbacks
 			configuration_update_callback m_configuration_update_callback;
@@ -314,6 +642,19 @@ namespace freelan
 			close_callback m_close_callback;
 			session_established_callback m_session_established_callback;
 			session_lost_callback m_session_lost_callback;
+			round_trip_time_callback m_round_trip_time_callback;
+
+			// Binary logging
+			struct binary_log_formats
+			{
+				binary_logger::format_id_type session_established;
+				binary_logger::format_id_type session_lost;
+				binary_logger::format_id_type network_error;
+				binary_logger::format_id_type presentation_rejected;
+			};
+
+			boost::shared_ptr<binary_logger> m_binary_logger;
+			binary_log_formats m_binary_log_formats;
 
 			// Filters
 			asiotap::osi::filter<asiotap::osi::ethernet_frame> m_ethernet_filter;
@@ -341,13 +682,46 @@ namespace freelan
 			endpoint_switch_port_map_type m_endpoint_switch_port_map;
 
 			switch_::port_type m_tap_adapter_switch_port;
+			switch_::port_type m_frame_callback_switch_port;
 
 			// Certificate validation
+			struct validation_context
+			{
+				core* instance;
+				freelan::logger* logger;
+			};
+
 			static const int ex_data_index;
 			static int certificate_validation_callback(int, X509_STORE_CTX*);
-			bool certificate_validation_method(bool, cryptoplus::x509::store_context);
-			bool certificate_is_valid(cert_type cert);
+			bool certificate_validation_method(bool, cryptoplus::x509::store_context, freelan::logger&);
+			bool certificate_is_valid(cert_type cert, freelan::logger&);
+			bool presentation_is_valid(const ep_type&, cert_type, cert_type, freelan::logger&);
+
+			// The CA store is built on first use and kept across close()/open() cycles as long as the certificate material is unchanged.
+			boost::mutex m_ca_store_mutex;
 			cryptoplus::x509::store m_ca_store;
+			ca_store_key m_ca_store_key;
+
+			// Asynchronous certificate validation
+			struct presentation_state
+			{
+				presentation_state() : generation(0), valid(false) {}
+
+				// Identifies the presentation being validated: results of superseded presentations are discarded
+				unsigned int generation;
+				bool valid;
+				handshake_governor::fingerprint_type fingerprint;
+			};
+
+			typedef std::map<ep_type, presentation_state> presentation_state_map_type;
+
+			void start_validation_threads();
+			void stop_validation_threads();
+			void do_validate_presentation(const ep_type&, cert_type, cert_type, unsigned int);
+			void on_presentation_validated(const ep_type&, unsigned int, bool);
+			void purge_presentation_states();
+			presentation_state_map_type m_presentation_state_map;
+			unsigned int m_presentation_generation;
 
 			// Client
 			void async_update_server_configuration(int);
@@ -356,6 +730,12 @@ namespace freelan
 			void set_network_information(const network_info& ninfo);
 			void set_identity(identity_store);
 			boost::asio::deadline_timer m_check_configuration_timer;
+			handler_allocator m_check_configuration_timer_allocator;
+
+			// Declared last so that validation threads never outlive the members they use
+			boost::asio::io_service m_validation_io_service;
+			boost::scoped_ptr<boost::asio::io_service::work> m_validation_work;
+			boost::thread_group m_validation_threads;
 	};
 
 	inline const freelan::configuration& core::configuration() const
@@ -388,6 +768,11 @@ namespace freelan
 		return m_logger;
 	}
 
+	inline metrics_registry& core::metrics()
+	{
+		return m_metrics;
+	}
+
 	inline void core::set_configuration_update_callback(configuration_update_callback callback)
 	{
 		m_configuration_update_callback = callback;
@@ -412,6 +797,11 @@ namespace freelan
 	{
 		m_session_lost_callback = callback;
 	}
+
+	inline void core::set_round_trip_time_callback(round_trip_time_callback callback)
+	{
+		m_round_trip_time_callback = callback;
+	}
 }
 
 #endif /* FREELAN_CORE_HPP */
@@ -229,6 +229,18 @@ namespace freelan
 	 */
 	std::istream& operator>>(std::istream& is, endpoint& value);
 
+	/**
+	 * \brief Parse an endpoint from a character range.
+	 * \param begin The first character.
+	 * \param end The past-the-end character.
+	 * \param value The value. Only modified on success.
+	 * \param ec The error code, set on failure and cleared on success.
+	 * \return The position past the last parsed character, or begin on failure.
+	 *
+	 * The endpoint type is chosen from the first characters so that each parser is only tried when it can succeed.
+	 */
+	const char* parse(const char* begin, const char* end, endpoint& value, boost::system::error_code& ec);
+
 	/**
 	 * \brief Compare two endpoints.
 	 * \param lhs The left argument.
@@ -0,0 +1,168 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file frame_tracer.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A frame tracer class.
+ */
+
+#ifndef FREELAN_FRAME_TRACER_HPP
+#define FREELAN_FRAME_TRACER_HPP
+
+#include <boost/array.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "metrics.hpp"
+
+namespace freelan
+{
+	/**
+	 * \brief A class that measures the time a sample of the frames spends in every stage of the data path.
+	 *
+	 * One frame every sampling interval is traced: begin() starts the trace,
+	 * every mark() records the time elapsed since the previous stage in the
+	 * histogram of the stage and end() records the total time. Only the first
+	 * mark of a stage counts, so that frames sent to several ports are only
+	 * measured up to their first handoff.
+	 *
+	 * Frames that are not sampled only cost a decrement. The tracer is not
+	 * thread-safe: it must only be used from the thread that runs the data path.
+	 */
+	class frame_tracer : private boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief The directions.
+			 */
+			enum direction
+			{
+				FTD_OUTBOUND, /**< \brief From the tap adapter to the network. */
+				FTD_INBOUND, /**< \brief From the network to the tap adapter. */
+				FTD_COUNT /**< \brief The count of directions. */
+			};
+
+			/**
+			 * \brief The stages, after the frame was received from the tap adapter or the network.
+			 */
+			enum stage
+			{
+				FTS_CLASSIFICATION, /**< \brief The frame was classified (proxies, source port lookup). */
+				FTS_SWITCH_DECISION, /**< \brief The switch chose a target port. */
+				FTS_HANDOFF, /**< \brief The frame was handed to the FSCP server or written to the tap adapter. */
+				FTS_COUNT /**< \brief The count of stages. */
+			};
+
+			/**
+			 * \brief Create a new frame tracer.
+			 * \param registry The registry in which to register the histograms. Must outlive the tracer.
+			 * \param sampling_interval One frame every sampling_interval is traced. Cannot be 0.
+			 */
+			frame_tracer(metrics_registry& registry, unsigned int sampling_interval);
+
+			/**
+			 * \brief Start tracing a frame, if it is sampled.
+			 * \param _direction The direction of the frame.
+			 */
+			void begin(direction _direction);
+
+			/**
+			 * \brief Mark the end of a stage for the frame being traced.
+			 * \param _stage The stage.
+			 */
+			void mark(stage _stage);
+
+			/**
+			 * \brief Stop tracing the current frame.
+			 */
+			void end();
+
+		private:
+
+			static boost::uint64_t now();
+
+			const unsigned int m_sampling_interval;
+			unsigned int m_countdown;
+			bool m_tracing;
+			direction m_direction;
+			unsigned int m_marked_stages;
+			boost::uint64_t m_start;
+			boost::uint64_t m_last_mark;
+			boost::array<boost::array<histogram*, FTS_COUNT>, FTD_COUNT> m_stage_histograms;
+			boost::array<histogram*, FTD_COUNT> m_total_histograms;
+	};
+
+	inline void frame_tracer::begin(direction _direction)
+	{
+		if (--m_countdown == 0)
+		{
+			m_countdown = m_sampling_interval;
+			m_tracing = true;
+			m_direction = _direction;
+			m_marked_stages = 0;
+			m_start = now();
+			m_last_mark = m_start;
+		}
+	}
+
+	inline void frame_tracer::mark(stage _stage)
+	{
+		if (m_tracing && !(m_marked_stages & (1 << _stage)))
+		{
+			const boost::uint64_t current = now();
+
+			m_stage_histograms[m_direction][_stage]->record(current - m_last_mark);
+			m_last_mark = current;
+			m_marked_stages |= (1 << _stage);
+		}
+	}
+
+	inline void frame_tracer::end()
+	{
+		if (m_tracing)
+		{
+			m_total_histograms[m_direction]->record(now() - m_start);
+			m_tracing = false;
+		}
+	}
+}
+
+#endif /* FREELAN_FRAME_TRACER_HPP */
@@ -0,0 +1,267 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file handler_allocator.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A recycled memory slot for asio handlers.
+ */
+
+#ifndef FREELAN_HANDLER_ALLOCATOR_HPP
+#define FREELAN_HANDLER_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <new>
+
+#include <boost/aligned_storage.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/version.hpp>
+
+namespace freelan
+{
+	/**
+	 * \brief A memory slot for the handler of a recurring asynchronous operation.
+	 *
+	 * asio allocates memory for every asynchronous operation, to store its
+	 * handler. An operation that is started again from its own handler, like
+	 * a read loop or a periodic timer, can reuse the same memory every time:
+	 * asio releases the memory before it calls the handler.
+	 *
+	 * Requests that do not fit in the slot, or that are made while the slot
+	 * is in use, fall back to the heap.
+	 *
+	 * \warning Not thread-safe: the operations that share a slot must run in the same thread.
+	 */
+	class handler_allocator : private boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief The size of the slot.
+			 */
+			static const std::size_t SLOT_SIZE = 512;
+
+			/**
+			 * \brief Create a new handler allocator.
+			 */
+			handler_allocator();
+
+			/**
+			 * \brief Allocate memory.
+			 * \param size The size of the memory.
+			 * \return The memory.
+			 */
+			void* allocate(std::size_t size);
+
+			/**
+			 * \brief Release memory.
+			 * \param pointer The memory, as returned by allocate().
+			 */
+			void deallocate(void* pointer);
+
+		private:
+
+			boost::aligned_storage<SLOT_SIZE> m_storage;
+			bool m_in_use;
+	};
+
+	/**
+	 * \brief A handler wrapper that takes its memory from a handler allocator.
+	 *
+	 * Use make_custom_alloc_handler() to create instances.
+	 */
+	template <typename Handler>
+	class custom_alloc_handler
+	{
+		public:
+
+#if BOOST_VERSION >= 106600
+			/**
+			 * \brief The allocator type, for the asio versions that look for associated allocators.
+			 */
+			template <typename T>
+			class allocator
+			{
+				public:
+
+					typedef T value_type;
+
+					template <typename U>
+					struct rebind
+					{
+						typedef allocator<U> other;
+					};
+
+					explicit allocator(handler_allocator& _allocator) : m_allocator(&_allocator) {}
+
+					template <typename U>
+					allocator(const allocator<U>& other) : m_allocator(other.m_allocator) {}
+
+					T* allocate(std::size_t n) { return static_cast<T*>(m_allocator->allocate(sizeof(T) * n)); }
+
+					void deallocate(T* pointer, std::size_t) { m_allocator->deallocate(pointer); }
+
+					bool operator==(const allocator& other) const { return (m_allocator == other.m_allocator); }
+
+					bool operator!=(const allocator& other) const { return (m_allocator != other.m_allocator); }
+
+				private:
+
+					handler_allocator* m_allocator;
+
+					template <typename U> friend class allocator;
+			};
+
+			/**
+			 * \brief The associated allocator type.
+			 */
+			typedef allocator<char> allocator_type;
+
+			/**
+			 * \brief Get the associated allocator.
+			 * \return The associated allocator.
+			 */
+			allocator_type get_allocator() const
+			{
+				return allocator_type(m_allocator);
+			}
+#endif
+
+			/**
+			 * \brief Wrap a handler.
+			 * \param _allocator The handler allocator.
+			 * \param handler The handler.
+			 */
+			custom_alloc_handler(handler_allocator& _allocator, Handler handler) :
+				m_allocator(_allocator),
+				m_handler(handler)
+			{
+			}
+
+			/**
+			 * \brief Call the handler.
+			 * \param arg1 The first argument.
+			 */
+			template <typename Arg1>
+			void operator()(Arg1 arg1)
+			{
+				m_handler(arg1);
+			}
+
+			/**
+			 * \brief Call the handler.
+			 * \param arg1 The first argument.
+			 * \param arg2 The second argument.
+			 */
+			template <typename Arg1, typename Arg2>
+			void operator()(Arg1 arg1, Arg2 arg2)
+			{
+				m_handler(arg1, arg2);
+			}
+
+			/**
+			 * \brief The asio allocation hook.
+			 * \param size The size of the memory.
+			 * \param this_handler The handler.
+			 * \return The memory.
+			 */
+			friend void* asio_handler_allocate(std::size_t size, custom_alloc_handler<Handler>* this_handler)
+			{
+				return this_handler->m_allocator.allocate(size);
+			}
+
+			/**
+			 * \brief The asio deallocation hook.
+			 * \param pointer The memory.
+			 * \param this_handler The handler.
+			 */
+			friend void asio_handler_deallocate(void* pointer, std::size_t, custom_alloc_handler<Handler>* this_handler)
+			{
+				this_handler->m_allocator.deallocate(pointer);
+			}
+
+		private:
+
+			handler_allocator& m_allocator;
+			Handler m_handler;
+	};
+
+	/**
+	 * \brief Wrap a handler so that it takes its memory from a handler allocator.
+	 * \param _allocator The handler allocator. Must outlive the asynchronous operation.
+	 * \param handler The handler.
+	 * \return The wrapped handler.
+	 */
+	template <typename Handler>
+	inline custom_alloc_handler<Handler> make_custom_alloc_handler(handler_allocator& _allocator, Handler handler)
+	{
+		return custom_alloc_handler<Handler>(_allocator, handler);
+	}
+
+	inline handler_allocator::handler_allocator() :
+		m_in_use(false)
+	{
+	}
+
+	inline void* handler_allocator::allocate(std::size_t size)
+	{
+		if (!m_in_use && (size <= SLOT_SIZE))
+		{
+			m_in_use = true;
+
+			return m_storage.address();
+		}
+
+		return ::operator new(size);
+	}
+
+	inline void handler_allocator::deallocate(void* pointer)
+	{
+		if (pointer == m_storage.address())
+		{
+			m_in_use = false;
+		}
+		else
+		{
+			::operator delete(pointer);
+		}
+	}
+}
+
+#endif /* FREELAN_HANDLER_ALLOCATOR_HPP */
@@ -0,0 +1,265 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file handshake_governor.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A handshake admission control class.
+ */
+
+#ifndef FREELAN_HANDSHAKE_GOVERNOR_HPP
+#define FREELAN_HANDSHAKE_GOVERNOR_HPP
+
+#include <map>
+#include <string>
+#include <utility>
+
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace freelan
+{
+	/**
+	 * \brief A class that decides whether incoming handshake messages should be processed.
+	 *
+	 * The governor bounds the count of handshakes in progress, rate-limits
+	 * handshake messages per source address and keeps certificates that failed
+	 * validation away for a while.
+	 *
+	 * The cooldown is keyed on the source address and the certificate
+	 * fingerprint: a spoofed source address or a host behind the same NAT
+	 * cannot get another certificate ignored.
+	 */
+	class handshake_governor
+	{
+		public:
+
+			/**
+			 * \brief The endpoint type.
+			 */
+			typedef boost::asio::ip::udp::endpoint ep_type;
+
+			/**
+			 * \brief The address type.
+			 */
+			typedef boost::asio::ip::address address_type;
+
+			/**
+			 * \brief The certificate fingerprint type.
+			 */
+			typedef std::string fingerprint_type;
+
+			/**
+			 * \brief Create a new handshake governor.
+			 * \param max_pending_handshakes The maximum count of handshakes in progress. 0 means no limit.
+			 * \param rate_limit The count of handshake messages accepted per second and per source address. 0 means no limit.
+			 * \param handshake_timeout The time after which a handshake in progress is considered abandoned.
+			 * \param failure_cooldown The time during which a certificate that failed validation is ignored from its source address. A null duration disables the cooldown.
+			 */
+			handshake_governor(unsigned int max_pending_handshakes, unsigned int rate_limit, const boost::posix_time::time_duration& handshake_timeout, const boost::posix_time::time_duration& failure_cooldown);
+
+			/**
+			 * \brief Change the limits.
+			 * \param max_pending_handshakes The maximum count of handshakes in progress. 0 means no limit.
+			 * \param rate_limit The count of handshake messages accepted per second and per source address. 0 means no limit.
+			 * \param failure_cooldown The time during which a certificate that failed validation is ignored from its source address. A null duration disables the cooldown.
+			 *
+			 * Handshakes in progress and running cooldowns are kept.
+			 */
+			void set_limits(unsigned int max_pending_handshakes, unsigned int rate_limit, const boost::posix_time::time_duration& failure_cooldown);
+
+			/**
+			 * \brief Check if a certificate is in its validation failure cooldown.
+			 * \param address The source address.
+			 * \param fingerprint The certificate fingerprint.
+			 * \return true if the certificate should be ignored when it comes from address.
+			 */
+			bool is_cooling_down(const address_type& address, const fingerprint_type& fingerprint) const;
+
+			/**
+			 * \brief Consume a handshake message token for the specified source address.
+			 * \param address The source address.
+			 * \return true if the message can be processed, false if the source exceeded its rate.
+			 */
+			bool consume_token(const address_type& address);
+
+			/**
+			 * \brief Register a handshake in progress.
+			 * \param ep The remote host.
+			 * \return true if the handshake can proceed, false if too many handshakes are in progress.
+			 *
+			 * Registering a host that already has a handshake in progress always succeeds.
+			 */
+			bool begin_handshake(const ep_type& ep);
+
+			/**
+			 * \brief Unregister a handshake in progress.
+			 * \param ep The remote host.
+			 */
+			void end_handshake(const ep_type& ep);
+
+			/**
+			 * \brief Unregister a handshake in progress and get its duration.
+			 * \param ep The remote host.
+			 * \param duration The time elapsed since the handshake was registered. Only set on success.
+			 * \return true if a handshake was in progress with ep.
+			 */
+			bool end_handshake(const ep_type& ep, boost::posix_time::time_duration& duration);
+
+			/**
+			 * \brief Check if a handshake is in progress with the specified host.
+			 * \param ep The remote host.
+			 * \return true if a handshake is in progress with ep.
+			 */
+			bool has_pending_handshake(const ep_type& ep) const;
+
+			/**
+			 * \brief Report a certificate validation failure.
+			 * \param address The source address.
+			 * \param fingerprint The fingerprint of the certificate that failed validation.
+			 */
+			void report_validation_failure(const address_type& address, const fingerprint_type& fingerprint);
+
+			/**
+			 * \brief Get the count of handshakes in progress.
+			 * \return The count of handshakes in progress.
+			 */
+			size_t pending_handshake_count() const;
+
+			/**
+			 * \brief Forget about expired handshakes, cooldowns and idle sources.
+			 */
+			void purge();
+
+			/**
+			 * \brief Forget everything.
+			 */
+			void clear();
+
+		private:
+
+			static boost::posix_time::ptime now();
+
+			struct source_state
+			{
+				source_state() : tokens(0) {}
+
+				double tokens;
+				boost::posix_time::ptime last_update;
+			};
+
+			typedef std::map<address_type, source_state> source_state_map_type;
+			typedef std::map<std::pair<address_type, fingerprint_type>, boost::posix_time::ptime> cooldown_map_type;
+
+			struct pending_handshake
+			{
+				boost::posix_time::ptime start;
+				boost::posix_time::ptime expiration;
+			};
+
+			typedef std::map<ep_type, pending_handshake> pending_handshake_map_type;
+
+			unsigned int m_max_pending_handshakes;
+			unsigned int m_rate_limit;
+			boost::posix_time::time_duration m_handshake_timeout;
+			boost::posix_time::time_duration m_failure_cooldown;
+			source_state_map_type m_source_state_map;
+			cooldown_map_type m_cooldown_map;
+			pending_handshake_map_type m_pending_handshake_map;
+	};
+
+	inline handshake_governor::handshake_governor(unsigned int max_pending_handshakes, unsigned int rate_limit, const boost::posix_time::time_duration& handshake_timeout, const boost::posix_time::time_duration& failure_cooldown) :
+		m_max_pending_handshakes(max_pending_handshakes),
+		m_rate_limit(rate_limit),
+		m_handshake_timeout(handshake_timeout),
+		m_failure_cooldown(failure_cooldown)
+	{
+	}
+
+	inline void handshake_governor::set_limits(unsigned int max_pending_handshakes, unsigned int rate_limit, const boost::posix_time::time_duration& failure_cooldown)
+	{
+		m_max_pending_handshakes = max_pending_handshakes;
+		m_rate_limit = rate_limit;
+		m_failure_cooldown = failure_cooldown;
+	}
+
+	inline void handshake_governor::end_handshake(const ep_type& ep)
+	{
+		m_pending_handshake_map.erase(ep);
+	}
+
+	inline bool handshake_governor::end_handshake(const ep_type& ep, boost::posix_time::time_duration& duration)
+	{
+		const pending_handshake_map_type::iterator it = m_pending_handshake_map.find(ep);
+
+		if (it == m_pending_handshake_map.end())
+		{
+			return false;
+		}
+
+		duration = now() - it->second.start;
+		m_pending_handshake_map.erase(it);
+
+		return true;
+	}
+
+	inline bool handshake_governor::has_pending_handshake(const ep_type& ep) const
+	{
+		return (m_pending_handshake_map.find(ep) != m_pending_handshake_map.end());
+	}
+
+	inline size_t handshake_governor::pending_handshake_count() const
+	{
+		return m_pending_handshake_map.size();
+	}
+
+	inline void handshake_governor::clear()
+	{
+		m_source_state_map.clear();
+		m_cooldown_map.clear();
+		m_pending_handshake_map.clear();
+	}
+
+	inline boost::posix_time::ptime handshake_governor::now()
+	{
+		return boost::posix_time::microsec_clock::universal_time();
+	}
+}
+
+#endif /* FREELAN_HANDSHAKE_GOVERNOR_HPP */
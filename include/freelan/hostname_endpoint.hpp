@@ -158,6 +158,18 @@ namespace freelan
 	 */
 	std::istream& operator>>(std::istream& is, hostname_endpoint& value);
 
+	/**
+	 * \brief Parse an endpoint from a character range.
+	 * \param begin The first character.
+	 * \param end The past-the-end character.
+	 * \param value The value. Only modified on success.
+	 * \param ec The error code, set on failure and cleared on success.
+	 * \return The position past the last parsed character, or begin on failure.
+	 *
+	 * The parsing itself performs no allocation: only the resulting hostname and service strings are allocated.
+	 */
+	const char* parse(const char* begin, const char* end, hostname_endpoint& value, boost::system::error_code& ec);
+
 	/**
 	 * \brief Compare two endpoints.
 	 * \param lhs The left argument.
@@ -226,6 +226,20 @@ namespace freelan
 	template <typename AddressType>
 	std::istream& operator>>(std::istream& is, ip_endpoint<AddressType>& value);
 
+	/**
+	 * \brief Parse an endpoint from a character range.
+	 * \tparam AddressType The address type.
+	 * \param begin The first character.
+	 * \param end The past-the-end character.
+	 * \param value The value. Only modified on success.
+	 * \param ec The error code, set on failure and cleared on success.
+	 * \return The position past the last parsed character, or begin on failure.
+	 *
+	 * The parsing itself performs no allocation.
+	 */
+	template <typename AddressType>
+	const char* parse(const char* begin, const char* end, ip_endpoint<AddressType>& value, boost::system::error_code& ec);
+
 	/**
 	 * \brief Compare two endpoints.
 	 * \param lhs The left argument.
@@ -46,11 +46,132 @@
 #ifndef FREELAN_IP_NETWORK_ADDRESS_HPP
 #define FREELAN_IP_NETWORK_ADDRESS_HPP
 
+#include <vector>
+
 #include <boost/asio.hpp>
 #include <boost/variant.hpp>
+#include <boost/cstdint.hpp>
 
 namespace freelan
 {
+	/**
+	 * \brief Get a network mask word.
+	 * \tparam WordType The word type.
+	 * \param prefix_length The count of leading bits set in the word.
+	 * \return The mask word.
+	 */
+	template <typename WordType>
+	inline WordType make_mask_word(unsigned int prefix_length)
+	{
+		const unsigned int bits = sizeof(WordType) * 8;
+
+		if (prefix_length == 0)
+		{
+			return 0;
+		}
+		else if (prefix_length >= bits)
+		{
+			return ~static_cast<WordType>(0);
+		}
+		else
+		{
+			return static_cast<WordType>(~static_cast<WordType>(0) << (bits - prefix_length));
+		}
+	}
+
+	/**
+	 * \brief The IP network address traits.
+	 * \tparam AddressType The address type.
+	 *
+	 * Addresses and masks are handled as host-order words, so that a membership test is a bitwise and and a comparison per word.
+	 */
+	template <typename AddressType>
+	struct ip_network_address_traits;
+
+	/**
+	 * \brief The IPv4 network address traits.
+	 */
+	template <>
+	struct ip_network_address_traits<boost::asio::ip::address_v4>
+	{
+		/**
+		 * \brief The word type.
+		 */
+		typedef boost::uint32_t word_type;
+
+		/**
+		 * \brief The count of words in an address.
+		 */
+		static const size_t word_count = 1;
+
+		/**
+		 * \brief Convert an address to words.
+		 * \param address The address.
+		 * \param words The words.
+		 */
+		static void to_words(const boost::asio::ip::address_v4& address, word_type* words)
+		{
+			words[0] = static_cast<word_type>(address.to_ulong());
+		}
+
+		/**
+		 * \brief Get the mask words for a prefix length.
+		 * \param prefix_length The prefix length.
+		 * \param words The words.
+		 */
+		static void to_mask_words(unsigned int prefix_length, word_type* words)
+		{
+			words[0] = make_mask_word<word_type>(prefix_length);
+		}
+	};
+
+	/**
+	 * \brief The IPv6 network address traits.
+	 */
+	template <>
+	struct ip_network_address_traits<boost::asio::ip::address_v6>
+	{
+		/**
+		 * \brief The word type.
+		 */
+		typedef boost::uint64_t word_type;
+
+		/**
+		 * \brief The count of words in an address.
+		 */
+		static const size_t word_count = 2;
+
+		/**
+		 * \brief Convert an address to words.
+		 * \param address The address.
+		 * \param words The words.
+		 */
+		static void to_words(const boost::asio::ip::address_v6& address, word_type* words)
+		{
+			const boost::asio::ip::address_v6::bytes_type bytes = address.to_bytes();
+
+			words[0] = 0;
+			words[1] = 0;
+
+			for (size_t i = 0; i < 8; ++i)
+			{
+				words[0] = (words[0] << 8) | bytes[i];
+				words[1] = (words[1] << 8) | bytes[i + 8];
+			}
+		}
+
+		/**
+		 * \brief Get the mask words for a prefix length.
+		 * \param prefix_length The prefix length.
+		 * \param words The words.
+		 */
+		static void to_mask_words(unsigned int prefix_length, word_type* words)
+		{
+			words[0] = make_mask_word<word_type>(prefix_length);
+			words[1] = make_mask_word<word_type>(prefix_length > 64 ? prefix_length - 64 : 0);
+		}
+	};
+
 	/**
 	 * \brief A generic IP network address template class.
 	 */
@@ -73,17 +194,27 @@ namespace freelan
 			 */
 			typedef AddressType address_type;
 
+			/**
+			 * \brief The traits type.
+			 */
+			typedef ip_network_address_traits<AddressType> traits_type;
+
+			/**
+			 * \brief The word type.
+			 */
+			typedef typename traits_type::word_type word_type;
+
 			/**
 			 * \brief Create an IP network address.
 			 */
-			base_ip_network_address() : m_address(), m_prefix_length(0) {};
+			base_ip_network_address() : m_address(), m_prefix_length(0) { update_words(); };
 
 			/**
 			 * \brief Create an IP network address.
 			 * \param _address The address.
 			 * \param _prefix_length The prefix length.
 			 */
-			base_ip_network_address(const address_type& _address, unsigned int _prefix_length) : m_address(_address), m_prefix_length(_prefix_length) {};
+			base_ip_network_address(const address_type& _address, unsigned int _prefix_length) : m_address(_address), m_prefix_length(_prefix_length) { update_words(); };
 
 			/**
 			 * \brief Check if the instance is null.
@@ -112,17 +243,69 @@ namespace freelan
 				return m_prefix_length;
 			}
 
+			/**
+			 * \brief Get the network words.
+			 * \return The traits_type::word_count network words, already masked.
+			 */
+			const word_type* network_words() const
+			{
+				return m_network_words;
+			}
+
+			/**
+			 * \brief Get the mask words.
+			 * \return The traits_type::word_count mask words.
+			 */
+			const word_type* mask_words() const
+			{
+				return m_mask_words;
+			}
+
 			/**
 			 * \brief Check if the specified address belongs to the network address.
 			 * \param addr The address to check.
 			 * \return true if addr belongs to the network address, false otherwise.
 			 */
-			bool has_address(const AddressType& addr) const;
+			bool has_address(const AddressType& addr) const
+			{
+				word_type words[traits_type::word_count];
+				traits_type::to_words(addr, words);
+
+				for (size_t i = 0; i < traits_type::word_count; ++i)
+				{
+					if ((words[i] & m_mask_words[i]) != m_network_words[i])
+						return false;
+				}
+
+				return true;
+			}
+
+			/**
+			 * \brief Check which of the specified addresses belong to the network address.
+			 * \param addresses The addresses to check.
+			 * \param count The count of addresses.
+			 * \param results An array of count elements. results[i] is set to true if addresses[i] belongs to the network address.
+			 * \return The count of addresses that belong to the network address.
+			 */
+			size_t has_addresses(const AddressType* addresses, size_t count, bool* results) const;
 
 		private:
 
+			void update_words()
+			{
+				traits_type::to_words(m_address, m_network_words);
+				traits_type::to_mask_words(m_prefix_length, m_mask_words);
+
+				for (size_t i = 0; i < traits_type::word_count; ++i)
+				{
+					m_network_words[i] &= m_mask_words[i];
+				}
+			}
+
 			address_type m_address;
 			unsigned int m_prefix_length;
+			word_type m_network_words[traits_type::word_count];
+			word_type m_mask_words[traits_type::word_count];
 
 			template<typename OtherAddressType> friend bool operator==(const base_ip_network_address<OtherAddressType>& lhs, const base_ip_network_address<OtherAddressType>& rhs);
 	};
@@ -147,6 +330,20 @@ namespace freelan
 	template <typename AddressType>
 	std::istream& operator>>(std::istream& is, base_ip_network_address<AddressType>& value);
 
+	/**
+	 * \brief Parse a network address from a character range.
+	 * \tparam AddressType The address type.
+	 * \param begin The first character.
+	 * \param end The past-the-end character.
+	 * \param value The value. Only modified on success.
+	 * \param ec The error code, set on failure and cleared on success.
+	 * \return The position past the last parsed character, or begin on failure.
+	 *
+	 * The parsing itself performs no allocation.
+	 */
+	template <typename AddressType>
+	const char* parse(const char* begin, const char* end, base_ip_network_address<AddressType>& value, boost::system::error_code& ec);
+
 	/**
 	 * \brief Compare two network addresses.
 	 * \param lhs The left argument.
@@ -186,6 +383,200 @@ namespace freelan
 	 */
 	typedef boost::variant<ipv4_network_address, ipv6_network_address> ip_network_address;
 
+	/**
+	 * \brief A list of network addresses, optimized for membership tests.
+	 *
+	 * The network and mask words of all the network addresses are stored contiguously so that an address can be checked against several networks at once.
+	 */
+	template <typename AddressType>
+	class base_ip_network_address_list
+	{
+		public:
+
+			/**
+			 * \brief The address type.
+			 */
+			typedef AddressType address_type;
+
+			/**
+			 * \brief The network address type.
+			 */
+			typedef base_ip_network_address<AddressType> network_address_type;
+
+			/**
+			 * \brief The traits type.
+			 */
+			typedef typename network_address_type::traits_type traits_type;
+
+			/**
+			 * \brief The word type.
+			 */
+			typedef typename traits_type::word_type word_type;
+
+			/**
+			 * \brief Create an empty list.
+			 */
+			base_ip_network_address_list() {};
+
+			/**
+			 * \brief Create a list from a range of network addresses.
+			 * \param begin An iterator to the first network address.
+			 * \param end An iterator past the last network address.
+			 */
+			template <typename NetworkAddressIterator>
+			base_ip_network_address_list(NetworkAddressIterator begin, NetworkAddressIterator end)
+			{
+				for (; begin != end; ++begin)
+				{
+					push_back(*begin);
+				}
+			}
+
+			/**
+			 * \brief Add a network address.
+			 * \param ina The network address.
+			 */
+			void push_back(const network_address_type& ina)
+			{
+				m_network_words.insert(m_network_words.end(), ina.network_words(), ina.network_words() + traits_type::word_count);
+				m_mask_words.insert(m_mask_words.end(), ina.mask_words(), ina.mask_words() + traits_type::word_count);
+			}
+
+			/**
+			 * \brief Remove all the network addresses.
+			 */
+			void clear()
+			{
+				m_network_words.clear();
+				m_mask_words.clear();
+			}
+
+			/**
+			 * \brief Get the count of network addresses.
+			 * \return The count of network addresses.
+			 */
+			size_t size() const
+			{
+				return m_network_words.size() / traits_type::word_count;
+			}
+
+			/**
+			 * \brief Check if the list is empty.
+			 * \return true if the list is empty.
+			 */
+			bool empty() const
+			{
+				return m_network_words.empty();
+			}
+
+			/**
+			 * \brief Check if the specified address belongs to one of the network addresses.
+			 * \param addr The address to check.
+			 * \return true if addr belongs to at least one of the network addresses.
+			 */
+			bool has_address(const AddressType& addr) const;
+
+		private:
+
+			std::vector<word_type> m_network_words;
+			std::vector<word_type> m_mask_words;
+	};
+
+	/**
+	 * \brief The IPv4 list instantiation.
+	 */
+	typedef base_ip_network_address_list<boost::asio::ip::address_v4> ipv4_network_address_list;
+
+	/**
+	 * \brief The IPv6 list instantiation.
+	 */
+	typedef base_ip_network_address_list<boost::asio::ip::address_v6> ipv6_network_address_list;
+
+	/**
+	 * \brief A list of IPv4 and IPv6 network addresses, optimized for membership tests.
+	 */
+	class ip_network_address_list
+	{
+		public:
+
+			/**
+			 * \brief Create an empty list.
+			 */
+			ip_network_address_list() {};
+
+			/**
+			 * \brief Create a list from a range of network addresses.
+			 * \param begin An iterator to the first network address.
+			 * \param end An iterator past the last network address.
+			 */
+			template <typename NetworkAddressIterator>
+			ip_network_address_list(NetworkAddressIterator begin, NetworkAddressIterator end)
+			{
+				for (; begin != end; ++begin)
+				{
+					push_back(*begin);
+				}
+			}
+
+			/**
+			 * \brief Add a network address.
+			 * \param ina The network address.
+			 */
+			void push_back(const ip_network_address& ina)
+			{
+				if (const ipv4_network_address* ipv4_ina = boost::get<ipv4_network_address>(&ina))
+				{
+					m_ipv4_list.push_back(*ipv4_ina);
+				}
+				else
+				{
+					m_ipv6_list.push_back(boost::get<ipv6_network_address>(ina));
+				}
+			}
+
+			/**
+			 * \brief Remove all the network addresses.
+			 */
+			void clear()
+			{
+				m_ipv4_list.clear();
+				m_ipv6_list.clear();
+			}
+
+			/**
+			 * \brief Get the count of network addresses.
+			 * \return The count of network addresses.
+			 */
+			size_t size() const
+			{
+				return m_ipv4_list.size() + m_ipv6_list.size();
+			}
+
+			/**
+			 * \brief Check if the list is empty.
+			 * \return true if the list is empty.
+			 */
+			bool empty() const
+			{
+				return m_ipv4_list.empty() && m_ipv6_list.empty();
+			}
+
+			/**
+			 * \brief Check if the specified address belongs to one of the network addresses.
+			 * \param addr The address to check.
+			 * \return true if addr belongs to at least one of the network addresses.
+			 */
+			bool has_address(const boost::asio::ip::address& addr) const
+			{
+				return addr.is_v4() ? m_ipv4_list.has_address(addr.to_v4()) : m_ipv6_list.has_address(addr.to_v6());
+			}
+
+		private:
+
+			ipv4_network_address_list m_ipv4_list;
+			ipv6_network_address_list m_ipv6_list;
+	};
+
 	/**
 	 * \brief A visitor that writes ip_network_address to output streams.
 	 */
@@ -235,6 +626,18 @@ namespace freelan
 	 */
 	std::istream& operator>>(std::istream& is, ip_network_address& value);
 
+	/**
+	 * \brief Parse an ip_network_address from a character range.
+	 * \param begin The first character.
+	 * \param end The past-the-end character.
+	 * \param value The value. Only modified on success.
+	 * \param ec The error code, set on failure and cleared on success.
+	 * \return The position past the last parsed character, or begin on failure.
+	 *
+	 * The address family is determined in a single scan: the IPv4 parser is not retried after an IPv6 failure.
+	 */
+	const char* parse(const char* begin, const char* end, ip_network_address& value, boost::system::error_code& ec);
+
 	/**
 	 * \brief Compare two ip_network_address.
 	 * \param lhs The left argument.
@@ -46,10 +46,70 @@
 #ifndef LOGGER_HPP
 #define LOGGER_HPP
 
-#include <iostream>
+#include <string>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+/**
+ * \brief The minimum log level compiled in.
+ *
+ * Statements written with FREELAN_LOG() whose level is below this value are
+ * removed at compile time. Values follow the log_level enumeration: 0 for
+ * LL_DEBUG up to 4 for LL_FATAL.
+ */
+#ifndef FREELAN_MINIMUM_LOG_LEVEL
+#define FREELAN_MINIMUM_LOG_LEVEL 0
+#endif
+
+/**
+ * \brief Log a message through a logger, lazily.
+ * \param _logger The logger.
+ * \param _level The log level.
+ * \param message The message, as a chain of values separated by <<.
+ *
+ * The message is only evaluated if the level is enabled at runtime. If the
+ * level is below FREELAN_MINIMUM_LOG_LEVEL, the statement is compiled out.
+ *
+ * Example:
+ * FREELAN_LOG(m_logger, LL_DEBUG, "Received HELLO_REQUEST from " << sender << ".");
+ */
+#define FREELAN_LOG(_logger, _level, message) \
+	do \
+	{ \
+		if ((_level) >= FREELAN_MINIMUM_LOG_LEVEL) \
+		{ \
+			if ((_logger).is_enabled(_level)) \
+			{ \
+				(_logger)(_level) << message; \
+			} \
+		} \
+	} \
+	while (false)
+
+/**
+ * \brief Log a message through a logger, lazily and with a rate limit.
+ * \param _logger The logger.
+ * \param _level The log level.
+ * \param message The message, as a chain of values separated by <<.
+ *
+ * Behaves like FREELAN_LOG() but the statement is subject to the rate limit
+ * of the logger: see logger::set_rate_limit(). Use it for messages that can be
+ * triggered once per packet.
+ */
+#define FREELAN_LOG_LIMITED(_logger, _level, message) \
+	do \
+	{ \
+		if ((_level) >= FREELAN_MINIMUM_LOG_LEVEL) \
+		{ \
+			if ((_logger).is_enabled(_level) && (_logger).check_rate_limit((_level), __FILE__, __LINE__)) \
+			{ \
+				(_logger)(_level) << message; \
+			} \
+		} \
+	} \
+	while (false)
 
 namespace freelan
 {
@@ -66,6 +126,10 @@ namespace freelan
 	};
 
 	class logger_stream;
+	class log_queue;
+	class log_rate_limiter;
+	class metrics_registry;
+	class counter;
 
 	/**
 	 * \brief A logger class.
@@ -79,6 +143,21 @@ namespace freelan
 			 */
 			typedef boost::function<void (log_level, const std::string&)> log_callback_type;
 
+			/**
+			 * \brief The default capacity of the asynchronous mode queue.
+			 */
+			static const size_t DEFAULT_QUEUE_CAPACITY;
+
+			/**
+			 * \brief The default count of entries a rate-limited site can log in a row.
+			 */
+			static const unsigned int DEFAULT_RATE_LIMIT_BURST;
+
+			/**
+			 * \brief The default time it takes for a rate-limited site to be able to log a full burst again.
+			 */
+			static const boost::posix_time::time_duration DEFAULT_RATE_LIMIT_PERIOD;
+
 			/**
 			 * \brief Create a new logger.
 			 * \param callback The callback to use for logging.
@@ -106,17 +185,94 @@ namespace freelan
 			 */
 			log_level level() const;
 
-		private:
+			/**
+			 * \brief Check if the specified log level is enabled.
+			 * \param level The log level.
+			 * \return true if entries at the specified level are logged.
+			 */
+			bool is_enabled(log_level level) const;
 
-			void flush(log_level);
+			/**
+			 * \brief Switch the logger to the asynchronous mode.
+			 * \param capacity The maximum count of pending log entries. Cannot exceed 65535.
+			 *
+			 * In asynchronous mode, log entries are pushed to a bounded lock-free
+			 * queue and a dedicated thread calls the callback. Logging never
+			 * blocks on a slow callback and log() can then be called from any
+			 * thread. Entries that do not fit in the queue are dropped and
+			 * counted, and messages longer than log_queue::MAX_MESSAGE_SIZE are
+			 * truncated.
+			 *
+			 * The copies of the logger made after this call share the queue. The
+			 * thread drains the queue and stops when the last copy is destroyed.
+			 */
+			void set_asynchronous(size_t capacity = DEFAULT_QUEUE_CAPACITY);
+
+			/**
+			 * \brief Check if the logger is in asynchronous mode.
+			 * \return true if the logger is in asynchronous mode.
+			 */
+			bool is_asynchronous() const;
+
+			/**
+			 * \brief Get the count of log entries dropped because the queue was full.
+			 * \return The count of dropped entries. Always 0 in synchronous mode.
+			 */
+			unsigned long dropped_count() const;
+
+			/**
+			 * \brief Set the rate limit of the FREELAN_LOG_LIMITED() statements.
+			 * \param burst The count of entries a site can log in a row. 0 disables the rate limit.
+			 * \param period The time it takes for a site to be able to log a full burst again.
+			 *
+			 * Every (level, file, line) site is limited separately. Once a site is
+			 * accepted again, the count of entries it could not log is reported in
+			 * a separate entry. If the site stays quiet for a whole period instead,
+			 * the count is reported by flush_suppressed_entries().
+			 *
+			 * The rate limit is shared with the copies of the logger.
+			 */
+			void set_rate_limit(unsigned int burst, const boost::posix_time::time_duration& period);
+
+			/**
+			 * \brief Check the rate limit of a log site.
+			 * \param level The log level.
+			 * \param file The source file.
+			 * \param line The source line.
+			 * \return true if the entry can be logged.
+			 *
+			 * Use FREELAN_LOG_LIMITED() instead of calling this method directly.
+			 */
+			bool check_rate_limit(log_level level, const char* file, unsigned int line);
+
+			/**
+			 * \brief Report the entries refused by the rate limit of the sites that stopped logging.
+			 *
+			 * The sites are scanned at most once per rate limit period. This method
+			 * is called by check_rate_limit() and should also be called periodically
+			 * so that the last flood of a site is reported even if nothing else is
+			 * logged.
+			 */
+			void flush_suppressed_entries();
+
+			/**
+			 * \brief Register the logger metrics.
+			 * \param registry The registry.
+			 *
+			 * The logger must outlive the registry. Its copies made after this call
+			 * count their entries in the same registry.
+			 */
+			void set_metrics(metrics_registry& registry);
 
 		private:
 
-			std::ostream& os();
+			void write(log_level, const char*, size_t);
 
 			log_callback_type m_callback;
 			log_level m_level;
-			boost::shared_ptr<std::ostream> m_os;
+			boost::shared_ptr<log_queue> m_queue;
+			boost::shared_ptr<log_rate_limiter> m_rate_limiter;
+			counter* m_entries_counter;
 
 			friend class logger_stream;
 	};
@@ -125,6 +281,16 @@ namespace freelan
 	{
 		return m_level;
 	}
+
+	inline bool logger::is_enabled(log_level _level) const
+	{
+		return (_level >= FREELAN_MINIMUM_LOG_LEVEL) && (_level >= m_level);
+	}
+
+	inline bool logger::is_asynchronous() const
+	{
+		return static_cast<bool>(m_queue);
+	}
 }
 
 #endif /* LOGGER_HPP */
@@ -48,18 +48,37 @@
 
 #include "logger.hpp"
 
+#include <string>
+#include <streambuf>
+#include <ostream>
+
 #include <boost/optional.hpp>
-#include <boost/make_shared.hpp>
+#include <boost/utility/in_place_factory.hpp>
 
 namespace freelan
 {
 	/**
 	 * \brief A logger stream class.
+	 *
+	 * A logger stream formats a log entry in a buffer it holds and hands it to
+	 * its logger when destroyed. Formatting entries that fit in the buffer does
+	 * not allocate memory.
+	 *
+	 * The formatting itself is done by a per-thread std::ostream whose buffer
+	 * is redirected to the logger stream buffer, so that no std::ostream has to
+	 * be constructed for every log entry.
 	 */
 	class logger_stream
 	{
 		public:
 
+			/**
+			 * \brief The size of the formatting buffer.
+			 *
+			 * Longer entries are formatted in a dynamically allocated buffer.
+			 */
+			static const size_t BUFFER_SIZE = 256;
+
 			/**
 			 * \brief The manipulator type.
 			 */
@@ -84,6 +103,19 @@ namespace freelan
 			 */
 			explicit logger_stream(logger& logger, log_level level);
 
+			/**
+			 * \brief Transfer a logger stream.
+			 * \param other The logger stream to transfer. It will log nothing once the call completes.
+			 *
+			 * Only one logger stream hands a given entry to the logger.
+			 */
+			logger_stream(const logger_stream& other);
+
+			/**
+			 * \brief Hand the formatted entry to the logger.
+			 */
+			~logger_stream();
+
 			/**
 			 * \brief Write something to the logger stream.
 			 * \param val The value to write.
@@ -108,34 +140,56 @@ namespace freelan
 
 		private:
 
-			class flusher
+			class buffer : public std::streambuf
 			{
 				public:
 
-					flusher(logger_stream& ls);
-					~flusher();
+					buffer();
+
+					const char* data() const;
+					size_t size() const;
+
+				protected:
+
+					int_type overflow(int_type);
+					std::streamsize xsputn(const char*, std::streamsize);
 
 				private:
 
-					logger_stream& m_ls;
+					char m_data[BUFFER_SIZE];
+					std::string m_overflow;
 			};
 
-			void flush();
+			static std::ostream& formatting_stream();
 
-			boost::optional<logger> m_logger;
+			logger_stream& operator=(const logger_stream&);
+
+			void attach();
+
+			mutable logger* m_logger;
 			log_level m_level;
-			boost::shared_ptr<flusher> m_flusher;
+			boost::optional<buffer> m_buffer;
+			std::ostream* m_os;
+			std::streambuf* m_previous_buffer;
 	};
 
-	inline logger_stream::logger_stream()
+	inline logger_stream::logger_stream() :
+		m_logger(NULL),
+		m_level(LL_DEBUG),
+		m_os(NULL),
+		m_previous_buffer(NULL)
 	{
 	}
 
-	inline logger_stream::logger_stream(logger& logger, log_level level) :
-		m_logger(logger),
-		m_level(level)
+	inline logger_stream::logger_stream(logger& _logger, log_level level) :
+		m_logger(&_logger),
+		m_level(level),
+		m_os(&formatting_stream()),
+		m_previous_buffer(NULL)
 	{
-		m_flusher.reset(new flusher(*this));
+		m_buffer = boost::in_place();
+
+		attach();
 	}
 
 	template <typename T>
@@ -143,7 +197,7 @@ namespace freelan
 	{
 		if (m_logger)
 		{
-			m_logger->os() << val;
+			*m_os << val;
 		}
 
 		return *this;
@@ -153,7 +207,7 @@ namespace freelan
 	{
 		if (m_logger)
 		{
-			m_logger->os() << manipulator;
+			*m_os << manipulator;
 		}
 
 		return *this;
@@ -164,22 +218,14 @@ namespace freelan
 		return manipulator(*this);
 	}
 
-	inline logger_stream::flusher::flusher(logger_stream& ls) :
-		m_ls(ls)
+	inline const char* logger_stream::buffer::data() const
 	{
+		return m_overflow.empty() ? m_data : m_overflow.data();
 	}
 
-	inline logger_stream::flusher::~flusher()
+	inline size_t logger_stream::buffer::size() const
 	{
-		m_ls.flush();
-	}
-
-	inline void logger_stream::flush()
-	{
-		if (m_logger)
-		{
-			m_logger->flush(m_level);
-		}
+		return m_overflow.empty() ? static_cast<size_t>(pptr() - pbase()) : m_overflow.size();
 	}
 }
 
@@ -0,0 +1,426 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file metrics.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief The metrics classes.
+ */
+
+#ifndef FREELAN_METRICS_HPP
+#define FREELAN_METRICS_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+
+#include <boost/array.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace freelan
+{
+	/**
+	 * \brief The metric types.
+	 */
+	enum metric_type
+	{
+		MT_COUNTER, /**< \brief A monotonic counter. */
+		MT_GAUGE, /**< \brief A value that can go up and down. */
+		MT_HISTOGRAM /**< \brief A distribution of values. */
+	};
+
+	/**
+	 * \brief A monotonic counter.
+	 *
+	 * All methods can be called from any thread.
+	 */
+	class counter : private boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief Create a new counter.
+			 */
+			counter();
+
+			/**
+			 * \brief Increment the counter.
+			 * \param value The value to add.
+			 */
+			void increment(boost::uint64_t value = 1);
+
+			/**
+			 * \brief Get the value of the counter.
+			 * \return The value of the counter.
+			 */
+			boost::uint64_t value() const;
+
+		private:
+
+			boost::atomic<boost::uint64_t> m_value;
+	};
+
+	/**
+	 * \brief A value that can go up and down.
+	 *
+	 * All methods can be called from any thread.
+	 */
+	class gauge : private boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief Create a new gauge.
+			 */
+			gauge();
+
+			/**
+			 * \brief Set the value of the gauge.
+			 * \param value The value.
+			 */
+			void set(boost::int64_t value);
+
+			/**
+			 * \brief Add to the value of the gauge.
+			 * \param value The value to add. Can be negative.
+			 */
+			void add(boost::int64_t value);
+
+			/**
+			 * \brief Get the value of the gauge.
+			 * \return The value of the gauge.
+			 */
+			boost::int64_t value() const;
+
+		private:
+
+			boost::atomic<boost::int64_t> m_value;
+	};
+
+	/**
+	 * \brief A snapshot of a histogram.
+	 */
+	struct histogram_snapshot
+	{
+		/**
+		 * \brief Create an empty snapshot.
+		 */
+		histogram_snapshot();
+
+		/**
+		 * \brief Get an upper bound of the specified quantile.
+		 * \param quantile The quantile, between 0 and 1.
+		 * \return The upper bound of the bucket that contains the quantile, or 0 if the snapshot is empty.
+		 */
+		boost::uint64_t value_at_quantile(double quantile) const;
+
+		/**
+		 * \brief The count of recorded values.
+		 */
+		boost::uint64_t count;
+
+		/**
+		 * \brief The sum of the recorded values.
+		 */
+		boost::uint64_t sum;
+
+		/**
+		 * \brief The count of values per bucket. See histogram::bucket_upper_bound().
+		 */
+		std::vector<boost::uint64_t> buckets;
+	};
+
+	/**
+	 * \brief A distribution of positive integer values.
+	 *
+	 * Values are counted in log-linear buckets: every power of two is split in
+	 * SUB_BUCKET_COUNT linear buckets, which bounds the relative error to
+	 * 1 / SUB_BUCKET_COUNT. Recording a value is lock-free and does not
+	 * allocate.
+	 *
+	 * All methods can be called from any thread.
+	 */
+	class histogram : private boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief The count of linear buckets per power of two.
+			 */
+			static const unsigned int SUB_BUCKET_COUNT = 8;
+
+			/**
+			 * \brief The count of buckets.
+			 */
+			static const size_t BUCKET_COUNT = 496;
+
+			/**
+			 * \brief Get the index of the bucket of a value.
+			 * \param value The value.
+			 * \return The index of the bucket.
+			 */
+			static size_t bucket_index(boost::uint64_t value);
+
+			/**
+			 * \brief Get the highest value counted in a bucket.
+			 * \param index The index of the bucket.
+			 * \return The highest value counted in the bucket.
+			 */
+			static boost::uint64_t bucket_upper_bound(size_t index);
+
+			/**
+			 * \brief Create a new histogram.
+			 */
+			histogram();
+
+			/**
+			 * \brief Record a value.
+			 * \param value The value.
+			 */
+			void record(boost::uint64_t value);
+
+			/**
+			 * \brief Record a duration, in microseconds.
+			 * \param duration The duration. Negative durations are recorded as 0.
+			 */
+			void record(const boost::posix_time::time_duration& duration);
+
+			/**
+			 * \brief Get a snapshot of the histogram.
+			 * \return The snapshot.
+			 */
+			histogram_snapshot snapshot() const;
+
+		private:
+
+			boost::array<boost::atomic<boost::uint64_t>, BUCKET_COUNT> m_buckets;
+			boost::atomic<boost::uint64_t> m_count;
+			boost::atomic<boost::uint64_t> m_sum;
+	};
+
+	/**
+	 * \brief A snapshot of a metric.
+	 */
+	struct metric_snapshot
+	{
+		/**
+		 * \brief The name.
+		 */
+		std::string name;
+
+		/**
+		 * \brief The description.
+		 */
+		std::string help;
+
+		/**
+		 * \brief The type.
+		 */
+		metric_type type;
+
+		/**
+		 * \brief The value, for counters and gauges.
+		 */
+		boost::int64_t value;
+
+		/**
+		 * \brief The distribution, for histograms.
+		 */
+		histogram_snapshot distribution;
+	};
+
+	/**
+	 * \brief A snapshot of all the metrics of a registry, sorted by name.
+	 */
+	typedef std::vector<metric_snapshot> metrics_snapshot;
+
+	/**
+	 * \brief A registry of metrics.
+	 *
+	 * Metrics are registered once by name and live as long as the registry.
+	 * Registering a name twice with the same type returns the existing metric.
+	 *
+	 * All methods can be called from any thread.
+	 */
+	class metrics_registry : private boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief A callback that computes the value of a metric when a snapshot is taken.
+			 */
+			typedef boost::function<boost::int64_t ()> value_callback;
+
+			/**
+			 * \brief Register a counter.
+			 * \param name The name of the counter, following the Prometheus conventions.
+			 * \param help The description of the counter.
+			 * \return The counter.
+			 */
+			freelan::counter& register_counter(const std::string& name, const std::string& help);
+
+			/**
+			 * \brief Register a gauge.
+			 * \param name The name of the gauge, following the Prometheus conventions.
+			 * \param help The description of the gauge.
+			 * \return The gauge.
+			 */
+			freelan::gauge& register_gauge(const std::string& name, const std::string& help);
+
+			/**
+			 * \brief Register a histogram.
+			 * \param name The name of the histogram, following the Prometheus conventions.
+			 * \param help The description of the histogram.
+			 * \return The histogram.
+			 */
+			freelan::histogram& register_histogram(const std::string& name, const std::string& help);
+
+			/**
+			 * \brief Register a counter or a gauge whose value is computed when a snapshot is taken.
+			 * \param name The name of the metric, following the Prometheus conventions.
+			 * \param help The description of the metric.
+			 * \param type The type of the metric. Cannot be MT_HISTOGRAM.
+			 * \param callback The callback. It must remain valid until it is unregistered.
+			 *
+			 * Registering a callback replaces the previous one with the same name.
+			 */
+			void register_callback(const std::string& name, const std::string& help, metric_type type, value_callback callback);
+
+			/**
+			 * \brief Unregister a callback.
+			 * \param name The name of the metric.
+			 */
+			void unregister_callback(const std::string& name);
+
+			/**
+			 * \brief Take a snapshot of all the metrics.
+			 * \return The snapshot.
+			 */
+			metrics_snapshot snapshot() const;
+
+			/**
+			 * \brief Write a snapshot of all the metrics in the Prometheus text format.
+			 * \param os The output stream.
+			 */
+			void write_prometheus(std::ostream& os) const;
+
+		private:
+
+			struct entry
+			{
+				std::string help;
+				metric_type type;
+				boost::shared_ptr<freelan::counter> counter;
+				boost::shared_ptr<freelan::gauge> gauge;
+				boost::shared_ptr<freelan::histogram> histogram;
+				value_callback callback;
+			};
+
+			typedef std::map<std::string, entry> entry_map_type;
+
+			entry& get_entry(const std::string&, const std::string&, metric_type);
+
+			mutable boost::mutex m_mutex;
+			entry_map_type m_entry_map;
+	};
+
+	inline counter::counter() :
+		m_value(0)
+	{
+	}
+
+	inline void counter::increment(boost::uint64_t _value)
+	{
+		m_value.fetch_add(_value, boost::memory_order_relaxed);
+	}
+
+	inline boost::uint64_t counter::value() const
+	{
+		return m_value.load(boost::memory_order_relaxed);
+	}
+
+	inline gauge::gauge() :
+		m_value(0)
+	{
+	}
+
+	inline void gauge::set(boost::int64_t _value)
+	{
+		m_value.store(_value, boost::memory_order_relaxed);
+	}
+
+	inline void gauge::add(boost::int64_t _value)
+	{
+		m_value.fetch_add(_value, boost::memory_order_relaxed);
+	}
+
+	inline boost::int64_t gauge::value() const
+	{
+		return m_value.load(boost::memory_order_relaxed);
+	}
+
+	inline histogram_snapshot::histogram_snapshot() :
+		count(0),
+		sum(0)
+	{
+	}
+
+	inline void histogram::record(boost::uint64_t value)
+	{
+		m_buckets[bucket_index(value)].fetch_add(1, boost::memory_order_relaxed);
+		m_count.fetch_add(1, boost::memory_order_relaxed);
+		m_sum.fetch_add(value, boost::memory_order_relaxed);
+	}
+
+	inline void histogram::record(const boost::posix_time::time_duration& duration)
+	{
+		const boost::int64_t microseconds = duration.total_microseconds();
+
+		record(static_cast<boost::uint64_t>(microseconds > 0 ? microseconds : 0));
+	}
+}
+
+#endif /* FREELAN_METRICS_HPP */
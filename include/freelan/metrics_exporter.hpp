@@ -0,0 +1,133 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file metrics_exporter.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A metrics exporter class.
+ */
+
+#ifndef FREELAN_METRICS_EXPORTER_HPP
+#define FREELAN_METRICS_EXPORTER_HPP
+
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "metrics.hpp"
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+
+namespace freelan
+{
+	/**
+	 * \brief A class that serves the metrics of a registry over a Unix domain socket.
+	 *
+	 * Every connection gets a snapshot of the registry in the Prometheus text
+	 * format, wrapped in a minimal HTTP response, then the connection is
+	 * closed. For instance:
+	 *
+	 * curl --unix-socket /var/run/freelan/metrics.sock http://localhost/metrics
+	 *
+	 * The exporter runs on the specified io_service. A client gets a few
+	 * seconds to send its request and read the response before its
+	 * connection is closed. When the process runs out of descriptors or
+	 * memory, accepting is paused for a while. Other accept errors stop the
+	 * exporter.
+	 */
+	class metrics_exporter : private boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief Create a new metrics exporter.
+			 * \param io_service The io_service to use.
+			 * \param registry The registry to export. Must outlive the exporter.
+			 */
+			metrics_exporter(boost::asio::io_service& io_service, const metrics_registry& registry);
+
+			/**
+			 * \brief Close the exporter.
+			 */
+			~metrics_exporter();
+
+			/**
+			 * \brief Start serving the metrics.
+			 * \param path The path of the socket. An existing socket at this path is replaced.
+			 *
+			 * If a file that is not a socket exists at path, a std::runtime_error is thrown.
+			 */
+			void open(const std::string& path);
+
+			/**
+			 * \brief Stop serving the metrics and remove the socket.
+			 */
+			void close();
+
+		private:
+
+			struct connection;
+
+			typedef boost::shared_ptr<connection> connection_ptr;
+
+			void async_accept();
+			void handle_accept(connection_ptr, const boost::system::error_code&);
+			void handle_accept_retry(const boost::system::error_code&);
+			void handle_read(connection_ptr, const boost::system::error_code&);
+			static void handle_write(connection_ptr, const boost::system::error_code&);
+			static void handle_timeout(connection_ptr, const boost::system::error_code&);
+
+			boost::asio::io_service& m_io_service;
+			const metrics_registry& m_registry;
+			boost::asio::local::stream_protocol::acceptor m_acceptor;
+			boost::asio::deadline_timer m_accept_retry_timer;
+			std::string m_path;
+	};
+
+	inline metrics_exporter::~metrics_exporter()
+	{
+		close();
+	}
+}
+
+#endif
+
+#endif /* FREELAN_METRICS_EXPORTER_HPP */
@@ -0,0 +1,209 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file path_prober.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A path quality prober class.
+ */
+
+#ifndef FREELAN_PATH_PROBER_HPP
+#define FREELAN_PATH_PROBER_HPP
+
+#include <boost/asio.hpp>
+#include <boost/array.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace freelan
+{
+	/**
+	 * \brief The quality of a path, as measured by a path_prober.
+	 */
+	struct path_quality
+	{
+		/**
+		 * \brief The count of probes of the measurement window that were answered or timed out.
+		 */
+		unsigned int probes_sent;
+
+		/**
+		 * \brief The count of probes of the measurement window that were answered.
+		 */
+		unsigned int probes_received;
+
+		/**
+		 * \brief The ratio of unanswered probes, between 0 and 1.
+		 *
+		 * Probes sent less than a timeout ago are not accounted for.
+		 */
+		double loss_rate;
+
+		/**
+		 * \brief The last round-trip time, without the time spent by the remote host.
+		 */
+		boost::posix_time::time_duration rtt;
+
+		/**
+		 * \brief The interarrival jitter, as defined in RFC 3550.
+		 */
+		boost::posix_time::time_duration jitter;
+
+		/**
+		 * \brief The last one-way delay from the local host to the remote host, corrected with the estimated clock offset.
+		 */
+		boost::posix_time::time_duration forward_delay;
+
+		/**
+		 * \brief The last one-way delay from the remote host to the local host, corrected with the estimated clock offset.
+		 */
+		boost::posix_time::time_duration backward_delay;
+
+		/**
+		 * \brief The estimated offset of the remote clock relative to the local clock.
+		 */
+		boost::posix_time::time_duration clock_offset;
+	};
+
+	/**
+	 * \brief A class that measures the quality of a path with sequenced and timestamped probes.
+	 *
+	 * The local host sends probe requests that carry a sequence number and
+	 * their transmit time. The remote host answers each one with a probe
+	 * response that adds its own receive and transmit times. From the four
+	 * timestamps, the local host computes the round-trip time and the clock
+	 * offset, like NTP does. The offset estimate comes from the sample with the
+	 * lowest round-trip time seen so far, which is the least affected by
+	 * queuing, and corrects the one-way delays.
+	 *
+	 * The class only builds and parses messages: sending them is up to the
+	 * caller.
+	 */
+	class path_prober
+	{
+		public:
+
+			/**
+			 * \brief The message types.
+			 */
+			enum message_type
+			{
+				MT_INVALID = 0, /**< \brief Not a probe message. */
+				MT_REQUEST = 1, /**< \brief A probe request. */
+				MT_RESPONSE = 2 /**< \brief A probe response. */
+			};
+
+			/**
+			 * \brief The size of a probe message.
+			 */
+			static const size_t MESSAGE_SIZE = 32;
+
+			/**
+			 * \brief The count of the last probes the measurements are computed on.
+			 */
+			static const size_t WINDOW_SIZE = 64;
+
+			/**
+			 * \brief The time after which an unanswered probe is considered lost.
+			 */
+			static const boost::posix_time::time_duration PROBE_TIMEOUT;
+
+			/**
+			 * \brief Get the type of a message.
+			 * \param message The message.
+			 * \return The type of the message, or MT_INVALID if it is not a probe message.
+			 */
+			static message_type get_message_type(boost::asio::const_buffer message);
+
+			/**
+			 * \brief Write the response to a probe request.
+			 * \param request The probe request. Its type must be MT_REQUEST.
+			 * \param receive_time The date at which the request was received.
+			 * \param response The buffer to write the response to. Must be at least MESSAGE_SIZE bytes long.
+			 * \return The size of the response.
+			 */
+			static size_t write_response(boost::asio::const_buffer request, const boost::posix_time::ptime& receive_time, boost::asio::mutable_buffer response);
+
+			/**
+			 * \brief Create a new path prober.
+			 */
+			path_prober();
+
+			/**
+			 * \brief Write a new probe request.
+			 * \param request The buffer to write the request to. Must be at least MESSAGE_SIZE bytes long.
+			 * \return The size of the request.
+			 */
+			size_t write_request(boost::asio::mutable_buffer request);
+
+			/**
+			 * \brief Handle a probe response.
+			 * \param response The probe response. Its type must be MT_RESPONSE.
+			 * \param receive_time The date at which the response was received.
+			 * \return true if the response matched a probe of the window.
+			 */
+			bool handle_response(boost::asio::const_buffer response, const boost::posix_time::ptime& receive_time);
+
+			/**
+			 * \brief Get the measured quality of the path.
+			 * \return The measured quality.
+			 */
+			path_quality quality() const;
+
+		private:
+
+			struct probe
+			{
+				probe() : sequence(0), answered(false) {}
+
+				boost::uint32_t sequence;
+				boost::posix_time::ptime send_time;
+				bool answered;
+				boost::posix_time::time_duration rtt;
+				boost::posix_time::time_duration clock_offset;
+			};
+
+			boost::uint32_t m_next_sequence;
+			boost::array<probe, WINDOW_SIZE> m_window;
+			boost::posix_time::time_duration m_last_transit;
+			path_quality m_quality;
+	};
+}
+
+#endif /* FREELAN_PATH_PROBER_HPP */
@@ -0,0 +1,154 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file pcap_reader.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A pcap and pcapng file reader class.
+ */
+
+#ifndef FREELAN_PCAP_READER_HPP
+#define FREELAN_PCAP_READER_HPP
+
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace freelan
+{
+	/**
+	 * \brief A frame read from a capture file.
+	 */
+	struct pcap_frame
+	{
+		/**
+		 * \brief The capture time, relative to the Unix epoch.
+		 */
+		boost::posix_time::time_duration timestamp;
+
+		/**
+		 * \brief The captured data. Valid as long as the reader exists.
+		 */
+		boost::asio::const_buffer data;
+
+		/**
+		 * \brief The size of the frame on the wire. Greater than the size of data if the frame was truncated by the capture.
+		 */
+		size_t original_size;
+	};
+
+	/**
+	 * \brief A reader of ethernet captures.
+	 *
+	 * Reads the classic pcap format (microsecond and nanosecond variants, in
+	 * both byte orders) and the pcapng format (enhanced and simple packet
+	 * blocks). Only frames captured on ethernet interfaces are returned: the
+	 * other frames are counted as skipped.
+	 *
+	 * The whole file is loaded in memory when the reader is created, so that
+	 * replaying the frames does not involve any I/O.
+	 */
+	class pcap_reader : private boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief Load a capture file.
+			 * \param path The path of the file.
+			 *
+			 * A std::runtime_error is thrown if the file cannot be read or is not a capture file.
+			 */
+			explicit pcap_reader(const std::string& path);
+
+			/**
+			 * \brief Read the next frame.
+			 * \param frame The frame to fill.
+			 * \return true if a frame was read, false at the end of the file.
+			 *
+			 * A std::runtime_error is thrown if the file is malformed.
+			 */
+			bool read(pcap_frame& frame);
+
+			/**
+			 * \brief Go back to the first frame.
+			 */
+			void rewind();
+
+			/**
+			 * \brief Get the count of frames skipped because they were not captured on an ethernet interface.
+			 * \return The count of skipped frames.
+			 */
+			unsigned long skipped_count() const;
+
+		private:
+
+			struct interface_description
+			{
+				bool is_ethernet;
+				boost::uint32_t snap_length;
+				boost::uint64_t ticks_per_second;
+			};
+
+			bool read_pcap(pcap_frame&);
+			bool read_pcapng(pcap_frame&);
+			void read_section_header(size_t, size_t);
+			void read_interface_description(size_t, size_t);
+			boost::uint16_t read_uint16(size_t) const;
+			boost::uint32_t read_uint32(size_t) const;
+			static boost::posix_time::time_duration to_time_duration(boost::uint64_t, boost::uint64_t);
+
+			std::vector<boost::uint8_t> m_data;
+			bool m_is_pcapng;
+			bool m_swapped;
+			size_t m_offset;
+			std::vector<interface_description> m_interfaces;
+			unsigned long m_skipped_count;
+	};
+
+	inline unsigned long pcap_reader::skipped_count() const
+	{
+		return m_skipped_count;
+	}
+}
+
+#endif /* FREELAN_PCAP_READER_HPP */
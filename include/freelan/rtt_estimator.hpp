@@ -0,0 +1,176 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file rtt_estimator.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A round-trip time estimator class.
+ */
+
+#ifndef FREELAN_RTT_ESTIMATOR_HPP
+#define FREELAN_RTT_ESTIMATOR_HPP
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace freelan
+{
+	/**
+	 * \brief A class that estimates the round-trip time to a host and derives a timeout from it.
+	 *
+	 * The estimation follows RFC 6298: the smoothed round-trip time and its
+	 * variance are updated with every sample and the timeout is the smoothed
+	 * round-trip time plus four times the variance. Every unanswered request
+	 * doubles the timeout until the next sample.
+	 */
+	class rtt_estimator
+	{
+		public:
+
+			/**
+			 * \brief The clock granularity, used as a lower bound for the variance term.
+			 */
+			static const boost::posix_time::time_duration CLOCK_GRANULARITY;
+
+			/**
+			 * \brief Create a new estimator, without any sample.
+			 */
+			rtt_estimator();
+
+			/**
+			 * \brief Add a round-trip time sample.
+			 * \param rtt The measured round-trip time.
+			 *
+			 * The backoff is reset.
+			 */
+			void add_sample(const boost::posix_time::time_duration& rtt);
+
+			/**
+			 * \brief Report an unanswered request.
+			 *
+			 * The next timeout is doubled.
+			 */
+			void backoff();
+
+			/**
+			 * \brief Check if the estimator has received a sample.
+			 * \return true if the estimator has received a sample.
+			 */
+			bool has_samples() const;
+
+			/**
+			 * \brief Get the smoothed round-trip time.
+			 * \return The smoothed round-trip time. Not a date time if there is no sample.
+			 */
+			boost::posix_time::time_duration smoothed_rtt() const;
+
+			/**
+			 * \brief Get the round-trip time variation.
+			 * \return The round-trip time variation. Not a date time if there is no sample.
+			 */
+			boost::posix_time::time_duration rtt_variation() const;
+
+			/**
+			 * \brief Get the count of consecutive unanswered requests.
+			 * \return The count of consecutive unanswered requests.
+			 */
+			unsigned int backoff_count() const;
+
+			/**
+			 * \brief Get the date of the last sample or unanswered request.
+			 * \return The date of the last update. Not a date time if the estimator was never updated.
+			 */
+			boost::posix_time::ptime last_update() const;
+
+			/**
+			 * \brief Get the timeout.
+			 * \param initial_timeout The timeout to use if there is no sample.
+			 * \param min_timeout The minimum timeout.
+			 * \param max_timeout The maximum timeout.
+			 * \return The timeout, including the backoff.
+			 */
+			boost::posix_time::time_duration timeout(const boost::posix_time::time_duration& initial_timeout, const boost::posix_time::time_duration& min_timeout, const boost::posix_time::time_duration& max_timeout) const;
+
+		private:
+
+			boost::posix_time::time_duration m_smoothed_rtt;
+			boost::posix_time::time_duration m_rtt_variation;
+			unsigned int m_backoff_count;
+			boost::posix_time::ptime m_last_update;
+	};
+
+	inline rtt_estimator::rtt_estimator() :
+		m_smoothed_rtt(boost::posix_time::not_a_date_time),
+		m_rtt_variation(boost::posix_time::not_a_date_time),
+		m_backoff_count(0)
+	{
+	}
+
+	inline void rtt_estimator::backoff()
+	{
+		++m_backoff_count;
+		m_last_update = boost::posix_time::microsec_clock::universal_time();
+	}
+
+	inline bool rtt_estimator::has_samples() const
+	{
+		return !m_smoothed_rtt.is_not_a_date_time();
+	}
+
+	inline boost::posix_time::time_duration rtt_estimator::smoothed_rtt() const
+	{
+		return m_smoothed_rtt;
+	}
+
+	inline boost::posix_time::time_duration rtt_estimator::rtt_variation() const
+	{
+		return m_rtt_variation;
+	}
+
+	inline unsigned int rtt_estimator::backoff_count() const
+	{
+		return m_backoff_count;
+	}
+
+	inline boost::posix_time::ptime rtt_estimator::last_update() const
+	{
+		return m_last_update;
+	}
+}
+
+#endif /* FREELAN_RTT_ESTIMATOR_HPP */
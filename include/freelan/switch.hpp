@@ -54,6 +54,8 @@
 
 #include "switch_port.hpp"
 #include "configuration.hpp"
+#include "metrics.hpp"
+#include "frame_tracer.hpp"
 
 namespace freelan
 {
@@ -96,6 +98,14 @@ namespace freelan
 			 */
 			switch_(const switch_configuration& configuration, const unsigned int max_entries = MAX_ENTRIES_DEFAULT);
 
+			/**
+			 * \brief Change the switch configuration.
+			 * \param configuration The new switch configuration.
+			 *
+			 * The registered ports and the learned ethernet addresses are kept.
+			 */
+			void set_configuration(const switch_configuration& configuration);
+
 			/**
 			 * \brief Register a switch port.
 			 * \param port The port to register. Cannot be null.
@@ -123,12 +133,26 @@ namespace freelan
 			 * \param port The port from which the data comes. Cannot be null.
 			 * \param data The data.
 			 */
-			void receive_data(port_type port, boost::asio::const_buffer data);
+			void receive_data(const port_type& port, boost::asio::const_buffer data);
+
+			/**
+			 * \brief Register the switch metrics.
+			 * \param registry The registry. Must outlive the switch.
+			 */
+			void set_metrics(metrics_registry& registry);
+
+			/**
+			 * \brief Set the frame tracer.
+			 * \param tracer The frame tracer, or NULL to disable tracing. Must outlive the switch or be unset.
+			 */
+			void set_frame_tracer(frame_tracer* tracer);
 
 		private:
 
-			void send_data_from(port_type, boost::asio::const_buffer);
-			void send_data_from_to(port_type, port_type, boost::asio::const_buffer);
+			// The forwarding path must not allocate: ports are passed by reference and looked up, never inserted.
+			void send_data_from(const port_type&, boost::asio::const_buffer);
+			void send_data_from_to(const port_type&, const port_type&, boost::asio::const_buffer);
+			void send_data_to(const port_type&, boost::asio::const_buffer);
 
 			switch_configuration m_configuration;
 			unsigned int m_max_entries;
@@ -143,12 +167,35 @@ namespace freelan
 			static bool is_multicast_address(const ethernet_address_type& address);
 
 			ethernet_address_map_type m_ethernet_address_map;
+
+			// Metrics
+			counter* m_frames_counter;
+			counter* m_flooded_frames_counter;
+			counter* m_evicted_addresses_counter;
+			gauge* m_addresses_gauge;
+
+			frame_tracer* m_frame_tracer;
 	};
 
 	inline switch_::switch_(const switch_configuration& configuration, const unsigned int max_entries) :
 		m_configuration(configuration),
-		m_max_entries(max_entries)
+		m_max_entries(max_entries),
+		m_frames_counter(NULL),
+		m_flooded_frames_counter(NULL),
+		m_evicted_addresses_counter(NULL),
+		m_addresses_gauge(NULL),
+		m_frame_tracer(NULL)
+	{
+	}
+
+	inline void switch_::set_configuration(const switch_configuration& configuration)
+	{
+		m_configuration = configuration;
+	}
+
+	inline void switch_::set_frame_tracer(frame_tracer* tracer)
 	{
+		m_frame_tracer = tracer;
 	}
 
 	inline void switch_::register_port(port_type port, group_type group)
@@ -0,0 +1,118 @@
+/**
+ * \file apply_configuration.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A configuration update sample.
+ *
+ * A core is given a configuration whose dynamic contact list has a duplicate.
+ * Its own configuration is then applied twice: the dynamic contact list must
+ * be deduplicated and stay stable, and the listen endpoint, which cannot
+ * change in place, must keep its value.
+ *
+ * Usage: apply_configuration
+ */
+
+#include <freelan/freelan.hpp>
+
+#include <cryptoplus/cryptoplus.hpp>
+#include <cryptoplus/error/error_strings.hpp>
+#include <cryptoplus/x509/certificate.hpp>
+#include <cryptoplus/pkey/pkey.hpp>
+#include <cryptoplus/hash/message_digest_algorithm.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace
+{
+	fscp::identity_store generate_identity(const std::string& name)
+	{
+		using namespace cryptoplus;
+
+		const pkey::pkey private_key = pkey::pkey::from_rsa_key(pkey::rsa_key::generate_private_key(1024, 17, NULL, NULL, false));
+
+		x509::certificate certificate = x509::certificate::create();
+
+		certificate.set_version(2);
+		certificate.set_serial_number(asn1::integer::from_long(1));
+		certificate.set_public_key(private_key);
+		certificate.subject().push_back("CN", MBSTRING_ASC, name.c_str(), name.size());
+		certificate.set_issuer(certificate.subject());
+		certificate.set_not_before(asn1::utctime::from_ptime(boost::posix_time::second_clock::universal_time() - boost::posix_time::hours(1)));
+		certificate.set_not_after(asn1::utctime::from_ptime(boost::posix_time::second_clock::universal_time() + boost::posix_time::hours(24)));
+		certificate.sign(private_key, hash::message_digest_algorithm(NID_sha1));
+
+		return fscp::identity_store(certificate, private_key);
+	}
+
+	void check(bool condition, const std::string& what)
+	{
+		if (!condition)
+		{
+			throw std::runtime_error("Check failed: " + what);
+		}
+	}
+}
+
+int main()
+{
+	cryptoplus::crypto_initializer crypto_initializer;
+	cryptoplus::algorithms_initializer algorithms_initializer;
+	cryptoplus::error::error_strings_initializer error_strings_initializer;
+
+	try
+	{
+		boost::asio::io_service io_service;
+
+		const freelan::logger logger(freelan::logger::log_callback_type(0), freelan::LL_ERROR);
+
+		freelan::configuration configuration;
+
+		configuration.security.identity = generate_identity("local");
+		configuration.security.certificate_validation_method = freelan::security_configuration::CVM_NONE;
+		configuration.tap_adapter.enabled = false;
+
+		const freelan::fscp_configuration::cert_type first = generate_identity("first").signature_certificate();
+		const freelan::fscp_configuration::cert_type second = generate_identity("second").signature_certificate();
+
+		configuration.fscp.dynamic_contact_list.push_back(first);
+		configuration.fscp.dynamic_contact_list.push_back(second);
+		configuration.fscp.dynamic_contact_list.push_back(first);
+
+		freelan::core core(io_service, configuration, logger);
+
+		core.apply_configuration(core.configuration());
+		io_service.run();
+		io_service.reset();
+
+		check(core.configuration().fscp.dynamic_contact_list.size() == 2, "the dynamic contact list is deduplicated");
+
+		core.apply_configuration(core.configuration());
+		io_service.run();
+		io_service.reset();
+
+		check(core.configuration().fscp.dynamic_contact_list.size() == 2, "the dynamic contact list is stable");
+
+		freelan::configuration new_configuration = core.configuration();
+		new_configuration.fscp.listen_on = freelan::ipv4_endpoint(boost::asio::ip::address_v4::loopback(), 12100);
+
+		core.apply_configuration(new_configuration);
+		io_service.run();
+
+		check(core.configuration().fscp.listen_on == configuration.fscp.listen_on, "the listen endpoint is kept");
+
+		std::cout << "Configuration updates: OK" << std::endl;
+	}
+	catch (std::exception& ex)
+	{
+		std::cerr << "Exception caught: " << ex.what() << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
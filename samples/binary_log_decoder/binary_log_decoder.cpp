@@ -0,0 +1,63 @@
+/**
+ * \file binary_log_decoder.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A binary log decoder sample.
+ */
+
+#include <freelan/binary_logger.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+	const char* log_level_name(freelan::log_level level)
+	{
+		switch (level)
+		{
+			case freelan::LL_DEBUG:
+				return "DEBUG";
+			case freelan::LL_INFORMATION:
+				return "INFORMATION";
+			case freelan::LL_WARNING:
+				return "WARNING";
+			case freelan::LL_ERROR:
+				return "ERROR";
+			case freelan::LL_FATAL:
+				return "FATAL";
+		}
+
+		return "UNKNOWN";
+	}
+
+	void on_entry(const freelan::binary_log_entry& entry)
+	{
+		std::cout << boost::posix_time::to_iso_extended_string(entry.timestamp) << " [" << log_level_name(entry.level) << "] " << entry.message << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 2)
+	{
+		std::cerr << "Usage: " << argv[0] << " <binary log file>" << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	try
+	{
+		const freelan::binary_log_reader reader(argv[1]);
+
+		reader.read(&on_entry);
+	}
+	catch (std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
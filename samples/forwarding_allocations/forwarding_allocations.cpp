@@ -0,0 +1,235 @@
+/**
+ * \file forwarding_allocations.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A forwarding path allocation counting sample.
+ *
+ * Counts the heap allocations made by the switch for every forwarded frame,
+ * on each switch forwarding path:
+ * - switch: tap to peer: a unicast frame from the tap adapter port to an endpoint port;
+ * - switch: peer to tap: a unicast frame from an endpoint port to the tap adapter port;
+ * - switch: relay: a unicast frame from an endpoint port to another one;
+ * - switch: flood: a broadcast frame from the tap adapter port to all the endpoint ports.
+ *
+ * The ports are the ones the core uses, with callbacks that do not send
+ * anything. Only the switch is measured: the tap adapter reads, the FSCP
+ * encryption and the asio handlers of the core are not part of these paths
+ * and their allocations are not counted.
+ *
+ * Every path has an allocation budget: the sample fails if a path exceeds
+ * it, so that the count of allocations per frame can be enforced.
+ *
+ * Usage: forwarding_allocations [<iterations>]
+ */
+
+#include <freelan/switch.hpp>
+#include <freelan/callback_switch_port.hpp>
+#include <freelan/endpoint_switch_port.hpp>
+#include <freelan/metrics.hpp>
+
+#include <cstdlib>
+#include <new>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/array.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace
+{
+	// The switch is used synchronously, from the main thread only.
+	unsigned long allocation_count = 0;
+
+	const freelan::switch_::group_type TAP_ADAPTERS_GROUP = 0;
+	const freelan::switch_::group_type ENDPOINTS_GROUP = 1;
+	const unsigned int ENDPOINT_COUNT = 4;
+	const size_t FRAME_SIZE = 1400;
+
+	unsigned long write_count = 0;
+
+	void on_tap_adapter_data(boost::asio::const_buffer)
+	{
+		++write_count;
+	}
+
+	void on_endpoint_data(const freelan::endpoint_switch_port::ep_type&, boost::asio::const_buffer)
+	{
+		++write_count;
+	}
+
+	typedef boost::array<unsigned char, FRAME_SIZE> frame_type;
+
+	frame_type make_frame(unsigned char target, unsigned char sender)
+	{
+		frame_type frame;
+		frame.assign(0);
+
+		// Locally administered addresses, except for the broadcast address.
+		const unsigned char target_address[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, target };
+		const unsigned char broadcast_address[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+		const unsigned char sender_address[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, sender };
+
+		std::copy(target_address, target_address + 6, frame.begin());
+
+		if (target == 0xff)
+		{
+			std::copy(broadcast_address, broadcast_address + 6, frame.begin());
+		}
+
+		std::copy(sender_address, sender_address + 6, frame.begin() + 6);
+		frame[12] = 0x08;
+		frame[13] = 0x00;
+
+		return frame;
+	}
+
+	struct path
+	{
+		std::string name;
+		freelan::switch_::port_type source;
+		frame_type frame;
+		unsigned long expected_writes;
+		double budget;
+	};
+
+	bool run(freelan::switch_& _switch, const path& _path, unsigned int iterations)
+	{
+		const unsigned long allocation_count_before = allocation_count;
+		const unsigned long write_count_before = write_count;
+		const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+		for (unsigned int i = 0; i < iterations; ++i)
+		{
+			_switch.receive_data(_path.source, boost::asio::buffer(_path.frame));
+		}
+
+		const boost::posix_time::time_duration duration = boost::posix_time::microsec_clock::universal_time() - start;
+		const double allocations = static_cast<double>(allocation_count - allocation_count_before) / iterations;
+		const unsigned long writes = (write_count - write_count_before) / iterations;
+		const bool success = (allocations <= _path.budget) && (writes == _path.expected_writes);
+
+		std::cout << _path.name << ": "
+			<< (duration.total_nanoseconds() / iterations) << " ns per frame, "
+			<< allocations << " allocation(s) per frame (budget: " << _path.budget << "), "
+			<< writes << " port write(s) per frame (expected: " << _path.expected_writes << ")"
+			<< (success ? "" : " FAILED") << std::endl;
+
+		return success;
+	}
+}
+
+void* operator new(size_t size) throw (std::bad_alloc)
+{
+	++allocation_count;
+
+	void* const ptr = std::malloc(size ? size : 1);
+
+	if (!ptr)
+	{
+		throw std::bad_alloc();
+	}
+
+	return ptr;
+}
+
+void operator delete(void* ptr) throw ()
+{
+	std::free(ptr);
+}
+
+void* operator new[](size_t size) throw (std::bad_alloc)
+{
+	return operator new(size);
+}
+
+void operator delete[](void* ptr) throw ()
+{
+	operator delete(ptr);
+}
+
+int main(int argc, char** argv)
+{
+	try
+	{
+		const unsigned int iterations = (argc > 1) ? boost::lexical_cast<unsigned int>(argv[1]) : 1000000;
+
+		freelan::metrics_registry registry;
+		freelan::switch_configuration configuration;
+		configuration.relay_mode_enabled = true;
+
+		freelan::switch_ _switch(configuration);
+		_switch.set_metrics(registry);
+
+		const freelan::switch_::port_type tap_adapter_port = boost::make_shared<freelan::callback_switch_port>(&on_tap_adapter_data);
+		_switch.register_port(tap_adapter_port, TAP_ADAPTERS_GROUP);
+
+		std::vector<freelan::switch_::port_type> endpoint_ports;
+
+		for (unsigned int i = 0; i < ENDPOINT_COUNT; ++i)
+		{
+			const freelan::endpoint_switch_port::ep_type ep(boost::asio::ip::address_v4::loopback(), static_cast<unsigned short>(12000 + i));
+
+			endpoint_ports.push_back(boost::make_shared<freelan::endpoint_switch_port>(ep, &on_endpoint_data));
+			_switch.register_port(endpoint_ports.back(), ENDPOINTS_GROUP);
+		}
+
+		// The addresses are learned beforehand: learning a new address allocates a table entry. Only unicast frames teach addresses.
+		_switch.receive_data(tap_adapter_port, boost::asio::buffer(make_frame(0x10, 0x01)));
+
+		for (unsigned int i = 0; i < ENDPOINT_COUNT; ++i)
+		{
+			_switch.receive_data(endpoint_ports[i], boost::asio::buffer(make_frame(0x01, static_cast<unsigned char>(0x10 + i))));
+		}
+
+		path paths[4];
+
+		paths[0].name = "switch: tap to peer";
+		paths[0].source = tap_adapter_port;
+		paths[0].frame = make_frame(0x10, 0x01);
+		paths[0].expected_writes = 1;
+		paths[0].budget = 0;
+
+		paths[1].name = "switch: peer to tap";
+		paths[1].source = endpoint_ports[0];
+		paths[1].frame = make_frame(0x01, 0x10);
+		paths[1].expected_writes = 1;
+		paths[1].budget = 0;
+
+		paths[2].name = "switch: relay";
+		paths[2].source = endpoint_ports[0];
+		paths[2].frame = make_frame(0x11, 0x10);
+		paths[2].expected_writes = 1;
+		paths[2].budget = 0;
+
+		paths[3].name = "switch: flood";
+		paths[3].source = tap_adapter_port;
+		paths[3].frame = make_frame(0xff, 0x01);
+		paths[3].expected_writes = ENDPOINT_COUNT;
+		paths[3].budget = 0;
+
+		std::cout << "Only the switch is measured: tap adapter, FSCP and asio allocations are not counted." << std::endl;
+
+		bool success = true;
+
+		for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); ++i)
+		{
+			success = run(_switch, paths[i], iterations) && success;
+		}
+
+		if (!success)
+		{
+			return EXIT_FAILURE;
+		}
+	}
+	catch (std::exception& ex)
+	{
+		std::cerr << "Exception caught: " << ex.what() << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,91 @@
+/**
+ * \file logger_benchmark.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A logger benchmark sample.
+ */
+
+#include <freelan/logger.hpp>
+#include <freelan/logger_stream.hpp>
+
+#include <cstdlib>
+#include <new>
+#include <iostream>
+#include <string>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace
+{
+	// Counting allocations is only meaningful from the main thread: the logger is used synchronously here.
+	unsigned long allocation_count = 0;
+
+	const unsigned int ITERATIONS = 1000000;
+
+	size_t total_size = 0;
+
+	void on_log(freelan::log_level, const std::string& msg)
+	{
+		total_size += msg.size();
+	}
+
+	void run(const std::string& name, freelan::logger& logger, freelan::log_level level)
+	{
+		const unsigned long allocation_count_before = allocation_count;
+		const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+		for (unsigned int i = 0; i < ITERATIONS; ++i)
+		{
+			logger(level) << "Sending contact request for " << i << " certificate(s) to " << "192.168.0.1:12000" << "...";
+		}
+
+		const boost::posix_time::time_duration duration = boost::posix_time::microsec_clock::universal_time() - start;
+		const unsigned long allocations = allocation_count - allocation_count_before;
+
+		std::cout << name << ": "
+			<< (duration.total_nanoseconds() / ITERATIONS) << " ns per statement, "
+			<< (static_cast<double>(allocations) / ITERATIONS) << " allocation(s) per statement" << std::endl;
+	}
+}
+
+void* operator new(size_t size) throw (std::bad_alloc)
+{
+	++allocation_count;
+
+	void* const ptr = std::malloc(size ? size : 1);
+
+	if (!ptr)
+	{
+		throw std::bad_alloc();
+	}
+
+	return ptr;
+}
+
+void operator delete(void* ptr) throw ()
+{
+	std::free(ptr);
+}
+
+int main()
+{
+	try
+	{
+		freelan::logger logger(&on_log, freelan::LL_INFORMATION);
+
+		// The first statement allocates the per-thread message string.
+		logger(freelan::LL_WARNING) << "Warming up.";
+
+		run("Enabled", logger, freelan::LL_WARNING);
+		run("Disabled", logger, freelan::LL_DEBUG);
+
+		std::cout << "Total size logged: " << total_size << " byte(s)" << std::endl;
+	}
+	catch (std::exception& ex)
+	{
+		std::cerr << "Exception caught: " << ex.what() << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
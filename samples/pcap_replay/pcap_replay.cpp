@@ -0,0 +1,484 @@
+/**
+ * \file pcap_replay.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A capture replay sample.
+ *
+ * Replays the ethernet frames of a pcap or pcapng capture through the data
+ * path of a core, without any network: the ARP and DHCP filters and the ARP
+ * proxy, as set up by the core when the proxies are enabled, then the switch.
+ * The switch ports are in-memory mock ports that count the frames they get.
+ *
+ * The ingress port of a frame depends on its source address: port 0 stands
+ * for the tap adapter and the other ports for the peers. Every new source
+ * address is assigned to the next port, in turn.
+ *
+ * Usage: pcap_replay <capture> [--timing line|original] [--speed <factor>]
+ *   [--loops <count>] [--ports <count>] [--routing switch|hub]
+ *   [--format text|json]
+ */
+
+#include <freelan/pcap_reader.hpp>
+#include <freelan/switch.hpp>
+#include <freelan/callback_switch_port.hpp>
+#include <freelan/metrics.hpp>
+
+#include <asiotap/osi/arp_proxy.hpp>
+#include <asiotap/osi/dhcp_proxy.hpp>
+#include <asiotap/osi/complex_filter.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/array.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace
+{
+	const freelan::switch_::group_type TAP_ADAPTERS_GROUP = 0;
+	const freelan::switch_::group_type ENDPOINTS_GROUP = 1;
+
+	struct parameters
+	{
+		parameters() :
+			original_timing(false),
+			speed(1.0),
+			loops(1),
+			ports(8),
+			json(false)
+		{
+		}
+
+		std::string path;
+		bool original_timing;
+		double speed;
+		unsigned int loops;
+		unsigned int ports;
+		freelan::switch_configuration switch_configuration;
+		bool json;
+	};
+
+	parameters parse_parameters(int argc, char** argv)
+	{
+		parameters result;
+
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string option = argv[i];
+
+			if (option.compare(0, 2, "--") != 0)
+			{
+				result.path = option;
+
+				continue;
+			}
+
+			if (i + 1 >= argc)
+			{
+				throw std::runtime_error("Missing value for option: " + option);
+			}
+
+			const std::string value = argv[++i];
+
+			if (option == "--timing")
+			{
+				if ((value != "line") && (value != "original"))
+				{
+					throw std::runtime_error("Unknown timing: " + value);
+				}
+
+				result.original_timing = (value == "original");
+			}
+			else if (option == "--speed")
+			{
+				result.speed = boost::lexical_cast<double>(value);
+
+				if (result.speed <= 0)
+				{
+					throw std::runtime_error("The speed must be positive");
+				}
+			}
+			else if (option == "--loops")
+			{
+				result.loops = std::max(boost::lexical_cast<unsigned int>(value), 1U);
+			}
+			else if (option == "--ports")
+			{
+				result.ports = boost::lexical_cast<unsigned int>(value);
+
+				if (result.ports < 2)
+				{
+					throw std::runtime_error("At least two ports are needed");
+				}
+			}
+			else if (option == "--routing")
+			{
+				std::istringstream iss(value);
+
+				if (!(iss >> result.switch_configuration.routing_method))
+				{
+					throw std::runtime_error("Unknown routing method: " + value);
+				}
+			}
+			else if (option == "--format")
+			{
+				if ((value != "text") && (value != "json"))
+				{
+					throw std::runtime_error("Unknown format: " + value);
+				}
+
+				result.json = (value == "json");
+			}
+			else
+			{
+				throw std::runtime_error("Unknown option: " + option);
+			}
+		}
+
+		if (result.path.empty())
+		{
+			throw std::runtime_error("No capture file specified");
+		}
+
+		return result;
+	}
+
+	typedef boost::array<unsigned char, 6> ethernet_address;
+
+	class replayer
+	{
+		public:
+
+			replayer(const parameters& _parameters) :
+				m_parameters(_parameters),
+				m_switch(_parameters.switch_configuration),
+				m_arp_filter(m_ethernet_filter),
+				m_ipv4_filter(m_ethernet_filter),
+				m_udp_filter(m_ipv4_filter),
+				m_bootp_filter(m_udp_filter),
+				m_dhcp_filter(m_bootp_filter),
+				m_arp_proxy(boost::asio::buffer(m_proxy_buffer), boost::bind(&replayer::on_proxy_data, this, _1), m_arp_filter),
+				m_dhcp_proxy(boost::asio::buffer(m_proxy_buffer), boost::bind(&replayer::on_proxy_data, this, _1), m_dhcp_filter),
+				m_port_writes(_parameters.ports, 0),
+				m_frame_writes(0),
+				m_next_port(0),
+				m_frames(0),
+				m_bytes(0),
+				m_multicast_frames(0),
+				m_arp_frames(0),
+				m_dhcp_frames(0),
+				m_proxy_replies(0),
+				m_dropped_frames(0),
+				m_unicast_frames(0),
+				m_flooded_frames(0),
+				m_truncated_frames(0),
+				m_skipped_frames(0)
+			{
+				m_switch.set_metrics(m_metrics);
+
+				for (unsigned int i = 0; i < _parameters.ports; ++i)
+				{
+					const freelan::switch_::port_type port = boost::make_shared<freelan::callback_switch_port>(boost::bind(&replayer::on_port_data, this, i, _1));
+
+					m_switch.register_port(port, (i == 0) ? TAP_ADAPTERS_GROUP : ENDPOINTS_GROUP);
+					m_ports.push_back(port);
+				}
+
+				// The proxies answer every request, like a core configured to do so.
+				m_arp_proxy.set_arp_request_callback(boost::bind(&replayer::on_arp_request, this, _1, _2));
+				m_dhcp_proxy.set_hardware_address(asiotap::osi::ethernet_address());
+			}
+
+			void run(freelan::pcap_reader& reader)
+			{
+				freelan::pcap_frame frame;
+
+				const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+				for (unsigned int loop = 0; loop < m_parameters.loops; ++loop)
+				{
+					reader.rewind();
+
+					boost::posix_time::time_duration first_timestamp;
+					const boost::posix_time::ptime loop_start = boost::posix_time::microsec_clock::universal_time();
+					bool first = true;
+
+					while (reader.read(frame))
+					{
+						if (m_parameters.original_timing)
+						{
+							if (first)
+							{
+								first_timestamp = frame.timestamp;
+								first = false;
+							}
+
+							const boost::posix_time::ptime due = loop_start + boost::posix_time::microseconds(static_cast<boost::int64_t>((frame.timestamp - first_timestamp).total_microseconds() / m_parameters.speed));
+
+							if (due > boost::posix_time::microsec_clock::universal_time())
+							{
+								boost::this_thread::sleep(due);
+							}
+
+							const boost::posix_time::ptime frame_start = boost::posix_time::microsec_clock::universal_time();
+
+							handle_frame(frame);
+
+							m_processing_time += boost::posix_time::microsec_clock::universal_time() - frame_start;
+						}
+						else
+						{
+							handle_frame(frame);
+						}
+					}
+				}
+
+				m_duration = boost::posix_time::microsec_clock::universal_time() - start;
+
+				if (!m_parameters.original_timing)
+				{
+					m_processing_time = m_duration;
+				}
+
+				m_skipped_frames = reader.skipped_count();
+			}
+
+			void report(std::ostream& os) const
+			{
+				const double processing_time = static_cast<double>(m_processing_time.total_microseconds()) / 1000000.0;
+				const double fps = (processing_time > 0) ? m_frames / processing_time : 0;
+				const double gbps = (processing_time > 0) ? m_bytes * 8 / processing_time / 1e9 : 0;
+				const double average_size = (m_frames > 0) ? static_cast<double>(m_bytes) / m_frames : 0;
+				const freelan::metrics_snapshot snapshot = m_metrics.snapshot();
+
+				if (m_parameters.json)
+				{
+					os << "{"
+						<< "\"capture\": \"" << m_parameters.path << "\""
+						<< ", \"timing\": \"" << (m_parameters.original_timing ? "original" : "line") << "\""
+						<< ", \"loops\": " << m_parameters.loops
+						<< ", \"ports\": " << m_parameters.ports
+						<< ", \"frames\": " << m_frames
+						<< ", \"bytes\": " << m_bytes
+						<< ", \"skipped_frames\": " << m_skipped_frames
+						<< ", \"truncated_frames\": " << m_truncated_frames
+						<< ", \"average_frame_size\": " << average_size
+						<< ", \"multicast_frames\": " << m_multicast_frames
+						<< ", \"duration_s\": " << static_cast<double>(m_duration.total_microseconds()) / 1000000.0
+						<< ", \"processing_time_s\": " << processing_time
+						<< ", \"frames_per_s\": " << fps
+						<< ", \"gbit_per_s\": " << gbps
+						<< ", \"arp_frames\": " << m_arp_frames
+						<< ", \"dhcp_frames\": " << m_dhcp_frames
+						<< ", \"proxy_replies\": " << m_proxy_replies
+						<< ", \"dropped_frames\": " << m_dropped_frames
+						<< ", \"unicast_frames\": " << m_unicast_frames
+						<< ", \"flooded_frames\": " << m_flooded_frames
+						<< ", \"port_writes\": " << m_frame_writes;
+
+					BOOST_FOREACH(const freelan::metric_snapshot& metric, snapshot)
+					{
+						if (metric.type != freelan::MT_HISTOGRAM)
+						{
+							os << ", \"" << metric.name << "\": " << metric.value;
+						}
+					}
+
+					os << "}" << std::endl;
+				}
+				else
+				{
+					os << "Capture: " << m_parameters.path << " (" << m_parameters.loops << " loop(s), " << (m_parameters.original_timing ? "original" : "line rate") << " timing)" << std::endl;
+					os << "Frames: " << m_frames << " (" << m_bytes << " byte(s), " << average_size << " byte(s) on average, " << m_multicast_frames << " multicast, " << m_skipped_frames << " skipped, " << m_truncated_frames << " truncated)" << std::endl;
+					os << "Processing time: " << processing_time << " s, " << fps << " frame(s)/s, " << gbps << " Gbit/s" << std::endl;
+					os << "Filters: " << m_arp_frames << " ARP, " << m_dhcp_frames << " DHCP, " << m_proxy_replies << " proxy reply(ies)" << std::endl;
+					os << "Switch decisions: " << m_unicast_frames << " unicast, " << m_flooded_frames << " flooded, " << m_dropped_frames << " dropped, " << m_frame_writes << " port write(s)" << std::endl;
+
+					for (size_t i = 0; i < m_port_writes.size(); ++i)
+					{
+						os << "  Port " << i << ((i == 0) ? " (tap adapter)" : "") << ": " << m_port_writes[i] << " frame(s)" << std::endl;
+					}
+
+					BOOST_FOREACH(const freelan::metric_snapshot& metric, snapshot)
+					{
+						if (metric.type != freelan::MT_HISTOGRAM)
+						{
+							os << metric.name << ": " << metric.value << std::endl;
+						}
+					}
+				}
+			}
+
+		private:
+
+			static const size_t ETHERNET_HEADER_SIZE = 14;
+
+			void handle_frame(const freelan::pcap_frame& frame)
+			{
+				const size_t size = boost::asio::buffer_size(frame.data);
+
+				if (size < frame.original_size)
+				{
+					++m_truncated_frames;
+				}
+
+				if (size < ETHERNET_HEADER_SIZE)
+				{
+					return;
+				}
+
+				const unsigned char* const buf = boost::asio::buffer_cast<const unsigned char*>(frame.data);
+
+				++m_frames;
+				m_bytes += size;
+
+				if (buf[0] & 0x01)
+				{
+					++m_multicast_frames;
+				}
+
+				// The same classification as the core does on the frames read from the tap adapter.
+				bool handled = false;
+
+				m_ethernet_filter.parse(frame.data);
+
+				if (m_arp_filter.get_last_helper())
+				{
+					++m_arp_frames;
+					handled = true;
+					m_arp_filter.clear_last_helper();
+				}
+
+				if (m_dhcp_filter.get_last_helper())
+				{
+					++m_dhcp_frames;
+					handled = true;
+					m_dhcp_filter.clear_last_helper();
+				}
+
+				if (handled)
+				{
+					return;
+				}
+
+				const unsigned long writes_before = m_frame_writes;
+
+				m_switch.receive_data(ingress_port(buf + 6), frame.data);
+
+				switch (m_frame_writes - writes_before)
+				{
+					case 0:
+						++m_dropped_frames;
+						break;
+					case 1:
+						++m_unicast_frames;
+						break;
+					default:
+						++m_flooded_frames;
+						break;
+				}
+			}
+
+			freelan::switch_::port_type ingress_port(const unsigned char* source)
+			{
+				ethernet_address address;
+				std::copy(source, source + address.size(), address.begin());
+
+				std::map<ethernet_address, size_t>::iterator it = m_ingress_ports.find(address);
+
+				if (it == m_ingress_ports.end())
+				{
+					it = m_ingress_ports.insert(std::make_pair(address, m_next_port)).first;
+					m_next_port = (m_next_port + 1) % m_ports.size();
+				}
+
+				return m_ports[it->second];
+			}
+
+			void on_port_data(size_t index, boost::asio::const_buffer)
+			{
+				++m_port_writes[index];
+				++m_frame_writes;
+			}
+
+			void on_proxy_data(boost::asio::const_buffer)
+			{
+				++m_proxy_replies;
+			}
+
+			bool on_arp_request(const boost::asio::ip::address_v4&, asiotap::osi::ethernet_address& address)
+			{
+				address = asiotap::osi::ethernet_address();
+
+				return true;
+			}
+
+			const parameters m_parameters;
+			freelan::metrics_registry m_metrics;
+			freelan::switch_ m_switch;
+			std::vector<freelan::switch_::port_type> m_ports;
+
+			asiotap::osi::filter<asiotap::osi::ethernet_frame> m_ethernet_filter;
+			asiotap::osi::complex_filter<asiotap::osi::arp_frame, asiotap::osi::ethernet_frame>::type m_arp_filter;
+			asiotap::osi::complex_filter<asiotap::osi::ipv4_frame, asiotap::osi::ethernet_frame>::type m_ipv4_filter;
+			asiotap::osi::complex_filter<asiotap::osi::udp_frame, asiotap::osi::ipv4_frame, asiotap::osi::ethernet_frame>::type m_udp_filter;
+			asiotap::osi::complex_filter<asiotap::osi::bootp_frame, asiotap::osi::udp_frame, asiotap::osi::ipv4_frame, asiotap::osi::ethernet_frame>::type m_bootp_filter;
+			asiotap::osi::complex_filter<asiotap::osi::dhcp_frame, asiotap::osi::bootp_frame, asiotap::osi::udp_frame, asiotap::osi::ipv4_frame, asiotap::osi::ethernet_frame>::type m_dhcp_filter;
+
+			boost::array<unsigned char, 2048> m_proxy_buffer;
+			asiotap::osi::proxy<asiotap::osi::arp_frame> m_arp_proxy;
+			asiotap::osi::proxy<asiotap::osi::dhcp_frame> m_dhcp_proxy;
+
+			std::vector<unsigned long> m_port_writes;
+			unsigned long m_frame_writes;
+			std::map<ethernet_address, size_t> m_ingress_ports;
+			size_t m_next_port;
+
+			unsigned long m_frames;
+			unsigned long m_bytes;
+			unsigned long m_multicast_frames;
+			unsigned long m_arp_frames;
+			unsigned long m_dhcp_frames;
+			unsigned long m_proxy_replies;
+			unsigned long m_dropped_frames;
+			unsigned long m_unicast_frames;
+			unsigned long m_flooded_frames;
+			unsigned long m_truncated_frames;
+			unsigned long m_skipped_frames;
+			boost::posix_time::time_duration m_duration;
+			boost::posix_time::time_duration m_processing_time;
+	};
+}
+
+int main(int argc, char** argv)
+{
+	try
+	{
+		const parameters _parameters = parse_parameters(argc, argv);
+
+		freelan::pcap_reader reader(_parameters.path);
+
+		replayer _replayer(_parameters);
+
+		_replayer.run(reader);
+		_replayer.report(std::cout);
+	}
+	catch (std::exception& ex)
+	{
+		std::cerr << "Exception caught: " << ex.what() << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
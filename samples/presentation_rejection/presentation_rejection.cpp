@@ -0,0 +1,197 @@
+/**
+ * \file presentation_rejection.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief An asynchronous presentation rejection sample.
+ *
+ * Two cores run in the same process on the loopback interface. The receiver
+ * validates certificates in dedicated threads and rejects all of them: the
+ * FSCP server has already stored the sender presentation by then, yet no
+ * session must be established on either side.
+ *
+ * Usage: presentation_rejection [--port <port>]
+ */
+
+#include <freelan/freelan.hpp>
+
+#include <cryptoplus/cryptoplus.hpp>
+#include <cryptoplus/error/error_strings.hpp>
+#include <cryptoplus/x509/certificate.hpp>
+#include <cryptoplus/pkey/pkey.hpp>
+#include <cryptoplus/hash/message_digest_algorithm.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace
+{
+	const boost::posix_time::time_duration OBSERVATION_PERIOD = boost::posix_time::seconds(3);
+
+	fscp::identity_store generate_identity(const std::string& name)
+	{
+		using namespace cryptoplus;
+
+		const pkey::pkey private_key = pkey::pkey::from_rsa_key(pkey::rsa_key::generate_private_key(2048, 17, NULL, NULL, false));
+
+		x509::certificate certificate = x509::certificate::create();
+
+		certificate.set_version(2);
+		certificate.set_serial_number(asn1::integer::from_long(1));
+		certificate.set_public_key(private_key);
+		certificate.subject().push_back("CN", MBSTRING_ASC, name.c_str(), name.size());
+		certificate.set_issuer(certificate.subject());
+		certificate.set_not_before(asn1::utctime::from_ptime(boost::posix_time::second_clock::universal_time() - boost::posix_time::hours(1)));
+		certificate.set_not_after(asn1::utctime::from_ptime(boost::posix_time::second_clock::universal_time() + boost::posix_time::hours(24)));
+		certificate.sign(private_key, hash::message_digest_algorithm(NID_sha1));
+
+		return fscp::identity_store(certificate, private_key);
+	}
+
+	freelan::configuration make_configuration(const std::string& name, unsigned short port, unsigned short peer_port)
+	{
+		freelan::configuration configuration;
+
+		configuration.fscp.listen_on = freelan::ipv4_endpoint(boost::asio::ip::address_v4::loopback(), port);
+
+		if (peer_port != 0)
+		{
+			configuration.fscp.contact_list.push_back(freelan::ipv4_endpoint(boost::asio::ip::address_v4::loopback(), peer_port));
+		}
+
+		// The certificates are self-signed.
+		configuration.security.identity = generate_identity(name);
+		configuration.security.certificate_validation_method = freelan::security_configuration::CVM_NONE;
+		configuration.tap_adapter.enabled = false;
+
+		return configuration;
+	}
+
+	class observer
+	{
+		public:
+
+			observer() :
+				m_validations(0),
+				m_sessions(0)
+			{
+			}
+
+			bool reject_certificate(freelan::core&, freelan::security_configuration::cert_type)
+			{
+				// Called from the validation threads.
+				boost::mutex::scoped_lock lock(m_mutex);
+
+				++m_validations;
+
+				return false;
+			}
+
+			void on_session_established(const freelan::core::ep_type& host)
+			{
+				std::cerr << "Unexpected session with " << host << "." << std::endl;
+
+				++m_sessions;
+			}
+
+			unsigned int validations() const
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+
+				return m_validations;
+			}
+
+			unsigned int sessions() const
+			{
+				return m_sessions;
+			}
+
+		private:
+
+			mutable boost::mutex m_mutex;
+			unsigned int m_validations;
+			unsigned int m_sessions;
+	};
+
+	unsigned short parse_port(int argc, char** argv)
+	{
+		if (argc == 1)
+		{
+			return 12200;
+		}
+
+		if ((argc != 3) || (std::string(argv[1]) != "--port"))
+		{
+			throw std::runtime_error("Usage: presentation_rejection [--port <port>]");
+		}
+
+		return boost::lexical_cast<unsigned short>(argv[2]);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	cryptoplus::crypto_initializer crypto_initializer;
+	cryptoplus::algorithms_initializer algorithms_initializer;
+	cryptoplus::error::error_strings_initializer error_strings_initializer;
+
+	try
+	{
+		const unsigned short port = parse_port(argc, argv);
+
+		boost::asio::io_service io_service;
+
+		const freelan::logger logger(freelan::logger::log_callback_type(0), freelan::LL_ERROR);
+
+		observer _observer;
+
+		freelan::configuration receiver_configuration = make_configuration("receiver", port + 1, 0);
+		receiver_configuration.security.certificate_validation_threads = 2;
+		receiver_configuration.security.certificate_validation_callback = boost::bind(&observer::reject_certificate, &_observer, _1, _2);
+
+		freelan::core sender(io_service, make_configuration("sender", port, port + 1), logger);
+		freelan::core receiver(io_service, receiver_configuration, logger);
+
+		sender.set_session_established_callback(boost::bind(&observer::on_session_established, &_observer, _1));
+		receiver.set_session_established_callback(boost::bind(&observer::on_session_established, &_observer, _1));
+
+		receiver.open();
+		sender.open();
+
+		boost::asio::deadline_timer timer(io_service, OBSERVATION_PERIOD);
+		timer.async_wait(boost::bind(&boost::asio::io_service::stop, &io_service));
+
+		io_service.run();
+
+		sender.close();
+		receiver.close();
+
+		if (_observer.validations() == 0)
+		{
+			std::cerr << "The sender presentation was never validated." << std::endl;
+
+			return EXIT_FAILURE;
+		}
+
+		if (_observer.sessions() != 0)
+		{
+			return EXIT_FAILURE;
+		}
+
+		std::cout << "Rejected presentations: " << _observer.validations() << ". Sessions: 0." << std::endl;
+	}
+	catch (std::exception& ex)
+	{
+		std::cerr << "Exception caught: " << ex.what() << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,733 @@
+/**
+ * \file scaling_harness.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief A control-plane scaling harness sample.
+ *
+ * One core (the hub) is opened on 127.0.0.1 and N lightweight peers, each
+ * a bare FSCP server with its own socket, join it at a given rate. Once all
+ * the sessions are established, some peers flap (close and reopen) and
+ * some leave.
+ *
+ * Every peer is bound to its own loopback address (127.1.x.y) so that the
+ * per-address handshake limits of the hub behave as in production. This
+ * works out of the box on Linux; other systems need loopback aliases.
+ *
+ * The process needs one file descriptor per peer: raise the limit with
+ * ulimit -n for large peer counts.
+ *
+ * Usage: scaling_harness [--peers <count>] [--join-rate <peers/s>]
+ *   [--flap <count>] [--leave <count>] [--leave-timeout <seconds>]
+ *   [--port <port>] [--format text|json]
+ */
+
+#include <freelan/freelan.hpp>
+#include <freelan/metrics.hpp>
+
+#include <cryptoplus/cryptoplus.hpp>
+#include <cryptoplus/error/error_strings.hpp>
+#include <cryptoplus/x509/certificate.hpp>
+#include <cryptoplus/pkey/pkey.hpp>
+#include <cryptoplus/hash/message_digest_algorithm.hpp>
+
+#include <fscp/server.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const boost::posix_time::time_duration TICK_PERIOD = boost::posix_time::milliseconds(10);
+	const boost::posix_time::time_duration REPORT_PERIOD = boost::posix_time::seconds(1);
+	const boost::posix_time::time_duration HELLO_TIMEOUT = boost::posix_time::seconds(3);
+	const boost::posix_time::time_duration SESSION_TIMEOUT = boost::posix_time::seconds(5);
+	const boost::posix_time::time_duration PHASE_TIMEOUT = boost::posix_time::minutes(5);
+
+	struct parameters
+	{
+		parameters() :
+			peers(1000),
+			join_rate(500),
+			flap(100),
+			leave(100),
+			leave_timeout(boost::posix_time::seconds(60)),
+			port(12000),
+			json(false)
+		{
+		}
+
+		unsigned int peers;
+		unsigned int join_rate;
+		unsigned int flap;
+		unsigned int leave;
+		boost::posix_time::time_duration leave_timeout;
+		unsigned short port;
+		bool json;
+	};
+
+	parameters parse_parameters(int argc, char** argv)
+	{
+		parameters result;
+
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string option = argv[i];
+
+			if (i + 1 >= argc)
+			{
+				throw std::runtime_error("Missing value for option: " + option);
+			}
+
+			const std::string value = argv[++i];
+
+			if (option == "--peers")
+			{
+				result.peers = boost::lexical_cast<unsigned int>(value);
+
+				if ((result.peers == 0) || (result.peers > 65000))
+				{
+					throw std::runtime_error("The peer count must be between 1 and 65000");
+				}
+			}
+			else if (option == "--join-rate")
+			{
+				result.join_rate = std::max(boost::lexical_cast<unsigned int>(value), 1U);
+			}
+			else if (option == "--flap")
+			{
+				result.flap = boost::lexical_cast<unsigned int>(value);
+			}
+			else if (option == "--leave")
+			{
+				result.leave = boost::lexical_cast<unsigned int>(value);
+			}
+			else if (option == "--leave-timeout")
+			{
+				result.leave_timeout = boost::posix_time::seconds(boost::lexical_cast<unsigned int>(value));
+			}
+			else if (option == "--port")
+			{
+				result.port = boost::lexical_cast<unsigned short>(value);
+			}
+			else if (option == "--format")
+			{
+				if ((value != "text") && (value != "json"))
+				{
+					throw std::runtime_error("Unknown format: " + value);
+				}
+
+				result.json = (value == "json");
+			}
+			else
+			{
+				throw std::runtime_error("Unknown option: " + option);
+			}
+		}
+
+		result.flap = std::min(result.flap, result.peers);
+		result.leave = std::min(result.leave, result.peers);
+
+		return result;
+	}
+
+	fscp::identity_store generate_identity(const std::string& name)
+	{
+		using namespace cryptoplus;
+
+		const pkey::pkey private_key = pkey::pkey::from_rsa_key(pkey::rsa_key::generate_private_key(2048, 17, NULL, NULL, false));
+
+		x509::certificate certificate = x509::certificate::create();
+
+		certificate.set_version(2);
+		certificate.set_serial_number(asn1::integer::from_long(1));
+		certificate.set_public_key(private_key);
+		certificate.subject().push_back("CN", MBSTRING_ASC, name.c_str(), name.size());
+		certificate.set_issuer(certificate.subject());
+		certificate.set_not_before(asn1::utctime::from_ptime(boost::posix_time::second_clock::universal_time() - boost::posix_time::hours(1)));
+		certificate.set_not_after(asn1::utctime::from_ptime(boost::posix_time::second_clock::universal_time() + boost::posix_time::hours(24)));
+		certificate.sign(private_key, hash::message_digest_algorithm(NID_sha1));
+
+		return fscp::identity_store(certificate, private_key);
+	}
+
+	// The resident set size of the process, in bytes, or 0 if unknown.
+	size_t resident_set_size()
+	{
+#ifdef __linux__
+		std::ifstream statm("/proc/self/statm");
+		size_t pages = 0;
+		size_t resident_pages = 0;
+
+		if (statm >> pages >> resident_pages)
+		{
+			return resident_pages * static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+		}
+#endif
+
+		return 0;
+	}
+
+	boost::int64_t metric_value(const freelan::metrics_snapshot& snapshot, const std::string& name)
+	{
+		BOOST_FOREACH(const freelan::metric_snapshot& metric, snapshot)
+		{
+			if (metric.name == name)
+			{
+				return metric.value;
+			}
+		}
+
+		return 0;
+	}
+
+	class harness;
+
+	/**
+	 * A peer: a bare FSCP server that greets the hub and accepts its session.
+	 */
+	class peer : private boost::noncopyable
+	{
+		public:
+
+			typedef fscp::server::ep_type ep_type;
+			typedef fscp::server::cert_type cert_type;
+
+			peer(boost::asio::io_service& io_service, const fscp::identity_store& identity, const ep_type& endpoint, const ep_type& hub, harness& _harness) :
+				m_io_service(io_service),
+				m_identity(identity),
+				m_endpoint(endpoint),
+				m_hub(hub),
+				m_harness(_harness),
+				m_established(false)
+			{
+			}
+
+			void open();
+			void close();
+			void greet();
+
+			bool is_open() const
+			{
+				return static_cast<bool>(m_server);
+			}
+
+			bool is_established() const
+			{
+				return m_established;
+			}
+
+		private:
+
+			void on_hello_response(const ep_type&, const boost::posix_time::time_duration&, bool);
+
+			bool on_hello_request(const ep_type& sender, bool default_accept)
+			{
+				if (default_accept)
+				{
+					m_server->async_introduce_to(sender);
+				}
+
+				return default_accept;
+			}
+
+			bool on_presentation(const ep_type& sender, cert_type, cert_type, bool)
+			{
+				m_server->async_request_session(sender);
+
+				return true;
+			}
+
+			bool on_session_request(const ep_type&, bool default_accept)
+			{
+				return default_accept;
+			}
+
+			void on_session_established(const ep_type&);
+			void on_session_lost(const ep_type&);
+
+			boost::asio::io_service& m_io_service;
+			const fscp::identity_store& m_identity;
+			const ep_type m_endpoint;
+			const ep_type m_hub;
+			harness& m_harness;
+			boost::scoped_ptr<fscp::server> m_server;
+			bool m_established;
+	};
+
+	class harness : private boost::noncopyable
+	{
+		public:
+
+			enum phase_type
+			{
+				PH_JOIN,
+				PH_FLAP,
+				PH_LEAVE,
+				PH_DONE
+			};
+
+			harness(boost::asio::io_service& io_service, freelan::core& hub, const parameters& _parameters) :
+				m_io_service(io_service),
+				m_hub(hub),
+				m_parameters(_parameters),
+				m_peer_identity(generate_identity("peer")),
+				m_tick_timer(io_service),
+				m_report_timer(io_service),
+				m_phase(PH_JOIN),
+				m_established_peers(0),
+				m_hub_sessions_lost(0),
+				m_greet_retries(0),
+				m_base_rss(0),
+				m_mesh_rss(0),
+				m_max_pending_greets(0),
+				m_max_pending_handshakes(0)
+			{
+				const peer::ep_type hub_endpoint(boost::asio::ip::address_v4::loopback(), _parameters.port);
+
+				for (unsigned int i = 0; i < _parameters.peers; ++i)
+				{
+					const peer::ep_type endpoint(boost::asio::ip::address_v4(0x7f010001 + i), _parameters.port + 1);
+
+					m_peers.push_back(boost::make_shared<peer>(boost::ref(m_io_service), boost::cref(m_peer_identity), endpoint, hub_endpoint, boost::ref(*this)));
+				}
+			}
+
+			void start()
+			{
+				BOOST_FOREACH(const boost::shared_ptr<peer>& _peer, m_peers)
+				{
+					_peer->open();
+				}
+
+				m_base_rss = resident_set_size();
+
+				BOOST_FOREACH(const boost::shared_ptr<peer>& _peer, m_peers)
+				{
+					m_greet_queue.push_back(_peer.get());
+				}
+
+				start_phase(PH_JOIN);
+
+				m_next_tick = boost::posix_time::microsec_clock::universal_time() + TICK_PERIOD;
+				m_tick_timer.expires_at(m_next_tick);
+				m_tick_timer.async_wait(boost::bind(&harness::on_tick, this, boost::asio::placeholders::error));
+
+				m_report_timer.expires_from_now(REPORT_PERIOD);
+				m_report_timer.async_wait(boost::bind(&harness::on_report, this, boost::asio::placeholders::error));
+			}
+
+			void schedule_greet(peer& _peer)
+			{
+				++m_greet_retries;
+				m_greet_queue.push_back(&_peer);
+			}
+
+			void expect_session(peer& _peer)
+			{
+				m_session_deadlines.push_back(std::make_pair(boost::posix_time::microsec_clock::universal_time() + SESSION_TIMEOUT, &_peer));
+			}
+
+			void on_peer_session_established()
+			{
+				++m_established_peers;
+
+				check_phase();
+			}
+
+			void on_peer_session_lost()
+			{
+				--m_established_peers;
+			}
+
+			void on_hub_session_lost(const freelan::core::ep_type&)
+			{
+				++m_hub_sessions_lost;
+
+				check_phase();
+			}
+
+			void report(std::ostream& os) const
+			{
+				const freelan::histogram_snapshot lag = m_loop_lag.snapshot();
+				const freelan::histogram_snapshot handshake = metric_distribution("freelan_handshake_duration_microseconds");
+				const double join_duration = seconds(m_phase_durations[PH_JOIN]);
+				const double handshakes_per_second = (join_duration > 0) ? m_parameters.peers / join_duration : 0;
+				const double memory_per_session = (m_mesh_rss > m_base_rss) ? static_cast<double>(m_mesh_rss - m_base_rss) / m_parameters.peers : 0;
+
+				if (m_parameters.json)
+				{
+					os << "{"
+						<< "\"peers\": " << m_parameters.peers
+						<< ", \"join_rate\": " << m_parameters.join_rate
+						<< ", \"time_to_full_mesh_s\": " << join_duration
+						<< ", \"handshakes_per_s\": " << handshakes_per_second
+						<< ", \"greet_retries\": " << m_greet_retries
+						<< ", \"memory_per_session_bytes\": " << memory_per_session
+						<< ", \"max_pending_greets\": " << m_max_pending_greets
+						<< ", \"max_pending_handshakes\": " << m_max_pending_handshakes
+						<< ", \"flapped_peers\": " << m_parameters.flap
+						<< ", \"flap_recovery_s\": " << seconds(m_phase_durations[PH_FLAP])
+						<< ", \"departed_peers\": " << m_parameters.leave
+						<< ", \"departures_detected\": " << m_hub_sessions_lost
+						<< ", \"departure_detection_s\": " << seconds(m_phase_durations[PH_LEAVE])
+						<< ", \"handshake_duration_us\": {\"p50\": " << handshake.value_at_quantile(0.5) << ", \"p99\": " << handshake.value_at_quantile(0.99) << "}"
+						<< ", \"loop_lag_us\": {\"p50\": " << lag.value_at_quantile(0.5) << ", \"p99\": " << lag.value_at_quantile(0.99) << ", \"max\": " << lag.value_at_quantile(1.0) << "}"
+						<< "}" << std::endl;
+				}
+				else
+				{
+					os << "Peers: " << m_parameters.peers << ", join rate: " << m_parameters.join_rate << " peer(s)/s" << std::endl;
+					os << "Time to full mesh: " << join_duration << " s (" << handshakes_per_second << " handshake(s)/s, " << m_greet_retries << " greet retry(ies))" << std::endl;
+					os << "Handshake duration (us): p50 " << handshake.value_at_quantile(0.5) << ", p99 " << handshake.value_at_quantile(0.99) << std::endl;
+					os << "Memory per session (both ends): " << memory_per_session << " byte(s)" << std::endl;
+					os << "Peak pending greets (HELLO timers): " << m_max_pending_greets << ", peak pending handshakes: " << m_max_pending_handshakes << std::endl;
+					os << "Flap: " << m_parameters.flap << " peer(s) recovered in " << seconds(m_phase_durations[PH_FLAP]) << " s" << std::endl;
+					os << "Leave: " << m_hub_sessions_lost << "/" << m_parameters.leave << " departure(s) detected in " << seconds(m_phase_durations[PH_LEAVE]) << " s" << std::endl;
+					os << "Loop lag (us): p50 " << lag.value_at_quantile(0.5) << ", p99 " << lag.value_at_quantile(0.99) << ", max " << lag.value_at_quantile(1.0) << std::endl;
+				}
+			}
+
+			bool finished() const
+			{
+				return (m_phase == PH_DONE);
+			}
+
+		private:
+
+			static double seconds(const boost::posix_time::time_duration& duration)
+			{
+				return static_cast<double>(duration.total_microseconds()) / 1000000.0;
+			}
+
+			freelan::histogram_snapshot metric_distribution(const std::string& name) const
+			{
+				BOOST_FOREACH(const freelan::metric_snapshot& metric, m_hub.metrics().snapshot())
+				{
+					if (metric.name == name)
+					{
+						return metric.distribution;
+					}
+				}
+
+				return freelan::histogram_snapshot();
+			}
+
+			void start_phase(phase_type phase)
+			{
+				m_phase = phase;
+				m_phase_start = boost::posix_time::microsec_clock::universal_time();
+
+				switch (m_phase)
+				{
+					case PH_JOIN:
+						break;
+					case PH_FLAP:
+						{
+							for (unsigned int i = 0; i < m_parameters.flap; ++i)
+							{
+								m_peers[i]->close();
+								m_peers[i]->open();
+								m_greet_queue.push_back(m_peers[i].get());
+							}
+
+							break;
+						}
+					case PH_LEAVE:
+						{
+							m_hub_sessions_lost = 0;
+
+							for (unsigned int i = 0; i < m_parameters.leave; ++i)
+							{
+								m_peers[m_peers.size() - 1 - i]->close();
+							}
+
+							break;
+						}
+					case PH_DONE:
+						{
+							m_tick_timer.cancel();
+							m_report_timer.cancel();
+							m_io_service.stop();
+
+							break;
+						}
+				}
+
+				check_phase();
+			}
+
+			void check_phase()
+			{
+				const boost::posix_time::time_duration elapsed = boost::posix_time::microsec_clock::universal_time() - m_phase_start;
+				bool complete = false;
+
+				switch (m_phase)
+				{
+					case PH_JOIN:
+						complete = (metric_value(m_hub.metrics().snapshot(), "freelan_sessions") >= m_parameters.peers);
+						break;
+					case PH_FLAP:
+						complete = (m_established_peers >= m_parameters.peers) && m_greet_queue.empty();
+						break;
+					case PH_LEAVE:
+						complete = (m_hub_sessions_lost >= m_parameters.leave) || (elapsed > m_parameters.leave_timeout);
+						break;
+					case PH_DONE:
+						return;
+				}
+
+				if (!complete && (m_phase != PH_LEAVE) && (elapsed > PHASE_TIMEOUT))
+				{
+					std::cerr << "Phase " << m_phase << " timed out." << std::endl;
+
+					complete = true;
+				}
+
+				if (complete)
+				{
+					m_phase_durations[m_phase] = elapsed;
+
+					if (m_phase == PH_JOIN)
+					{
+						m_mesh_rss = resident_set_size();
+					}
+
+					start_phase(static_cast<phase_type>(m_phase + 1));
+				}
+			}
+
+			void on_tick(const boost::system::error_code& ec)
+			{
+				if (ec == boost::asio::error::operation_aborted)
+				{
+					return;
+				}
+
+				// The loop lag is how late the timer handler runs.
+				m_loop_lag.record(boost::posix_time::microsec_clock::universal_time() - m_next_tick);
+
+				const unsigned int greets_per_tick = std::max<unsigned int>(m_parameters.join_rate * TICK_PERIOD.total_milliseconds() / 1000, 1);
+
+				for (unsigned int i = 0; (i < greets_per_tick) && !m_greet_queue.empty(); ++i)
+				{
+					peer* const _peer = m_greet_queue.front();
+					m_greet_queue.pop_front();
+
+					if (_peer->is_open() && !_peer->is_established())
+					{
+						_peer->greet();
+					}
+				}
+
+				// The hub may drop handshakes when it is overloaded: greet again the peers that got no session.
+				const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+				while (!m_session_deadlines.empty() && (m_session_deadlines.front().first <= now))
+				{
+					peer* const _peer = m_session_deadlines.front().second;
+					m_session_deadlines.pop_front();
+
+					if (_peer->is_open() && !_peer->is_established())
+					{
+						schedule_greet(*_peer);
+					}
+				}
+
+				const freelan::metrics_snapshot snapshot = m_hub.metrics().snapshot();
+
+				m_max_pending_greets = std::max(m_max_pending_greets, metric_value(snapshot, "freelan_pending_greets"));
+				m_max_pending_handshakes = std::max(m_max_pending_handshakes, metric_value(snapshot, "freelan_pending_handshakes"));
+
+				check_phase();
+
+				if (m_phase != PH_DONE)
+				{
+					m_next_tick += TICK_PERIOD;
+					m_tick_timer.expires_at(m_next_tick);
+					m_tick_timer.async_wait(boost::bind(&harness::on_tick, this, boost::asio::placeholders::error));
+				}
+			}
+
+			void on_report(const boost::system::error_code& ec)
+			{
+				if (ec == boost::asio::error::operation_aborted)
+				{
+					return;
+				}
+
+				const freelan::metrics_snapshot snapshot = m_hub.metrics().snapshot();
+
+				std::cerr << "[phase " << m_phase << "] hub sessions: " << metric_value(snapshot, "freelan_sessions")
+					<< ", established peers: " << m_established_peers
+					<< ", pending greets: " << metric_value(snapshot, "freelan_pending_greets")
+					<< ", pending handshakes: " << metric_value(snapshot, "freelan_pending_handshakes")
+					<< ", loop lag p99: " << m_loop_lag.snapshot().value_at_quantile(0.99) << " us" << std::endl;
+
+				m_report_timer.expires_from_now(REPORT_PERIOD);
+				m_report_timer.async_wait(boost::bind(&harness::on_report, this, boost::asio::placeholders::error));
+			}
+
+			boost::asio::io_service& m_io_service;
+			freelan::core& m_hub;
+			const parameters m_parameters;
+			const fscp::identity_store m_peer_identity;
+			std::vector<boost::shared_ptr<peer> > m_peers;
+			std::deque<peer*> m_greet_queue;
+			std::deque<std::pair<boost::posix_time::ptime, peer*> > m_session_deadlines;
+			boost::asio::deadline_timer m_tick_timer;
+			boost::asio::deadline_timer m_report_timer;
+			boost::posix_time::ptime m_next_tick;
+			phase_type m_phase;
+			boost::posix_time::ptime m_phase_start;
+			boost::posix_time::time_duration m_phase_durations[PH_DONE];
+			unsigned int m_established_peers;
+			unsigned int m_hub_sessions_lost;
+			unsigned int m_greet_retries;
+			size_t m_base_rss;
+			size_t m_mesh_rss;
+			boost::int64_t m_max_pending_greets;
+			boost::int64_t m_max_pending_handshakes;
+			freelan::histogram m_loop_lag;
+	};
+
+	void peer::open()
+	{
+		m_server.reset(new fscp::server(m_io_service, m_identity));
+
+		m_server->set_hello_message_callback(boost::bind(&peer::on_hello_request, this, _1, _2));
+		m_server->set_presentation_message_callback(boost::bind(&peer::on_presentation, this, _1, _2, _3, _4));
+		m_server->set_session_request_message_callback(boost::bind(&peer::on_session_request, this, _1, _2));
+		m_server->set_session_established_callback(boost::bind(&peer::on_session_established, this, _1));
+		m_server->set_session_lost_callback(boost::bind(&peer::on_session_lost, this, _1));
+
+		m_server->open(m_endpoint);
+	}
+
+	void peer::close()
+	{
+		if (m_server)
+		{
+			m_server->close();
+			m_server.reset();
+		}
+
+		if (m_established)
+		{
+			m_established = false;
+			m_harness.on_peer_session_lost();
+		}
+	}
+
+	void peer::greet()
+	{
+		m_server->async_greet(m_hub, boost::bind(&peer::on_hello_response, this, _1, _2, _3), HELLO_TIMEOUT);
+	}
+
+	void peer::on_hello_response(const ep_type& sender, const boost::posix_time::time_duration&, bool success)
+	{
+		if (!m_server)
+		{
+			return;
+		}
+
+		if (success)
+		{
+			m_server->async_introduce_to(sender);
+			m_harness.expect_session(*this);
+		}
+		else
+		{
+			m_harness.schedule_greet(*this);
+		}
+	}
+
+	void peer::on_session_established(const ep_type&)
+	{
+		if (!m_established)
+		{
+			m_established = true;
+			m_harness.on_peer_session_established();
+		}
+	}
+
+	void peer::on_session_lost(const ep_type&)
+	{
+		if (m_established)
+		{
+			m_established = false;
+			m_harness.on_peer_session_lost();
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	cryptoplus::crypto_initializer crypto_initializer;
+	cryptoplus::algorithms_initializer algorithms_initializer;
+	cryptoplus::error::error_strings_initializer error_strings_initializer;
+
+	try
+	{
+		const parameters _parameters = parse_parameters(argc, argv);
+
+		boost::asio::io_service io_service;
+
+		freelan::configuration configuration;
+
+		configuration.fscp.listen_on = freelan::ipv4_endpoint(boost::asio::ip::address_v4::loopback(), _parameters.port);
+		configuration.security.identity = generate_identity("hub");
+		configuration.security.certificate_validation_method = freelan::security_configuration::CVM_NONE;
+		configuration.tap_adapter.enabled = false;
+
+		const freelan::logger logger(freelan::logger::log_callback_type(0), freelan::LL_ERROR);
+
+		freelan::core hub(io_service, configuration, logger);
+
+		harness _harness(io_service, hub, _parameters);
+
+		hub.set_session_lost_callback(boost::bind(&harness::on_hub_session_lost, &_harness, _1));
+
+		hub.open();
+
+		_harness.start();
+
+		io_service.run();
+
+		hub.close();
+
+		if (!_harness.finished())
+		{
+			return EXIT_FAILURE;
+		}
+
+		_harness.report(std::cout);
+	}
+	catch (std::exception& ex)
+	{
+		std::cerr << "Exception caught: " << ex.what() << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
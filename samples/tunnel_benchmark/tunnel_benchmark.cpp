@@ -0,0 +1,519 @@
+/**
+ * \file tunnel_benchmark.cpp
+ * \author Julien Kauffmann <julien.kauffmann@freelan.org>
+ * \brief An end-to-end tunnel benchmark sample.
+ *
+ * Two cores run in the same process and establish a session on the loopback
+ * interface. The tap adapters are replaced by in-memory frame ports: frames
+ * injected in the first core travel through the switch, the FSCP encryption,
+ * the UDP socket and the second core before reaching the frame sink.
+ *
+ * Usage: tunnel_benchmark [--size <bytes>] [--count <frames>] [--window <frames>]
+ *   [--pattern zero|sequence|random] [--port <port>] [--format text|json]
+ */
+
+#include <freelan/freelan.hpp>
+#include <freelan/metrics.hpp>
+
+#include <cryptoplus/cryptoplus.hpp>
+#include <cryptoplus/error/error_strings.hpp>
+#include <cryptoplus/x509/certificate.hpp>
+#include <cryptoplus/pkey/pkey.hpp>
+#include <cryptoplus/hash/message_digest_algorithm.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace
+{
+	// Ethernet header (14 bytes), then a sequence number and a timestamp (8 bytes each).
+	const size_t ETHERNET_HEADER_SIZE = 14;
+	const size_t SEQUENCE_OFFSET = ETHERNET_HEADER_SIZE;
+	const size_t TIMESTAMP_OFFSET = SEQUENCE_OFFSET + 8;
+	const size_t MIN_FRAME_SIZE = 64;
+	const size_t MAX_FRAME_SIZE = 9014;
+
+	const boost::posix_time::time_duration STALL_TIMEOUT = boost::posix_time::milliseconds(200);
+	const boost::posix_time::time_duration SESSION_TIMEOUT = boost::posix_time::seconds(10);
+
+	enum pattern_type
+	{
+		PT_ZERO,
+		PT_SEQUENCE,
+		PT_RANDOM
+	};
+
+	struct parameters
+	{
+		parameters() :
+			frame_size(1400),
+			count(100000),
+			window(256),
+			pattern(PT_RANDOM),
+			port(12000),
+			json(false)
+		{
+		}
+
+		size_t frame_size;
+		unsigned long count;
+		unsigned long window;
+		pattern_type pattern;
+		unsigned short port;
+		bool json;
+	};
+
+	const char* pattern_name(pattern_type pattern)
+	{
+		switch (pattern)
+		{
+			case PT_ZERO:
+				return "zero";
+			case PT_SEQUENCE:
+				return "sequence";
+			case PT_RANDOM:
+				return "random";
+		}
+
+		return "unknown";
+	}
+
+	parameters parse_parameters(int argc, char** argv)
+	{
+		parameters result;
+
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string option = argv[i];
+
+			if (i + 1 >= argc)
+			{
+				throw std::runtime_error("Missing value for option: " + option);
+			}
+
+			const std::string value = argv[++i];
+
+			if (option == "--size")
+			{
+				result.frame_size = boost::lexical_cast<size_t>(value);
+
+				if ((result.frame_size < MIN_FRAME_SIZE) || (result.frame_size > MAX_FRAME_SIZE))
+				{
+					throw std::runtime_error("The frame size must be between " + boost::lexical_cast<std::string>(MIN_FRAME_SIZE) + " and " + boost::lexical_cast<std::string>(MAX_FRAME_SIZE) + " bytes");
+				}
+			}
+			else if (option == "--count")
+			{
+				result.count = boost::lexical_cast<unsigned long>(value);
+			}
+			else if (option == "--window")
+			{
+				result.window = std::max(boost::lexical_cast<unsigned long>(value), 1UL);
+			}
+			else if (option == "--pattern")
+			{
+				if (value == "zero")
+				{
+					result.pattern = PT_ZERO;
+				}
+				else if (value == "sequence")
+				{
+					result.pattern = PT_SEQUENCE;
+				}
+				else if (value == "random")
+				{
+					result.pattern = PT_RANDOM;
+				}
+				else
+				{
+					throw std::runtime_error("Unknown pattern: " + value);
+				}
+			}
+			else if (option == "--port")
+			{
+				result.port = boost::lexical_cast<unsigned short>(value);
+			}
+			else if (option == "--format")
+			{
+				if ((value != "text") && (value != "json"))
+				{
+					throw std::runtime_error("Unknown format: " + value);
+				}
+
+				result.json = (value == "json");
+			}
+			else
+			{
+				throw std::runtime_error("Unknown option: " + option);
+			}
+		}
+
+		return result;
+	}
+
+	fscp::identity_store generate_identity(const std::string& name)
+	{
+		using namespace cryptoplus;
+
+		const pkey::pkey private_key = pkey::pkey::from_rsa_key(pkey::rsa_key::generate_private_key(2048, 17, NULL, NULL, false));
+
+		x509::certificate certificate = x509::certificate::create();
+
+		certificate.set_version(2);
+		certificate.set_serial_number(asn1::integer::from_long(1));
+		certificate.set_public_key(private_key);
+		certificate.subject().push_back("CN", MBSTRING_ASC, name.c_str(), name.size());
+		certificate.set_issuer(certificate.subject());
+		certificate.set_not_before(asn1::utctime::from_ptime(boost::posix_time::second_clock::universal_time() - boost::posix_time::hours(1)));
+		certificate.set_not_after(asn1::utctime::from_ptime(boost::posix_time::second_clock::universal_time() + boost::posix_time::hours(24)));
+		certificate.sign(private_key, hash::message_digest_algorithm(NID_sha1));
+
+		return fscp::identity_store(certificate, private_key);
+	}
+
+	freelan::configuration make_configuration(const std::string& name, unsigned short port, unsigned short peer_port)
+	{
+		freelan::configuration configuration;
+
+		configuration.fscp.listen_on = freelan::ipv4_endpoint(boost::asio::ip::address_v4::loopback(), port);
+
+		if (peer_port != 0)
+		{
+			configuration.fscp.contact_list.push_back(freelan::ipv4_endpoint(boost::asio::ip::address_v4::loopback(), peer_port));
+		}
+
+		// The certificates are self-signed.
+		configuration.security.identity = generate_identity(name);
+		configuration.security.certificate_validation_method = freelan::security_configuration::CVM_NONE;
+		configuration.tap_adapter.enabled = false;
+
+		return configuration;
+	}
+
+	void write_uint64(unsigned char* buf, boost::uint64_t value)
+	{
+		for (size_t i = 0; i < 8; ++i)
+		{
+			buf[i] = static_cast<unsigned char>(value >> (8 * (7 - i)));
+		}
+	}
+
+	boost::uint64_t read_uint64(const unsigned char* buf)
+	{
+		boost::uint64_t value = 0;
+
+		for (size_t i = 0; i < 8; ++i)
+		{
+			value = (value << 8) | buf[i];
+		}
+
+		return value;
+	}
+
+	class benchmark
+	{
+		public:
+
+			benchmark(boost::asio::io_service& io_service, freelan::core& sender, const parameters& _parameters) :
+				m_io_service(io_service),
+				m_sender(sender),
+				m_parameters(_parameters),
+				m_frame(_parameters.frame_size),
+				m_epoch(boost::posix_time::microsec_clock::universal_time()),
+				m_timer(io_service),
+				m_started(false),
+				m_finished(false),
+				m_pump_pending(false),
+				m_sent(0),
+				m_received(0),
+				m_presumed_lost(0),
+				m_last_received(0),
+				m_start_clock(0),
+				m_end_clock(0)
+			{
+				static const unsigned char header[ETHERNET_HEADER_SIZE] = {
+					0x02, 0x00, 0x00, 0x00, 0x00, 0x02, // Destination
+					0x02, 0x00, 0x00, 0x00, 0x00, 0x01, // Source
+					0x88, 0xb5 // Local experimental ethertype
+				};
+
+				std::memcpy(&m_frame[0], header, sizeof(header));
+
+				for (size_t i = TIMESTAMP_OFFSET + 8; i < m_frame.size(); ++i)
+				{
+					switch (m_parameters.pattern)
+					{
+						case PT_ZERO:
+							m_frame[i] = 0;
+							break;
+						case PT_SEQUENCE:
+							m_frame[i] = static_cast<unsigned char>(i);
+							break;
+						case PT_RANDOM:
+							m_frame[i] = static_cast<unsigned char>(std::rand());
+							break;
+					}
+				}
+
+				m_timer.expires_from_now(SESSION_TIMEOUT);
+				m_timer.async_wait(boost::bind(&benchmark::on_session_timeout, this, boost::asio::placeholders::error));
+			}
+
+			void start()
+			{
+				if (m_started)
+				{
+					return;
+				}
+
+				m_started = true;
+				m_start_time = boost::posix_time::microsec_clock::universal_time();
+				m_start_clock = std::clock();
+
+				arm_stall_timer();
+				pump();
+			}
+
+			void on_frame(boost::asio::const_buffer frame)
+			{
+				const unsigned char* const buf = boost::asio::buffer_cast<const unsigned char*>(frame);
+
+				if (m_finished || (boost::asio::buffer_size(frame) != m_parameters.frame_size))
+				{
+					return;
+				}
+
+				m_latency.record(now() - boost::posix_time::microseconds(read_uint64(buf + TIMESTAMP_OFFSET)));
+				++m_received;
+
+				// A frame presumed lost eventually arrived.
+				if (m_received + m_presumed_lost > m_sent)
+				{
+					--m_presumed_lost;
+				}
+
+				if (m_received + m_presumed_lost >= m_parameters.count)
+				{
+					finish();
+				}
+				else if (!m_pump_pending)
+				{
+					m_pump_pending = true;
+					m_io_service.post(boost::bind(&benchmark::pump, this));
+				}
+			}
+
+			void report(std::ostream& os) const
+			{
+				const double duration = static_cast<double>((m_end_time - m_start_time).total_microseconds()) / 1000000.0;
+				const double cpu_time = static_cast<double>(m_end_clock - m_start_clock) / CLOCKS_PER_SEC;
+				const double bytes = static_cast<double>(m_received) * m_parameters.frame_size;
+				const double gbps = (duration > 0) ? bytes * 8 / duration / 1e9 : 0;
+				const double pps = (duration > 0) ? m_received / duration : 0;
+				const double cpu_ns_per_byte = (bytes > 0) ? cpu_time * 1e9 / bytes : 0;
+				const freelan::histogram_snapshot latency = m_latency.snapshot();
+				const boost::uint64_t lost = m_sent - m_received;
+
+				if (m_parameters.json)
+				{
+					os << "{"
+						<< "\"frame_size\": " << m_parameters.frame_size
+						<< ", \"pattern\": \"" << pattern_name(m_parameters.pattern) << "\""
+						<< ", \"window\": " << m_parameters.window
+						<< ", \"frames_sent\": " << m_sent
+						<< ", \"frames_received\": " << m_received
+						<< ", \"frames_lost\": " << lost
+						<< ", \"duration_s\": " << duration
+						<< ", \"gbit_per_s\": " << gbps
+						<< ", \"packets_per_s\": " << pps
+						<< ", \"cpu_ns_per_byte\": " << cpu_ns_per_byte
+						<< ", \"latency_us\": {"
+						<< "\"p50\": " << latency.value_at_quantile(0.5)
+						<< ", \"p90\": " << latency.value_at_quantile(0.9)
+						<< ", \"p99\": " << latency.value_at_quantile(0.99)
+						<< ", \"p999\": " << latency.value_at_quantile(0.999)
+						<< ", \"max\": " << latency.value_at_quantile(1.0)
+						<< "}}" << std::endl;
+				}
+				else
+				{
+					os << "Frame size: " << m_parameters.frame_size << " byte(s), pattern: " << pattern_name(m_parameters.pattern) << ", window: " << m_parameters.window << " frame(s)" << std::endl;
+					os << "Frames: " << m_sent << " sent, " << m_received << " received, " << lost << " lost" << std::endl;
+					os << "Duration: " << duration << " s" << std::endl;
+					os << "Throughput: " << gbps << " Gbit/s, " << pps << " packet(s)/s" << std::endl;
+					os << "CPU: " << cpu_ns_per_byte << " ns/byte (both ends)" << std::endl;
+					os << "Latency (us, bucket upper bounds): p50 " << latency.value_at_quantile(0.5)
+						<< ", p90 " << latency.value_at_quantile(0.9)
+						<< ", p99 " << latency.value_at_quantile(0.99)
+						<< ", p99.9 " << latency.value_at_quantile(0.999)
+						<< ", max " << latency.value_at_quantile(1.0) << std::endl;
+				}
+			}
+
+			bool finished() const
+			{
+				return m_finished;
+			}
+
+		private:
+
+			boost::posix_time::time_duration now() const
+			{
+				return boost::posix_time::microsec_clock::universal_time() - m_epoch;
+			}
+
+			void pump()
+			{
+				m_pump_pending = false;
+
+				while (!m_finished && (m_sent < m_parameters.count) && (m_sent - m_received - m_presumed_lost < m_parameters.window))
+				{
+					write_uint64(&m_frame[SEQUENCE_OFFSET], m_sent);
+					write_uint64(&m_frame[TIMESTAMP_OFFSET], now().total_microseconds());
+
+					m_sender.inject_frame(boost::asio::buffer(m_frame));
+
+					++m_sent;
+				}
+			}
+
+			void arm_stall_timer()
+			{
+				m_timer.expires_from_now(STALL_TIMEOUT);
+				m_timer.async_wait(boost::bind(&benchmark::on_stall_timeout, this, boost::asio::placeholders::error));
+			}
+
+			void on_stall_timeout(const boost::system::error_code& ec)
+			{
+				if ((ec == boost::asio::error::operation_aborted) || m_finished)
+				{
+					return;
+				}
+
+				// No frame arrived for a while: the frames in flight are lost.
+				if (m_received == m_last_received)
+				{
+					m_presumed_lost = m_sent - m_received;
+
+					if (m_sent >= m_parameters.count)
+					{
+						finish();
+
+						return;
+					}
+
+					pump();
+				}
+
+				m_last_received = m_received;
+
+				arm_stall_timer();
+			}
+
+			void on_session_timeout(const boost::system::error_code& ec)
+			{
+				if ((ec != boost::asio::error::operation_aborted) && !m_started)
+				{
+					std::cerr << "No session could be established." << std::endl;
+
+					m_io_service.stop();
+				}
+			}
+
+			void finish()
+			{
+				m_finished = true;
+				m_end_time = boost::posix_time::microsec_clock::universal_time();
+				m_end_clock = std::clock();
+				m_timer.cancel();
+				m_io_service.stop();
+			}
+
+			boost::asio::io_service& m_io_service;
+			freelan::core& m_sender;
+			const parameters m_parameters;
+			std::vector<unsigned char> m_frame;
+			const boost::posix_time::ptime m_epoch;
+			boost::asio::deadline_timer m_timer;
+			bool m_started;
+			bool m_finished;
+			bool m_pump_pending;
+			boost::uint64_t m_sent;
+			boost::uint64_t m_received;
+			boost::uint64_t m_presumed_lost;
+			boost::uint64_t m_last_received;
+			boost::posix_time::ptime m_start_time;
+			boost::posix_time::ptime m_end_time;
+			std::clock_t m_start_clock;
+			std::clock_t m_end_clock;
+			freelan::histogram m_latency;
+	};
+
+	void ignore_frame(boost::asio::const_buffer)
+	{
+	}
+
+	void on_session_established(benchmark& _benchmark, const freelan::core::ep_type&)
+	{
+		_benchmark.start();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	cryptoplus::crypto_initializer crypto_initializer;
+	cryptoplus::algorithms_initializer algorithms_initializer;
+	cryptoplus::error::error_strings_initializer error_strings_initializer;
+
+	try
+	{
+		const parameters _parameters = parse_parameters(argc, argv);
+
+		boost::asio::io_service io_service;
+
+		const freelan::logger logger(freelan::logger::log_callback_type(0), freelan::LL_ERROR);
+
+		freelan::core sender(io_service, make_configuration("sender", _parameters.port, _parameters.port + 1), logger);
+		freelan::core receiver(io_service, make_configuration("receiver", _parameters.port + 1, 0), logger);
+
+		benchmark _benchmark(io_service, sender, _parameters);
+
+		sender.set_frame_callback(&ignore_frame);
+		receiver.set_frame_callback(boost::bind(&benchmark::on_frame, &_benchmark, _1));
+		sender.set_session_established_callback(boost::bind(&on_session_established, boost::ref(_benchmark), _1));
+
+		receiver.open();
+		sender.open();
+
+		io_service.run();
+
+		sender.close();
+		receiver.close();
+
+		if (!_benchmark.finished())
+		{
+			return EXIT_FAILURE;
+		}
+
+		_benchmark.report(std::cout);
+	}
+	catch (std::exception& ex)
+	{
+		std::cerr << "Exception caught: " << ex.what() << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
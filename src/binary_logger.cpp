@@ -0,0 +1,678 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file binary_logger.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A binary logger class.
+ */
+
+#include "binary_logger.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include <boost/static_assert.hpp>
+
+namespace freelan
+{
+	namespace
+	{
+		const char MAGIC[8] = { 'F', 'L', 'B', 'L', 'O', 'G', '\0', '\0' };
+		const boost::uint32_t VERSION = 1;
+
+		// The file starts with a header, followed by the format table and the ring.
+		struct file_header
+		{
+			char magic[8];
+			boost::uint32_t version;
+			boost::uint32_t max_formats;
+			boost::uint32_t format_slot_size;
+			boost::uint32_t format_count;
+			boost::uint64_t capacity;
+			boost::uint64_t head;
+			boost::uint64_t tail;
+		};
+
+		struct format_slot
+		{
+			boost::uint8_t level;
+			boost::uint8_t reserved;
+			boost::uint16_t length;
+			char text[binary_logger::MAX_FORMAT_LENGTH];
+		};
+
+		BOOST_STATIC_ASSERT(sizeof(file_header) == 48);
+		BOOST_STATIC_ASSERT(sizeof(format_slot) == 256);
+
+		const size_t HEADER_SIZE = 64;
+		const size_t FORMAT_TABLE_SIZE = binary_logger::MAX_FORMATS * sizeof(format_slot);
+		const size_t RING_OFFSET = HEADER_SIZE + FORMAT_TABLE_SIZE;
+
+		// A record starts with its size, its format identifier and its timestamp.
+		const size_t RECORD_HEADER_SIZE = 16;
+		const size_t RECORD_SIZE_OFFSET = 0;
+		const size_t RECORD_FORMAT_ID_OFFSET = 4;
+		const size_t RECORD_TIMESTAMP_OFFSET = 8;
+
+		const boost::posix_time::ptime EPOCH(boost::gregorian::date(1970, 1, 1));
+
+		const char* create_ring_file(const std::string& path, size_t size)
+		{
+			std::filebuf file;
+
+			if (!file.open(path.c_str(), std::ios_base::in | std::ios_base::out | std::ios_base::trunc | std::ios_base::binary))
+			{
+				throw std::runtime_error("Unable to create the binary log file: " + path);
+			}
+
+			file.pubseekoff(size - 1, std::ios_base::beg);
+			file.sputc(0);
+
+			return path.c_str();
+		}
+
+		file_header& get_header(const boost::interprocess::mapped_region& region)
+		{
+			return *static_cast<file_header*>(region.get_address());
+		}
+
+		format_slot* get_format_table(const boost::interprocess::mapped_region& region)
+		{
+			return reinterpret_cast<format_slot*>(static_cast<char*>(region.get_address()) + HEADER_SIZE);
+		}
+
+		boost::uint8_t* get_ring(const boost::interprocess::mapped_region& region)
+		{
+			return static_cast<boost::uint8_t*>(region.get_address()) + RING_OFFSET;
+		}
+
+		void copy_from_ring(const boost::uint8_t* ring, size_t capacity, boost::uint64_t offset, void* buf, size_t buf_len)
+		{
+			const size_t position = static_cast<size_t>(offset % capacity);
+			const size_t first_part = std::min(buf_len, capacity - position);
+
+			std::memcpy(buf, ring + position, first_part);
+			std::memcpy(static_cast<boost::uint8_t*>(buf) + first_part, ring, buf_len - first_part);
+		}
+
+		template <typename T>
+		T read_value(const boost::uint8_t* buf)
+		{
+			T value;
+
+			std::memcpy(&value, buf, sizeof(value));
+
+			return value;
+		}
+
+		// The size of the fixed part of an argument, not counting its type byte
+		size_t get_argument_fixed_size(binary_log_record::argument_type type)
+		{
+			switch (type)
+			{
+				case binary_log_record::BA_INTEGER:
+				case binary_log_record::BA_UNSIGNED:
+				case binary_log_record::BA_DOUBLE:
+				case binary_log_record::BA_DURATION:
+					return sizeof(boost::uint64_t);
+				case binary_log_record::BA_BOOLEAN:
+					return sizeof(boost::uint8_t);
+				case binary_log_record::BA_STRING:
+					return sizeof(boost::uint16_t);
+				case binary_log_record::BA_IPV4_ADDRESS:
+					return boost::asio::ip::address_v4::bytes_type().size();
+				case binary_log_record::BA_IPV4_ENDPOINT:
+					return boost::asio::ip::address_v4::bytes_type().size() + sizeof(boost::uint16_t);
+				case binary_log_record::BA_IPV6_ADDRESS:
+					return boost::asio::ip::address_v6::bytes_type().size();
+				case binary_log_record::BA_IPV6_ENDPOINT:
+					return boost::asio::ip::address_v6::bytes_type().size() + sizeof(boost::uint16_t);
+			}
+
+			return 0;
+		}
+	}
+
+	const size_t binary_logger::DEFAULT_CAPACITY = 4 * 1024 * 1024;
+	const size_t binary_logger::MAX_FORMATS;
+	const size_t binary_logger::MAX_FORMAT_LENGTH;
+
+	binary_logger::binary_logger(const std::string& path, size_t capacity) :
+		m_file_mapping(create_ring_file(path, RING_OFFSET + capacity), boost::interprocess::read_write),
+		m_region(m_file_mapping, boost::interprocess::read_write),
+		m_capacity(capacity)
+	{
+		file_header& header = get_header(m_region);
+
+		std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+		header.version = VERSION;
+		header.max_formats = MAX_FORMATS;
+		header.format_slot_size = sizeof(format_slot);
+		header.format_count = 0;
+		header.capacity = m_capacity;
+		header.head = 0;
+		header.tail = 0;
+	}
+
+	binary_logger::format_id_type binary_logger::register_format(log_level level, const std::string& format)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		file_header& header = get_header(m_region);
+
+		if (header.format_count >= MAX_FORMATS)
+		{
+			throw std::runtime_error("The binary log format table is full.");
+		}
+
+		format_slot& slot = get_format_table(m_region)[header.format_count];
+
+		slot.level = static_cast<boost::uint8_t>(level);
+		slot.length = static_cast<boost::uint16_t>(std::min(format.size(), MAX_FORMAT_LENGTH));
+		std::memcpy(slot.text, format.data(), slot.length);
+
+		return static_cast<format_id_type>(header.format_count++);
+	}
+
+	void binary_logger::write(const void* buf, size_t buf_len)
+	{
+		if (buf_len > m_capacity)
+		{
+			return;
+		}
+
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		file_header& header = get_header(m_region);
+
+		// The oldest records are dropped until the new record fits.
+		while (header.head + buf_len - header.tail > m_capacity)
+		{
+			boost::uint32_t record_size = 0;
+
+			read_ring(header.tail + RECORD_SIZE_OFFSET, &record_size, sizeof(record_size));
+
+			header.tail += record_size;
+		}
+
+		write_ring(header.head, buf, buf_len);
+
+		header.head += buf_len;
+	}
+
+	void binary_logger::read_ring(boost::uint64_t offset, void* buf, size_t buf_len) const
+	{
+		copy_from_ring(get_ring(m_region), m_capacity, offset, buf, buf_len);
+	}
+
+	void binary_logger::write_ring(boost::uint64_t offset, const void* buf, size_t buf_len)
+	{
+		boost::uint8_t* const ring = get_ring(m_region);
+		const size_t position = static_cast<size_t>(offset % m_capacity);
+		const size_t first_part = std::min(buf_len, m_capacity - position);
+
+		std::memcpy(ring + position, buf, first_part);
+		std::memcpy(ring, static_cast<const boost::uint8_t*>(buf) + first_part, buf_len - first_part);
+	}
+
+	const size_t binary_log_record::MAX_SIZE;
+
+	binary_log_record::binary_log_record(binary_logger& _logger, binary_logger::format_id_type format_id) :
+		m_logger(&_logger),
+		m_size(RECORD_HEADER_SIZE)
+	{
+		const boost::int64_t timestamp = (boost::posix_time::microsec_clock::universal_time() - EPOCH).total_microseconds();
+
+		std::memset(m_buffer.data(), 0, RECORD_HEADER_SIZE);
+		std::memcpy(m_buffer.data() + RECORD_FORMAT_ID_OFFSET, &format_id, sizeof(format_id));
+		std::memcpy(m_buffer.data() + RECORD_TIMESTAMP_OFFSET, &timestamp, sizeof(timestamp));
+	}
+
+	binary_log_record::binary_log_record(const binary_log_record& other) :
+		m_logger(other.m_logger),
+		m_size(other.m_size)
+	{
+		other.m_logger = NULL;
+
+		std::memcpy(m_buffer.data(), other.m_buffer.data(), m_size);
+	}
+
+	binary_log_record::~binary_log_record()
+	{
+		if (m_logger)
+		{
+			const boost::uint32_t size = static_cast<boost::uint32_t>(m_size);
+
+			std::memcpy(m_buffer.data() + RECORD_SIZE_OFFSET, &size, sizeof(size));
+
+			m_logger->write(m_buffer.data(), m_size);
+		}
+	}
+
+	binary_log_record& binary_log_record::operator<<(int value)
+	{
+		return *this << static_cast<long>(value);
+	}
+
+	binary_log_record& binary_log_record::operator<<(long value)
+	{
+		const boost::int64_t _value = value;
+
+		if (begin_argument(BA_INTEGER, sizeof(_value)))
+		{
+			append(&_value, sizeof(_value));
+		}
+
+		return *this;
+	}
+
+	binary_log_record& binary_log_record::operator<<(unsigned int value)
+	{
+		return *this << static_cast<unsigned long>(value);
+	}
+
+	binary_log_record& binary_log_record::operator<<(unsigned long value)
+	{
+		const boost::uint64_t _value = value;
+
+		if (begin_argument(BA_UNSIGNED, sizeof(_value)))
+		{
+			append(&_value, sizeof(_value));
+		}
+
+		return *this;
+	}
+
+	binary_log_record& binary_log_record::operator<<(bool value)
+	{
+		const boost::uint8_t _value = value ? 1 : 0;
+
+		if (begin_argument(BA_BOOLEAN, sizeof(_value)))
+		{
+			append(&_value, sizeof(_value));
+		}
+
+		return *this;
+	}
+
+	binary_log_record& binary_log_record::operator<<(double value)
+	{
+		if (begin_argument(BA_DOUBLE, sizeof(value)))
+		{
+			append(&value, sizeof(value));
+		}
+
+		return *this;
+	}
+
+	binary_log_record& binary_log_record::operator<<(const char* value)
+	{
+		const size_t value_len = std::strlen(value);
+
+		// Strings are truncated to what remains.
+		if (m_size + 1 + sizeof(boost::uint16_t) <= MAX_SIZE)
+		{
+			const boost::uint16_t length = static_cast<boost::uint16_t>(std::min(value_len, MAX_SIZE - m_size - 1 - sizeof(boost::uint16_t)));
+
+			begin_argument(BA_STRING, sizeof(length) + length);
+			append(&length, sizeof(length));
+			append(value, length);
+		}
+
+		return *this;
+	}
+
+	binary_log_record& binary_log_record::operator<<(const std::string& value)
+	{
+		return *this << value.c_str();
+	}
+
+	binary_log_record& binary_log_record::operator<<(const boost::asio::ip::address& value)
+	{
+		if (value.is_v4())
+		{
+			const boost::asio::ip::address_v4::bytes_type bytes = value.to_v4().to_bytes();
+
+			if (begin_argument(BA_IPV4_ADDRESS, bytes.size()))
+			{
+				append(bytes.data(), bytes.size());
+			}
+		}
+		else
+		{
+			const boost::asio::ip::address_v6::bytes_type bytes = value.to_v6().to_bytes();
+
+			if (begin_argument(BA_IPV6_ADDRESS, bytes.size()))
+			{
+				append(bytes.data(), bytes.size());
+			}
+		}
+
+		return *this;
+	}
+
+	binary_log_record& binary_log_record::operator<<(const boost::asio::ip::udp::endpoint& value)
+	{
+		const boost::uint16_t port = value.port();
+
+		if (value.address().is_v4())
+		{
+			const boost::asio::ip::address_v4::bytes_type bytes = value.address().to_v4().to_bytes();
+
+			if (begin_argument(BA_IPV4_ENDPOINT, bytes.size() + sizeof(port)))
+			{
+				append(bytes.data(), bytes.size());
+				append(&port, sizeof(port));
+			}
+		}
+		else
+		{
+			const boost::asio::ip::address_v6::bytes_type bytes = value.address().to_v6().to_bytes();
+
+			if (begin_argument(BA_IPV6_ENDPOINT, bytes.size() + sizeof(port)))
+			{
+				append(bytes.data(), bytes.size());
+				append(&port, sizeof(port));
+			}
+		}
+
+		return *this;
+	}
+
+	binary_log_record& binary_log_record::operator<<(const boost::posix_time::time_duration& value)
+	{
+		const boost::int64_t microseconds = value.total_microseconds();
+
+		if (begin_argument(BA_DURATION, sizeof(microseconds)))
+		{
+			append(&microseconds, sizeof(microseconds));
+		}
+
+		return *this;
+	}
+
+	bool binary_log_record::begin_argument(argument_type type, size_t payload_size)
+	{
+		if (!m_logger || (m_size + 1 + payload_size > MAX_SIZE))
+		{
+			return false;
+		}
+
+		const boost::uint8_t _type = static_cast<boost::uint8_t>(type);
+
+		append(&_type, sizeof(_type));
+
+		return true;
+	}
+
+	void binary_log_record::append(const void* buf, size_t buf_len)
+	{
+		assert(m_size + buf_len <= MAX_SIZE);
+
+		std::memcpy(m_buffer.data() + m_size, buf, buf_len);
+		m_size += buf_len;
+	}
+
+	binary_log_reader::binary_log_reader(const std::string& path) :
+		m_file_mapping(path.c_str(), boost::interprocess::read_only),
+		m_region(m_file_mapping, boost::interprocess::read_only),
+		m_capacity(0)
+	{
+		if (m_region.get_size() < RING_OFFSET)
+		{
+			throw std::runtime_error("Not a binary log file: " + path);
+		}
+
+		const file_header& header = get_header(m_region);
+
+		if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+		{
+			throw std::runtime_error("Not a binary log file: " + path);
+		}
+
+		if ((header.version != VERSION) || (header.max_formats != binary_logger::MAX_FORMATS) || (header.format_slot_size != sizeof(format_slot)))
+		{
+			throw std::runtime_error("Unsupported binary log file version: " + path);
+		}
+
+		if ((header.capacity == 0) || (m_region.get_size() < RING_OFFSET + header.capacity))
+		{
+			throw std::runtime_error("Truncated binary log file: " + path);
+		}
+
+		m_capacity = static_cast<size_t>(header.capacity);
+
+		const format_slot* const format_table = get_format_table(m_region);
+
+		for (size_t i = 0; i < std::min<size_t>(header.format_count, binary_logger::MAX_FORMATS); ++i)
+		{
+			format _format;
+
+			_format.level = static_cast<log_level>(format_table[i].level);
+			_format.text.assign(format_table[i].text, std::min<size_t>(format_table[i].length, binary_logger::MAX_FORMAT_LENGTH));
+
+			m_formats.push_back(_format);
+		}
+	}
+
+	void binary_log_reader::read(entry_handler_type handler) const
+	{
+		const file_header& header = get_header(m_region);
+
+		boost::array<boost::uint8_t, binary_log_record::MAX_SIZE> record;
+
+		for (boost::uint64_t offset = header.tail; offset < header.head;)
+		{
+			read_ring(offset, record.data(), RECORD_HEADER_SIZE);
+
+			const boost::uint32_t size = read_value<boost::uint32_t>(record.data() + RECORD_SIZE_OFFSET);
+			const binary_logger::format_id_type format_id = read_value<binary_logger::format_id_type>(record.data() + RECORD_FORMAT_ID_OFFSET);
+			const boost::int64_t timestamp = read_value<boost::int64_t>(record.data() + RECORD_TIMESTAMP_OFFSET);
+
+			if ((size < RECORD_HEADER_SIZE) || (size > record.size()))
+			{
+				throw std::runtime_error("Corrupted binary log file.");
+			}
+
+			read_ring(offset, record.data(), size);
+
+			binary_log_entry entry;
+
+			entry.timestamp = EPOCH + boost::posix_time::microseconds(timestamp);
+
+			if (format_id < m_formats.size())
+			{
+				entry.level = m_formats[format_id].level;
+				entry.message = render(m_formats[format_id], record.data() + RECORD_HEADER_SIZE, size - RECORD_HEADER_SIZE);
+			}
+			else
+			{
+				std::ostringstream oss;
+				oss << "<unknown format #" << format_id << ">";
+
+				entry.level = LL_ERROR;
+				entry.message = oss.str();
+			}
+
+			handler(entry);
+
+			offset += size;
+		}
+	}
+
+	void binary_log_reader::read_ring(boost::uint64_t offset, void* buf, size_t buf_len) const
+	{
+		copy_from_ring(get_ring(m_region), m_capacity, offset, buf, buf_len);
+	}
+
+	std::string binary_log_reader::render(const format& _format, const boost::uint8_t* buf, size_t buf_len) const
+	{
+		std::ostringstream oss;
+
+		const boost::uint8_t* const end = buf + buf_len;
+		std::string::size_type position = 0;
+
+		for (std::string::size_type placeholder = _format.text.find("{}"); placeholder != std::string::npos; placeholder = _format.text.find("{}", position))
+		{
+			oss.write(_format.text.data() + position, placeholder - position);
+			position = placeholder + 2;
+
+			if (buf >= end)
+			{
+				oss << "{}";
+
+				continue;
+			}
+
+			const binary_log_record::argument_type type = static_cast<binary_log_record::argument_type>(*buf++);
+
+			// A torn or corrupted record must not make us read past its end.
+			size_t needed = get_argument_fixed_size(type);
+
+			if ((type == binary_log_record::BA_STRING) && (static_cast<size_t>(end - buf) >= needed))
+			{
+				needed += read_value<boost::uint16_t>(buf);
+			}
+
+			if (static_cast<size_t>(end - buf) < needed)
+			{
+				oss << "<truncated>";
+				buf = end;
+
+				continue;
+			}
+
+			switch (type)
+			{
+				case binary_log_record::BA_INTEGER:
+					{
+						oss << read_value<boost::int64_t>(buf);
+						buf += sizeof(boost::int64_t);
+						break;
+					}
+				case binary_log_record::BA_UNSIGNED:
+					{
+						oss << read_value<boost::uint64_t>(buf);
+						buf += sizeof(boost::uint64_t);
+						break;
+					}
+				case binary_log_record::BA_BOOLEAN:
+					{
+						oss << ((*buf != 0) ? "true" : "false");
+						buf += sizeof(boost::uint8_t);
+						break;
+					}
+				case binary_log_record::BA_DOUBLE:
+					{
+						oss << read_value<double>(buf);
+						buf += sizeof(double);
+						break;
+					}
+				case binary_log_record::BA_STRING:
+					{
+						const boost::uint16_t length = read_value<boost::uint16_t>(buf);
+						buf += sizeof(length);
+						oss.write(reinterpret_cast<const char*>(buf), length);
+						buf += length;
+						break;
+					}
+				case binary_log_record::BA_IPV4_ADDRESS:
+				case binary_log_record::BA_IPV4_ENDPOINT:
+					{
+						boost::asio::ip::address_v4::bytes_type bytes;
+						std::memcpy(bytes.data(), buf, bytes.size());
+						buf += bytes.size();
+
+						if (type == binary_log_record::BA_IPV4_ENDPOINT)
+						{
+							oss << boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4(bytes), read_value<boost::uint16_t>(buf));
+							buf += sizeof(boost::uint16_t);
+						}
+						else
+						{
+							oss << boost::asio::ip::address_v4(bytes);
+						}
+
+						break;
+					}
+				case binary_log_record::BA_IPV6_ADDRESS:
+				case binary_log_record::BA_IPV6_ENDPOINT:
+					{
+						boost::asio::ip::address_v6::bytes_type bytes;
+						std::memcpy(bytes.data(), buf, bytes.size());
+						buf += bytes.size();
+
+						if (type == binary_log_record::BA_IPV6_ENDPOINT)
+						{
+							oss << boost::asio::ip::udp::endpoint(boost::asio::ip::address_v6(bytes), read_value<boost::uint16_t>(buf));
+							buf += sizeof(boost::uint16_t);
+						}
+						else
+						{
+							oss << boost::asio::ip::address_v6(bytes);
+						}
+
+						break;
+					}
+				case binary_log_record::BA_DURATION:
+					{
+						oss << boost::posix_time::microseconds(read_value<boost::int64_t>(buf));
+						buf += sizeof(boost::int64_t);
+						break;
+					}
+				default:
+					{
+						// We can't know the size of an unknown argument: the remaining ones are lost.
+						oss << "<?>";
+						buf = end;
+						break;
+					}
+			}
+		}
+
+		oss << _format.text.substr(position);
+
+		return oss.str();
+	}
+}
@@ -50,6 +50,7 @@
 
 #include <boost/lexical_cast.hpp>
 #include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <cryptoplus/x509/name.hpp>
 #include <cryptoplus/x509/certificate_request.hpp>
@@ -63,6 +64,8 @@
 #include "configuration.hpp"
 #include "logger.hpp"
 #include "logger_stream.hpp"
+#include "metrics.hpp"
+#include "probes.hpp"
 
 namespace freelan
 {
@@ -157,16 +160,16 @@ namespace freelan
 	client::client(const freelan::configuration& configuration, freelan::logger& _logger) :
 		m_configuration(configuration),
 		m_logger(_logger),
-		m_scheme(server_protocol_to_scheme(m_configuration.server.protocol))
+		m_scheme(server_protocol_to_scheme(m_configuration.server.protocol)),
+		m_requests_counter(NULL),
+		m_request_failures_counter(NULL),
+		m_request_duration_histogram(NULL)
 	{
 		if (m_configuration.server.protocol == server_configuration::SP_HTTP)
 		{
 			m_logger(LL_WARNING) << "Current server protocol is HTTP. Your password will be sent in cleartext to the server !";
 		}
 
-		// Set the timeout
-		m_request.set_connect_timeout(boost::posix_time::seconds(5));
-
 		// Set the user agent
 		if (m_configuration.server.user_agent.empty())
 		{
@@ -175,8 +178,6 @@ namespace freelan
 		else
 		{
 			m_logger(LL_INFORMATION) << "User agent set to \"" << m_configuration.server.user_agent << "\".";
-
-			m_request.set_user_agent(m_configuration.server.user_agent);
 		}
 
 		// Set the HTTP proxy
@@ -190,24 +191,18 @@ namespace freelan
 			{
 				m_logger(LL_INFORMATION) << "Disabling HTTP(S) proxy.";
 			}
-
-			m_request.set_proxy(*m_configuration.server.https_proxy);
 		}
 
 		// Disable peer verification if required
 		if (m_configuration.server.disable_peer_verification)
 		{
 			m_logger(LL_WARNING) << "Peer verification disabled ! Connection will be a LOT LESS SECURE.";
-
-			m_request.set_ssl_peer_verification(false);
 		}
 		else
 		{
 			if (!m_configuration.server.ca_info.empty())
 			{
 				m_logger(LL_INFORMATION) << "Setting CA info to \"" << m_configuration.server.ca_info.string() << "\"";
-
-				m_request.set_ca_info(m_configuration.server.ca_info);
 			}
 		}
 
@@ -215,15 +210,20 @@ namespace freelan
 		if (m_configuration.server.disable_host_verification)
 		{
 			m_logger(LL_WARNING) << "Host verification disabled ! Connection will be less secure.";
-
-			m_request.set_ssl_host_verification(false);
 		}
 
-		// Set the read callback
-		m_request.set_write_function(boost::bind(&client::read_data, this, _1));
+		// The session cookie, the TLS sessions and the connections are shared with the concurrent calls
+		m_share.share(CURL_LOCK_DATA_COOKIE);
+		m_share.share(CURL_LOCK_DATA_DNS);
+		m_share.share(CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+		m_share.share(CURL_LOCK_DATA_CONNECT);
+#endif
 
-		// Enable cookie support
-		m_request.enable_cookie_support();
+		configure_request(m_request);
+
+		// Set the read callback
+		m_request.set_write_function(boost::bind(&client::read_data, boost::ref(m_data), _1));
 	}
 
 	void client::authenticate()
@@ -293,23 +293,268 @@ namespace freelan
 		}
 	}
 
-	void client::perform_request(curl& request, const std::string& url, values_type& values)
+	client::batch_response client::perform_batch(const batch_request& request)
 	{
-		request.set_url(url);
+		if (m_server_version_major != 1)
+		{
+			m_logger(LL_ERROR) << "Unsupported server version.";
+
+			throw std::runtime_error("Server protocol error.");
+		}
+
+		// The calls must outlive the multi handle in case of failure.
+		boost::scoped_ptr<pending_call> authority_call;
+		boost::scoped_ptr<pending_call> network_call;
+		boost::scoped_ptr<pending_call> sign_call;
+
+		curl_multi multi;
+
+		const bool multiplexing = multi.enable_multiplexing();
+
+		if (request.get_authority_certificate)
+		{
+			authority_call.reset(new pending_call());
+			setup_pending_call(*authority_call, multi, multiplexing);
+
+			v1_prepare_get_authority_certificate(authority_call->request, m_get_authority_certificate_url);
+		}
+
+		if (request.network)
+		{
+			network_call.reset(new pending_call());
+			setup_pending_call(*network_call, multi, multiplexing);
+
+			v1_prepare_join_network(network_call->request, m_join_network_url, *request.network, request.endpoints);
+		}
+
+		if (request.certificate_request)
+		{
+			sign_call.reset(new pending_call());
+			setup_pending_call(*sign_call, multi, multiplexing);
+
+			v1_prepare_sign_certificate_request(sign_call->request, m_sign_url, *request.certificate_request);
+		}
+
+		m_logger(LL_DEBUG) << "Performing server calls concurrently" << (multiplexing ? " (multiplexed)" : "") << "...";
+
+		const unsigned int call_count = (authority_call ? 1 : 0) + (network_call ? 1 : 0) + (sign_call ? 1 : 0);
+		const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+		batch_response response;
+
+		FREELAN_PROBE2(server_request_start, &multi, call_count);
+
+		try
+		{
+			multi.perform();
+		}
+		catch (...)
+		{
+			FREELAN_PROBE3(server_request_end, &multi, call_count, 0);
+
+			record_requests(start, call_count, call_count);
+
+			throw;
+		}
+
+		unsigned int failure_count = 0;
+
+		// Each call is finished on its own: one failure must not discard the other results.
+		if (authority_call)
+		{
+			try
+			{
+				values_type values;
+
+				finish_pending_call(*authority_call, multi, values);
+
+				response.authority_certificate = v1_parse_authority_certificate(values);
+			}
+			catch (std::exception& ex)
+			{
+				m_logger(LL_ERROR) << "Unable to get the authority certificate: " << ex.what();
+
+				response.authority_certificate_error = boost::current_exception();
+				++failure_count;
+			}
+		}
+
+		if (network_call)
+		{
+			try
+			{
+				values_type values;
+
+				finish_pending_call(*network_call, multi, values);
+
+				response.ninfo = v1_parse_join_network(*request.network, values);
+			}
+			catch (std::exception& ex)
+			{
+				m_logger(LL_ERROR) << "Unable to join the network: " << ex.what();
+
+				response.ninfo_error = boost::current_exception();
+				++failure_count;
+			}
+		}
+
+		if (sign_call)
+		{
+			try
+			{
+				values_type values;
+
+				finish_pending_call(*sign_call, multi, values);
+
+				response.certificate = v1_parse_sign_certificate_request(values);
+			}
+			catch (std::exception& ex)
+			{
+				m_logger(LL_ERROR) << "Unable to get the certificate signed: " << ex.what();
+
+				response.certificate_error = boost::current_exception();
+				++failure_count;
+			}
+		}
+
+		FREELAN_PROBE3(server_request_end, &multi, call_count, (failure_count == 0) ? 1 : 0);
+
+		record_requests(start, call_count, failure_count);
+
+		return response;
+	}
+
+	void client::set_metrics(metrics_registry& registry)
+	{
+		m_requests_counter = &registry.register_counter("freelan_server_requests_total", "The count of requests sent to the server.");
+		m_request_failures_counter = &registry.register_counter("freelan_server_request_failures_total", "The count of requests sent to the server that failed.");
+		m_request_duration_histogram = &registry.register_histogram("freelan_server_request_duration_microseconds", "The duration of the server requests, or batches of concurrent requests.");
+	}
+
+	void client::configure_request(curl& request)
+	{
+		request.set_share(m_share);
+
+		// Set the timeout
+		request.set_connect_timeout(boost::posix_time::seconds(5));
+
+		// Set the user agent
+		if (!m_configuration.server.user_agent.empty())
+		{
+			request.set_user_agent(m_configuration.server.user_agent);
+		}
+
+		// Set the HTTP proxy
+		if (m_configuration.server.https_proxy)
+		{
+			request.set_proxy(*m_configuration.server.https_proxy);
+		}
+
+		// Disable peer verification if required
+		if (m_configuration.server.disable_peer_verification)
+		{
+			request.set_ssl_peer_verification(false);
+		}
+		else
+		{
+			if (!m_configuration.server.ca_info.empty())
+			{
+				request.set_ca_info(m_configuration.server.ca_info);
+			}
+		}
+
+		// Disable host verification if required
+		if (m_configuration.server.disable_host_verification)
+		{
+			request.set_ssl_host_verification(false);
+		}
+
+		// Enable cookie support
+		request.enable_cookie_support();
+	}
+
+	void client::setup_pending_call(pending_call& call, curl_multi& multi, bool multiplexing)
+	{
+		configure_request(call.request);
+
+		if (multiplexing)
+		{
+			call.request.enable_http2();
+		}
+
+		call.request.set_write_function(boost::bind(&client::read_data, boost::ref(call.data), _1));
+
+		multi.add_handle(call.request);
+	}
 
+	void client::finish_pending_call(pending_call& call, curl_multi& multi, values_type& values)
+	{
+		multi.remove_handle(call.request);
+
+		const CURLcode result = multi.get_result(call.request);
+
+		if (result != CURLE_OK)
+		{
+			throw std::runtime_error(curl_easy_strerror(result));
+		}
+
+		parse_response(call.request, call.data, values);
+	}
+
+	void client::perform_request(curl& request, values_type& values)
+	{
 		m_data.clear();
 
-		request.perform();
+		const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+		FREELAN_PROBE2(server_request_start, &request, 1);
+
+		try
+		{
+			request.perform();
+
+			parse_response(request, m_data, values);
+		}
+		catch (...)
+		{
+			FREELAN_PROBE3(server_request_end, &request, 1, 0);
+
+			record_requests(start, 1, 1);
 
+			throw;
+		}
+
+		FREELAN_PROBE3(server_request_end, &request, 1, 1);
+
+		record_requests(start, 1, 0);
+	}
+
+	void client::record_requests(const boost::posix_time::ptime& start, unsigned int count, unsigned int failure_count)
+	{
+		if (m_requests_counter)
+		{
+			m_requests_counter->increment(count);
+
+			if (failure_count > 0)
+			{
+				m_request_failures_counter->increment(failure_count);
+			}
+
+			m_request_duration_histogram->record(boost::posix_time::microsec_clock::universal_time() - start);
+		}
+	}
+
+	void client::parse_response(curl& request, const std::string& data, values_type& values)
+	{
 		const long response_code = request.get_response_code();
 
 		m_logger(LL_DEBUG) << "HTTP response code: " << response_code;
-		m_logger(LL_DEBUG) << "Received:\n" << m_data;
+		m_logger(LL_DEBUG) << "Received:\n" << data;
 
 		if (response_code != 200)
 		{
 			m_logger(LL_ERROR) << "Unexpected HTTP response code " << response_code << ".";
-			m_logger(LL_ERROR) << "Here is what the server replied:\n" << m_data;
+			m_logger(LL_ERROR) << "Here is what the server replied:\n" << data;
 
 			throw std::runtime_error("HTTP request failed.");
 		}
@@ -329,7 +574,7 @@ namespace freelan
 
 				json::value_type value;
 
-				if (!parser.parse(value, m_data))
+				if (!parser.parse(value, data))
 				{
 					throw std::runtime_error("JSON parsing failed.");
 				}
@@ -348,19 +593,19 @@ namespace freelan
 		}
 	}
 
-	void client::perform_get_request(curl& request, const std::string& url, values_type& values)
+	void client::prepare_get_request(curl& request, const std::string& url)
 	{
+		request.set_url(url);
 		request.set_get();
 
 		request.set_http_header("Accept", "application/json");
 
 		m_logger(LL_DEBUG) << "Sent: GET " << url;
-
-		perform_request(request, url, values);
 	}
 
-	void client::perform_post_request(curl& request, const std::string& url, const values_type& parameters, values_type& values)
+	void client::prepare_post_request(curl& request, const std::string& url, const values_type& parameters)
 	{
+		request.set_url(url);
 		request.set_post();
 
 		request.set_http_header("Accept", "application/json");
@@ -373,8 +618,20 @@ namespace freelan
 		request.set_copy_post_fields(boost::asio::buffer(json));
 
 		m_logger(LL_DEBUG) << "Sent: POST " << url << "\n" << json;
+	}
+
+	void client::perform_get_request(curl& request, const std::string& url, values_type& values)
+	{
+		prepare_get_request(request, url);
+
+		perform_request(request, values);
+	}
+
+	void client::perform_post_request(curl& request, const std::string& url, const values_type& parameters, values_type& values)
+	{
+		prepare_post_request(request, url, parameters);
 
-		perform_request(request, url, values);
+		perform_request(request, values);
 	}
 
 	void client::get_server_information(
@@ -421,26 +678,49 @@ namespace freelan
 
 	cryptoplus::x509::certificate client::v1_get_authority_certificate(curl& request, const std::string& get_authority_certificate_url)
 	{
-		const std::string url = m_scheme + boost::lexical_cast<std::string>(m_configuration.server.host) + get_authority_certificate_url;
+		v1_prepare_get_authority_certificate(request, get_authority_certificate_url);
 
-		m_logger(LL_INFORMATION) << "Requesting authority certificate...";
+		values_type values;
 
-		request.reset_http_headers();
+		perform_request(request, values);
+
+		return v1_parse_authority_certificate(values);
+	}
+
+	network_info_v1 client::v1_join_network(curl& request, const std::string& join_network_url, const std::string& network, const std::vector<endpoint>& endpoints)
+	{
+		v1_prepare_join_network(request, join_network_url, network, endpoints);
 
 		values_type values;
 
-		perform_get_request(request, url, values);
+		perform_request(request, values);
 
-		cryptoplus::x509::certificate authority_certificate;
+		return v1_parse_join_network(network, values);
+	}
 
-		assert_has_value(values, "authority_certificate", authority_certificate);
+	cryptoplus::x509::certificate client::v1_sign_certificate_request(curl& request, const std::string& sign_url, const cryptoplus::x509::certificate_request& csr)
+	{
+		v1_prepare_sign_certificate_request(request, sign_url, csr);
 
-		m_logger(LL_INFORMATION) << "Authority certificate received from server.";
+		values_type values;
 
-		return authority_certificate;
+		perform_request(request, values);
+
+		return v1_parse_sign_certificate_request(values);
 	}
 
-	network_info_v1 client::v1_join_network(curl& request, const std::string& join_network_url, const std::string& network, const std::vector<endpoint>& endpoints)
+	void client::v1_prepare_get_authority_certificate(curl& request, const std::string& get_authority_certificate_url)
+	{
+		const std::string url = m_scheme + boost::lexical_cast<std::string>(m_configuration.server.host) + get_authority_certificate_url;
+
+		m_logger(LL_INFORMATION) << "Requesting authority certificate...";
+
+		request.reset_http_headers();
+
+		prepare_get_request(request, url);
+	}
+
+	void client::v1_prepare_join_network(curl& request, const std::string& join_network_url, const std::string& network, const std::vector<endpoint>& endpoints)
 	{
 		const std::string url = m_scheme + boost::lexical_cast<std::string>(m_configuration.server.host) + join_network_url;
 
@@ -460,10 +740,37 @@ namespace freelan
 		parameters.items["network"] = network;
 		parameters.items["endpoints"] = _endpoints;
 
-		values_type values;
+		prepare_post_request(request, url, parameters);
+	}
 
-		perform_post_request(request, url, parameters, values);
+	void client::v1_prepare_sign_certificate_request(curl& request, const std::string& sign_url, const cryptoplus::x509::certificate_request& csr)
+	{
+		const std::string url = m_scheme + boost::lexical_cast<std::string>(m_configuration.server.host) + sign_url;
+
+		m_logger(LL_INFORMATION) << "Sending certificate request...";
+
+		request.reset_http_headers();
+
+		values_type parameters;
 
+		parameters.items["certificate_request"] = certificate_request_to_string(csr);
+
+		prepare_post_request(request, url, parameters);
+	}
+
+	cryptoplus::x509::certificate client::v1_parse_authority_certificate(const values_type& values)
+	{
+		cryptoplus::x509::certificate authority_certificate;
+
+		assert_has_value(values, "authority_certificate", authority_certificate);
+
+		m_logger(LL_INFORMATION) << "Authority certificate received from server.";
+
+		return authority_certificate;
+	}
+
+	network_info_v1 client::v1_parse_join_network(const std::string& network, const values_type& values)
+	{
 		network_info_v1 ninfo;
 
 		json::array_type users_certificates_array;
@@ -498,16 +805,26 @@ namespace freelan
 		for (json::array_type::items_type::const_iterator it = users_endpoints_array.items.begin(); it != users_endpoints_array.items.end(); ++it)
 		{
 			const std::string ep = json::value_cast<json::string_type>(*it);
+			const char* const ep_end = ep.c_str() + ep.size();
 
-			try
+			endpoint value;
+			boost::system::error_code ec;
+
+			if ((parse(ep.c_str(), ep_end, value, ec) != ep_end) && !ec)
 			{
-				m_logger(LL_DEBUG) << "Adding " << ep << " to the users endpoints list.";
+				// Trailing characters.
+				ec = boost::system::errc::make_error_code(boost::system::errc::invalid_argument);
+			}
 
-				ninfo.users_endpoints.push_back(boost::lexical_cast<endpoint>(ep));
+			if (ec)
+			{
+				m_logger(LL_WARNING) << "Unable to add " << ep << " to the users endpoints list: " << ec.message();
 			}
-			catch (boost::bad_lexical_cast& ex)
+			else
 			{
-				m_logger(LL_WARNING) << "Unable to add " << ep << " to the users endpoints list: " << ex.what();
+				m_logger(LL_DEBUG) << "Adding " << ep << " to the users endpoints list.";
+
+				ninfo.users_endpoints.push_back(value);
 			}
 		}
 
@@ -516,22 +833,8 @@ namespace freelan
 		return ninfo;
 	}
 
-	cryptoplus::x509::certificate client::v1_sign_certificate_request(curl& request, const std::string& sign_url, const cryptoplus::x509::certificate_request& csr)
+	cryptoplus::x509::certificate client::v1_parse_sign_certificate_request(const values_type& values)
 	{
-		const std::string url = m_scheme + boost::lexical_cast<std::string>(m_configuration.server.host) + sign_url;
-
-		m_logger(LL_INFORMATION) << "Sending certificate request...";
-
-		request.reset_http_headers();
-
-		values_type parameters;
-
-		parameters.items["certificate_request"] = certificate_request_to_string(csr);
-
-		values_type values;
-
-		perform_post_request(request, url, parameters, values);
-
 		cryptoplus::x509::certificate certificate;
 
 		assert_has_value(values, "certificate", certificate);
@@ -573,12 +876,12 @@ namespace freelan
 		m_logger(LL_INFORMATION) << "Succesfully authenticated as " << m_configuration.server.username << ".";
 	}
 
-	size_t client::read_data(boost::asio::const_buffer buf)
+	size_t client::read_data(std::string& data, boost::asio::const_buffer buf)
 	{
 		const char* _data = boost::asio::buffer_cast<const char*>(buf);
 		size_t data_len = boost::asio::buffer_size(buf);
 
-		m_data.append(_data, data_len);
+		data.append(_data, data_len);
 
 		return data_len;
 	}
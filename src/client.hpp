@@ -50,6 +50,11 @@
 #include <map>
 
 #include <boost/asio.hpp>
+#include <boost/optional.hpp>
+#include <boost/exception_ptr.hpp>
+
+#include <cryptoplus/x509/certificate.hpp>
+#include <cryptoplus/x509/certificate_request.hpp>
 
 #include <kfather/kfather.hpp>
 #include <kfather/value.hpp>
@@ -57,19 +62,13 @@
 #include "ip_network_address.hpp"
 #include "curl.hpp"
 
-namespace cryptoplus
-{
-	namespace x509
-	{
-		class certificate;
-		class certificate_request;
-	}
-}
-
 namespace freelan
 {
 	class configuration;
 	class logger;
+	class metrics_registry;
+	class counter;
+	class histogram;
 	
 	/**
 	 * \brief A network information class.
@@ -99,6 +98,75 @@ namespace freelan
 			 */
 			typedef json::object_type values_type;
 
+			/**
+			 * \brief A batch of independent calls.
+			 */
+			struct batch_request
+			{
+				/**
+				 * \brief Create an empty batch.
+				 */
+				batch_request() : get_authority_certificate(false) {}
+
+				/**
+				 * \brief Whether to get the authority certificate.
+				 */
+				bool get_authority_certificate;
+
+				/**
+				 * \brief The network to join, if any.
+				 */
+				boost::optional<std::string> network;
+
+				/**
+				 * \brief The endpoints to publish when joining the network.
+				 */
+				std::vector<endpoint> endpoints;
+
+				/**
+				 * \brief The certificate request to sign, if any.
+				 */
+				boost::optional<cryptoplus::x509::certificate_request> certificate_request;
+			};
+
+			/**
+			 * \brief The results of a batch of calls.
+			 *
+			 * Each requested call either sets its result or its error.
+			 */
+			struct batch_response
+			{
+				/**
+				 * \brief The authority certificate.
+				 */
+				boost::optional<cryptoplus::x509::certificate> authority_certificate;
+
+				/**
+				 * \brief The error of the authority certificate call, if it failed.
+				 */
+				boost::exception_ptr authority_certificate_error;
+
+				/**
+				 * \brief The network information.
+				 */
+				boost::optional<network_info> ninfo;
+
+				/**
+				 * \brief The error of the join network call, if it failed.
+				 */
+				boost::exception_ptr ninfo_error;
+
+				/**
+				 * \brief The signed certificate.
+				 */
+				boost::optional<cryptoplus::x509::certificate> certificate;
+
+				/**
+				 * \brief The error of the sign call, if it failed.
+				 */
+				boost::exception_ptr certificate_error;
+			};
+
 			/**
 			 * \brief Create a client instance.
 			 * \param configuration The configuration to use.
@@ -129,12 +197,46 @@ namespace freelan
 			 */
 			cryptoplus::x509::certificate renew_certificate(const cryptoplus::x509::certificate_request& csr);
 
+			/**
+			 * \brief Perform a batch of independent calls concurrently.
+			 * \param request The calls to perform.
+			 * \return The results.
+			 *
+			 * authenticate() must have been called first: the calls share its
+			 * session cookie, and its connection when possible. When libcurl
+			 * supports it, the calls are multiplexed over a single HTTP/2
+			 * connection. Otherwise, they are issued over parallel connections.
+			 *
+			 * The calls succeed or fail independently: a failed call sets its error
+			 * in the response and leaves the results of the other calls intact. An
+			 * exception is only thrown if the calls could not be performed at all.
+			 */
+			batch_response perform_batch(const batch_request& request);
+
+			/**
+			 * \brief Register the client metrics.
+			 * \param registry The registry. Must outlive the client.
+			 */
+			void set_metrics(metrics_registry& registry);
+
 		private:
 
+			struct pending_call
+			{
+				curl request;
+				std::string data;
+			};
+
 			client(const client&);
 			client& operator=(const client&);
 
-			void perform_request(curl&, const std::string&, values_type&);
+			void configure_request(curl&);
+			void setup_pending_call(pending_call&, curl_multi&, bool);
+			void finish_pending_call(pending_call&, curl_multi&, values_type&);
+			void perform_request(curl&, values_type&);
+			void parse_response(curl&, const std::string&, values_type&);
+			void prepare_get_request(curl&, const std::string&);
+			void prepare_post_request(curl&, const std::string&, const values_type&);
 			void perform_get_request(curl&, const std::string&, values_type&);
 			void perform_post_request(curl&, const std::string&, const values_type&, values_type&);
 			void get_server_information(curl&, std::string&, unsigned int&, unsigned int&, std::string&, std::string&, std::string&, std::string&);
@@ -144,12 +246,20 @@ namespace freelan
 			cryptoplus::x509::certificate v1_get_authority_certificate(curl&, const std::string&);
 			network_info_v1 v1_join_network(curl&, const std::string&, const std::string&, const std::vector<endpoint>&);
 			cryptoplus::x509::certificate v1_sign_certificate_request(curl&, const std::string&, const cryptoplus::x509::certificate_request&);
+			void v1_prepare_get_authority_certificate(curl&, const std::string&);
+			void v1_prepare_join_network(curl&, const std::string&, const std::string&, const std::vector<endpoint>&);
+			void v1_prepare_sign_certificate_request(curl&, const std::string&, const cryptoplus::x509::certificate_request&);
+			cryptoplus::x509::certificate v1_parse_authority_certificate(const values_type&);
+			network_info_v1 v1_parse_join_network(const std::string&, const values_type&);
+			cryptoplus::x509::certificate v1_parse_sign_certificate_request(const values_type&);
 
 			// Version 1 sub-methods
 			void v1_get_server_login(curl&, const std::string&, std::string&);
 			void v1_post_server_login(curl&, const std::string&, const std::string&);
 
-			size_t read_data(boost::asio::const_buffer buf);
+			void record_requests(const boost::posix_time::ptime&, unsigned int, unsigned int);
+
+			static size_t read_data(std::string&, boost::asio::const_buffer buf);
 
 			const configuration& m_configuration;
 			logger& m_logger;
@@ -160,9 +270,15 @@ namespace freelan
 			std::string m_get_authority_certificate_url;
 			std::string m_join_network_url;
 			std::string m_sign_url;
+			curl_share m_share;
 			curl m_request;
 			const std::string m_scheme;
 			std::string m_data;
+
+			// Metrics
+			counter* m_requests_counter;
+			counter* m_request_failures_counter;
+			histogram* m_request_duration_histogram;
 	};
 
 }
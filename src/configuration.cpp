@@ -72,7 +72,14 @@ namespace freelan
 		accept_contact_requests(true),
 		accept_contacts(true),
 		hostname_resolution_protocol(HRP_IPV4),
-		hello_timeout(boost::posix_time::seconds(3))
+		hello_timeout(boost::posix_time::seconds(3)),
+		adaptive_hello_timeout(true),
+		min_hello_timeout(boost::posix_time::milliseconds(200)),
+		max_hello_timeout(boost::posix_time::seconds(15)),
+		path_probe_interval(),
+		max_pending_handshakes(0),
+		handshake_rate_limit(0),
+		validation_failure_cooldown()
 	{
 	}
 
@@ -80,6 +87,7 @@ namespace freelan
 		identity(),
 		certificate_validation_method(CVM_DEFAULT),
 		certificate_validation_callback(0),
+		certificate_validation_threads(0),
 		certificate_authority_list(),
 		certificate_revocation_validation_method(CRVM_NONE),
 		certificate_revocation_list_list()
@@ -46,6 +46,7 @@
 #include "core.hpp"
 
 #include <sstream>
+#include <set>
 
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
@@ -54,7 +55,9 @@
 #include "client.hpp"
 #include "tap_adapter_switch_port.hpp"
 #include "endpoint_switch_port.hpp"
+#include "callback_switch_port.hpp"
 #include "logger_stream.hpp"
+#include "probes.hpp"
 
 namespace freelan
 {
@@ -63,6 +66,7 @@ namespace freelan
 		static const switch_::group_type TAP_ADAPTERS_GROUP = 0;
 		static const switch_::group_type ENDPOINTS_GROUP = 1;
 		static const boost::posix_time::time_duration CERTIFICATE_RENEWAL_DELAY = boost::posix_time::hours(6);
+		static const boost::posix_time::time_duration RTT_ESTIMATION_LIFETIME = boost::posix_time::minutes(10);
 
 		enum ConfigurationItems
 		{
@@ -88,6 +92,20 @@ namespace freelan
 
 			return csr;
 		}
+
+		handshake_governor::fingerprint_type get_fingerprint(const cryptoplus::x509::certificate& cert)
+		{
+			unsigned char digest[EVP_MAX_MD_SIZE];
+			unsigned int digest_len = 0;
+
+			// A failure gives an empty fingerprint: the certificates concerned then share their cooldowns.
+			if (X509_digest(cert.raw(), EVP_sha256(), digest, &digest_len) != 1)
+			{
+				return handshake_governor::fingerprint_type();
+			}
+
+			return handshake_governor::fingerprint_type(reinterpret_cast<const char*>(digest), digest_len);
+		}
 	}
 
 	// Has to be put first, as static variables definition order matters
@@ -95,6 +113,9 @@ namespace freelan
 
 	const boost::posix_time::time_duration core::CONTACT_PERIOD = boost::posix_time::seconds(30);
 	const boost::posix_time::time_duration core::DYNAMIC_CONTACT_PERIOD = boost::posix_time::seconds(45);
+	const boost::posix_time::time_duration core::HANDSHAKE_TIMEOUT = boost::posix_time::seconds(10);
+	const unsigned int core::DYNAMIC_CONTACT_MAX_INTERVAL = 16;
+	const size_t core::DYNAMIC_CONTACT_BATCH_SIZE = 32;
 
 	const std::string core::DEFAULT_SERVICE = "12000";
 
@@ -103,32 +124,58 @@ namespace freelan
 		m_running(false),
 		m_configuration(_configuration),
 		m_logger(_logger),
+		m_metrics(),
+		m_handshake_duration_histogram(m_metrics.register_histogram("freelan_handshake_duration_microseconds", "The time from the first handshake message to the session establishment.")),
+		m_hello_rtt_histogram(m_metrics.register_histogram("freelan_hello_rtt_microseconds", "The round-trip time of HELLO requests.")),
+		m_presentation_validation_duration_histogram(m_metrics.register_histogram("freelan_presentation_validation_duration_microseconds", "The time it takes to validate the certificates of a presentation.")),
+		m_tap_adapter_read_size_histogram(m_metrics.register_histogram("freelan_tap_adapter_read_size_bytes", "The size of the frames read from the tap adapter.")),
+		m_sessions_established_counter(m_metrics.register_counter("freelan_sessions_established_total", "The count of established sessions.")),
+		m_sessions_lost_counter(m_metrics.register_counter("freelan_sessions_lost_total", "The count of lost sessions.")),
+		m_sessions_gauge(m_metrics.register_gauge("freelan_sessions", "The count of active sessions.")),
+		m_endpoint_received_frames_counter(m_metrics.register_counter("freelan_endpoint_received_frames_total", "The count of frames received from the established sessions.")),
+		m_endpoint_received_bytes_counter(m_metrics.register_counter("freelan_endpoint_received_bytes_total", "The count of bytes received from the established sessions.")),
+		m_endpoint_sent_frames_counter(m_metrics.register_counter("freelan_endpoint_sent_frames_total", "The count of frames sent to the established sessions.")),
+		m_endpoint_sent_bytes_counter(m_metrics.register_counter("freelan_endpoint_sent_bytes_total", "The count of bytes sent to the established sessions.")),
+		m_pending_greets_gauge(m_metrics.register_gauge("freelan_pending_greets", "The count of hosts being greeted.")),
+		m_pending_handshakes_gauge(m_metrics.register_gauge("freelan_pending_handshakes", "The count of handshakes in progress.")),
+		m_handshake_governor(m_configuration.fscp.max_pending_handshakes, m_configuration.fscp.handshake_rate_limit, HANDSHAKE_TIMEOUT, m_configuration.fscp.validation_failure_cooldown),
+		m_never_contact_list(),
 		m_server(),
 		m_resolver(m_io_service),
 		m_contact_timer(m_io_service, CONTACT_PERIOD),
 		m_dynamic_contact_timer(m_io_service, DYNAMIC_CONTACT_PERIOD),
+		m_path_prober_map(),
+		m_path_probe_timer(m_io_service),
+		m_tap_adapter_configured(false),
 		m_configuration_update_callback(),
 		m_open_callback(),
 		m_close_callback(),
 		m_session_established_callback(),
 		m_session_lost_callback(),
+		m_round_trip_time_callback(),
+		m_binary_logger(),
 		m_arp_filter(m_ethernet_filter),
 		m_ipv4_filter(m_ethernet_filter),
 		m_udp_filter(m_ipv4_filter),
 		m_bootp_filter(m_udp_filter),
 		m_dhcp_filter(m_bootp_filter),
 		m_switch(m_configuration.switch_),
-		m_check_configuration_timer(m_io_service)
+		m_presentation_generation(0),
+		m_check_configuration_timer(m_io_service),
+		m_validation_io_service()
 	{
+		m_logger.set_metrics(m_metrics);
+		m_switch.set_metrics(m_metrics);
 	}
 
-	void core::open()
+	core::~core()
 	{
-		typedef boost::asio::ip::udp::resolver::query query;
-
-		m_listen_endpoint = boost::apply_visitor(endpoint_resolve_visitor(m_resolver, to_protocol(m_configuration.fscp.hostname_resolution_protocol), query::address_configured | query::passive, DEFAULT_SERVICE), m_configuration.fscp.listen_on);
+		stop_validation_threads();
+	}
 
-		m_logger(LL_DEBUG) << "Core opening on " << *m_listen_endpoint << "...";
+	void core::open()
+	{
+		resolve_listen_endpoint();
 
 		if (m_configuration.server.enabled)
 		{
@@ -137,165 +184,77 @@ namespace freelan
 			update_server_configuration(CI_ALL);
 		}
 
-		if (m_configuration_update_callback)
-		{
-			m_configuration_update_callback(m_configuration);
-		}
+		check_configuration();
 
-		if (!m_configuration.security.identity)
-		{
-			throw std::runtime_error("No user certificate or private key set. Unable to continue.");
-		}
+		m_never_contact_list = ip_network_address_list(m_configuration.fscp.never_contact_list.begin(), m_configuration.fscp.never_contact_list.end());
 
 		create_server();
 		create_tap_adapter();
 
+		start_validation_threads();
+
 		// FSCP
 		m_server->open(*m_listen_endpoint);
 
+		// The CA store is built on the first validation.
 		if (m_configuration.security.certificate_validation_method == security_configuration::CVM_DEFAULT)
 		{
-			m_ca_store = cryptoplus::x509::store::create();
-
-			BOOST_FOREACH(const cert_type& cert, m_configuration.security.certificate_authority_list)
-			{
-				m_ca_store.add_certificate(cert);
-			}
-
-			BOOST_FOREACH(const crl_type& crl, m_configuration.security.certificate_revocation_list_list)
-			{
-				m_ca_store.add_certificate_revocation_list(crl);
-			}
-
-			switch (m_configuration.security.certificate_revocation_validation_method)
-			{
-				case security_configuration::CRVM_LAST:
-					{
-						m_ca_store.set_verification_flags(X509_V_FLAG_CRL_CHECK);
-						break;
-					}
-				case security_configuration::CRVM_ALL:
-					{
-						m_ca_store.set_verification_flags(X509_V_FLAG_CRL_CHECK | X509_V_FLAG_CRL_CHECK_ALL);
-						break;
-					}
-				case security_configuration::CRVM_NONE:
-					{
-						break;
-					}
-			}
+			refresh_ca_store();
 		}
 
-		// We start the contact loop
-		do_contact();
-		m_contact_timer.async_wait(boost::bind(&core::do_periodic_contact, this, boost::asio::placeholders::error));
-		m_dynamic_contact_timer.async_wait(boost::bind(&core::do_periodic_dynamic_contact, this, boost::asio::placeholders::error));
+		start_contact_loop();
+		start_path_probing();
 
 		// Tap adapter
 		if (m_tap_adapter)
 		{
-			m_tap_adapter->open();
-
-			// IPv4 address
-			if (!m_configuration.tap_adapter.ipv4_address_prefix_length.is_null())
-			{
-				try
-				{
-#ifdef WINDOWS
-					// Quick fix for Windows:
-					// Directly setting the IPv4 address/prefix length doesn't work like it should on Windows.
-					// We disable direct setting if DHCP is enabled.
+			open_tap_adapter();
 
-					if (!m_configuration.tap_adapter.dhcp_proxy_enabled)
-					{
-						m_tap_adapter->add_ip_address_v4(
-						    m_configuration.tap_adapter.ipv4_address_prefix_length.address(),
-						    m_configuration.tap_adapter.ipv4_address_prefix_length.prefix_length()
-						);
-					}
-#else
-					m_tap_adapter->add_ip_address_v4(
-					    m_configuration.tap_adapter.ipv4_address_prefix_length.address(),
-					    m_configuration.tap_adapter.ipv4_address_prefix_length.prefix_length()
-					);
-#endif
-				}
-				catch (std::runtime_error& ex)
-				{
-					m_logger(LL_WARNING) << "Cannot set IPv4 address: " << ex.what();
-				}
-			}
+			configure_tap_adapter();
+		}
 
-			// IPv6 address
-			if (!m_configuration.tap_adapter.ipv6_address_prefix_length.is_null())
-			{
-				try
-				{
-					m_tap_adapter->add_ip_address_v6(
-					    m_configuration.tap_adapter.ipv6_address_prefix_length.address(),
-					    m_configuration.tap_adapter.ipv6_address_prefix_length.prefix_length()
-					);
-				}
-				catch (std::runtime_error& ex)
-				{
-					m_logger(LL_WARNING) << "Cannot set IPv6 address: " << ex.what();
-				}
-			}
+		m_logger(LL_DEBUG) << "Core opened.";
 
-			m_tap_adapter->set_connected_state(true);
+		if (m_open_callback)
+		{
+			m_io_service.post(m_open_callback);
+		}
 
-			m_tap_adapter->async_read(boost::asio::buffer(m_tap_adapter_buffer, m_tap_adapter_buffer.size()), boost::bind(&core::tap_adapter_read_done, this, boost::ref(*m_tap_adapter), _1, _2));
+		m_running = true;
+	}
 
-			// The ARP proxy
-			if (m_configuration.tap_adapter.arp_proxy_enabled)
-			{
-				m_arp_proxy.reset(new arp_proxy_type(boost::asio::buffer(m_proxy_buffer), boost::bind(&core::on_proxy_data, this, _1), m_arp_filter));
-				m_arp_proxy->set_arp_request_callback(boost::bind(&core::on_arp_request, this, _1, _2));
-			}
-			else
-			{
-				m_arp_proxy.reset();
-			}
+	void core::async_open(async_open_handler handler)
+	{
+		const boost::shared_ptr<open_context> context = boost::make_shared<open_context>(handler);
 
-			// The DHCP proxy
-			if (m_configuration.tap_adapter.dhcp_proxy_enabled)
-			{
-				m_dhcp_proxy.reset(new dhcp_proxy_type(boost::asio::buffer(m_proxy_buffer), boost::bind(&core::on_proxy_data, this, _1), m_dhcp_filter));
-				m_dhcp_proxy->set_hardware_address(m_tap_adapter->ethernet_address());
+		m_logger(LL_DEBUG) << "Core opening asynchronously...";
 
-				if (!m_configuration.tap_adapter.dhcp_server_ipv4_address_prefix_length.is_null())
-				{
-					m_dhcp_proxy->set_software_address(m_configuration.tap_adapter.dhcp_server_ipv4_address_prefix_length.address());
-				}
+		// Stages that depend on nothing start right away.
+		// The resolution reports its own completion, from the resolver handler.
+		start_open_stage(context, OS_RESOLUTION, boost::bind(&core::async_resolve_listen_endpoint, this, context), false, true);
 
-				if (!m_configuration.tap_adapter.ipv4_address_prefix_length.is_null())
-				{
-					m_dhcp_proxy->add_entry(
-					    m_tap_adapter->ethernet_address(),
-					    m_configuration.tap_adapter.ipv4_address_prefix_length.address(),
-					    m_configuration.tap_adapter.ipv4_address_prefix_length.prefix_length()
-					);
-				}
-			}
-			else
-			{
-				m_dhcp_proxy.reset();
-			}
+		if ((m_configuration.security.certificate_validation_method == security_configuration::CVM_DEFAULT) && !refresh_ca_store())
+		{
+			// The CA store is built from a snapshot: the server configuration stage might add an authority certificate in the meantime.
+			context->ca_key = make_ca_store_key(m_configuration.security);
 
-			if (m_configuration.tap_adapter.up_callback)
-			{
-				m_configuration.tap_adapter.up_callback(*this, *m_tap_adapter);
-			}
+			start_open_stage(context, OS_CA_STORE, boost::bind(&core::build_open_ca_store, this, context), true);
+		}
+		else
+		{
+			skip_open_stage(context, OS_CA_STORE);
 		}
 
-		m_logger(LL_DEBUG) << "Core opened.";
+		if (m_configuration.tap_adapter.enabled)
+		{
+			create_tap_adapter();
 
-		if (m_open_callback)
+			start_open_stage(context, OS_TAP_ADAPTER, boost::bind(&core::open_tap_adapter, this), true);
+		}
+		else
 		{
-			m_io_service.post(m_open_callback);
+			skip_open_stage(context, OS_TAP_ADAPTER);
 		}
-
-		m_running = true;
 	}
 
 	void core::close()
@@ -313,9 +272,22 @@ namespace freelan
 		}
 	}
 
+	void core::apply_configuration(const freelan::configuration& configuration)
+	{
+		m_io_service.post(boost::bind(&core::do_apply_configuration, this, configuration));
+	}
+
 	void core::log(freelan::log_level level, const std::string& msg)
 	{
-		m_io_service.post(boost::bind(&logger::log, boost::ref(m_logger), level, msg));
+		if (m_logger.is_asynchronous())
+		{
+			// The queue is safe to use from any thread: no need to go through the io_service.
+			m_logger.log(level, msg);
+		}
+		else
+		{
+			m_io_service.post(boost::bind(&logger::log, boost::ref(m_logger), level, msg));
+		}
 	}
 
 	void core::do_close()
@@ -324,6 +296,7 @@ namespace freelan
 
 		m_dhcp_proxy.reset();
 		m_arp_proxy.reset();
+		m_tap_adapter_configured = false;
 
 		if (m_tap_adapter)
 		{
@@ -370,9 +343,21 @@ namespace freelan
 			m_tap_adapter->close();
 		}
 
+		release_tap_adapter_switch_port();
+
 		m_check_configuration_timer.cancel();
 		m_contact_timer.cancel();
 		m_dynamic_contact_timer.cancel();
+		m_path_probe_timer.cancel();
+
+		stop_validation_threads();
+
+		m_pending_greet_map.clear();
+		m_rtt_estimator_map.clear();
+		m_path_prober_map.clear();
+		m_handshake_governor.clear();
+		m_presentation_state_map.clear();
+		update_pending_gauges();
 
 		m_server->close();
 		m_listen_endpoint = boost::none;
@@ -380,237 +365,1544 @@ namespace freelan
 		m_logger(LL_DEBUG) << "Core closed.";
 	}
 
-	void core::async_greet(const ep_type& target)
+	void core::do_apply_configuration(const freelan::configuration& configuration)
 	{
-		m_server->async_greet(target, boost::bind(&core::on_hello_response, this, _1, _2, _3), m_configuration.fscp.hello_timeout);
-	}
+		m_logger(LL_INFORMATION) << "Applying new configuration...";
 
-	bool core::on_hello_request(const ep_type& sender, bool default_accept)
-	{
-		m_logger(LL_DEBUG) << "Received HELLO_REQUEST from " << sender << ".";
+		// FSCP
+		const fscp_configuration& new_fscp = configuration.fscp;
 
-		if (default_accept)
+		if (!(new_fscp.listen_on == m_configuration.fscp.listen_on))
 		{
-			m_server->async_introduce_to(sender);
-
-			return true;
+			m_logger(LL_WARNING) << "The listen endpoint cannot be changed while the core is open: the new value was ignored.";
 		}
 
-		return false;
-	}
+		fscp_configuration::endpoint_list new_contact_list;
 
-	void core::on_hello_response(const ep_type& sender, const boost::posix_time::time_duration& time_duration, bool success)
-	{
-		if (success)
+		BOOST_FOREACH(const fscp_configuration::endpoint& ep, new_fscp.contact_list)
 		{
-			m_logger(LL_DEBUG) << "Received HELLO_RESPONSE from " << sender << ". Latency: " << time_duration << ".";
-
-			m_server->async_introduce_to(sender);
+			if (std::find(m_configuration.fscp.contact_list.begin(), m_configuration.fscp.contact_list.end(), ep) == m_configuration.fscp.contact_list.end())
+			{
+				new_contact_list.push_back(ep);
+			}
 		}
-		else
+
+		// The dynamic contacts received from the server are kept. As configuration() already lists them, each certificate is only added once.
+		std::set<cert_type, certificate_less> dynamic_contact_set;
+		cert_list_type dynamic_contact_list;
+
+		BOOST_FOREACH(const cert_type& cert, new_fscp.dynamic_contact_list)
 		{
-			m_logger(LL_DEBUG) << "Received no HELLO_RESPONSE from " << sender << ". Timeout: " << time_duration << ".";
+			if (dynamic_contact_set.insert(cert).second)
+			{
+				dynamic_contact_list.push_back(cert);
+			}
 		}
-	}
 
-	bool core::on_presentation(const ep_type& sender, cert_type sig_cert, cert_type enc_cert, bool is_new)
-	{
-		if (m_logger.level() <= LL_DEBUG)
+		BOOST_FOREACH(const cert_type& cert, m_last_dynamic_contact_list_from_server)
 		{
-			m_logger(LL_DEBUG) << "Received PRESENTATION from " << sender << ". Signature: " << sig_cert.subject().oneline() << ". Cipherment: " << enc_cert.subject().oneline() << ". New presentation: " << is_new << ".";
+			if (dynamic_contact_set.insert(cert).second)
+			{
+				dynamic_contact_list.push_back(cert);
+			}
 		}
 
-		if (certificate_is_valid(sig_cert) && certificate_is_valid(enc_cert))
+		const std::set<cert_type, certificate_less> dynamic_contacts(m_configuration.fscp.dynamic_contact_list.begin(), m_configuration.fscp.dynamic_contact_list.end());
+		cert_list_type new_dynamic_contact_list;
+
+		BOOST_FOREACH(const cert_type& cert, dynamic_contact_list)
 		{
-			m_server->async_request_session(sender);
-			return true;
+			if (dynamic_contacts.find(cert) == dynamic_contacts.end())
+			{
+				new_dynamic_contact_list.push_back(cert);
+			}
 		}
 
-		return false;
-	}
+		const fscp_configuration::endpoint listen_on = m_configuration.fscp.listen_on;
 
-	bool core::on_session_request(const ep_type& sender, bool default_accept)
-	{
-		m_logger(LL_DEBUG) << "Received SESSION_REQUEST from " << sender << ".";
+		m_configuration.fscp = new_fscp;
+		m_configuration.fscp.listen_on = listen_on;
+		m_configuration.fscp.dynamic_contact_list.swap(dynamic_contact_list);
 
-		if (default_accept)
+		m_never_contact_list = ip_network_address_list(m_configuration.fscp.never_contact_list.begin(), m_configuration.fscp.never_contact_list.end());
+
+		m_handshake_governor.set_limits(new_fscp.max_pending_handshakes, new_fscp.handshake_rate_limit, new_fscp.validation_failure_cooldown);
+
+		if (m_running)
 		{
-			return true;
+			if (!new_contact_list.empty())
+			{
+				m_logger(LL_INFORMATION) << "Contacting " << new_contact_list.size() << " new contact(s)...";
+
+				std::for_each(new_contact_list.begin(), new_contact_list.end(), boost::bind(&core::do_contact, this, _1));
+			}
+
+			// Removed dynamic contacts are forgotten on the next periodic dynamic contact.
+			if (!new_dynamic_contact_list.empty())
+			{
+				do_dynamic_contact(new_dynamic_contact_list);
+			}
 		}
 
-		return false;
-	}
+		// Security
+		const security_configuration& new_security = configuration.security;
 
-	void core::on_session_established(const ep_type& sender)
-	{
-		cert_type sig_cert = m_server->get_presentation(sender).signature_certificate();
+		if (new_security.identity)
+		{
+			if (!m_configuration.security.identity || (new_security.identity->signature_certificate().raw() != m_configuration.security.identity->signature_certificate().raw()))
+			{
+				m_configuration.security.identity = new_security.identity;
 
-		m_logger(LL_INFORMATION) << "Session established with " << sender << " (" << sig_cert.subject().oneline() << ").";
+				if (m_server)
+				{
+					m_server->set_identity(*new_security.identity);
+				}
 
-		const switch_::port_type port = boost::make_shared<endpoint_switch_port>(sender, boost::bind(&fscp::server::async_send_data, &*m_server, _1, fscp::CHANNEL_NUMBER_0, _2));
+				m_logger(LL_INFORMATION) << "Local client identity was updated.";
+			}
+		}
+		else
+		{
+			m_logger(LL_WARNING) << "The new configuration has no identity: keeping the current one.";
+		}
 
-		m_endpoint_switch_port_map[sender] = port;
-		m_switch.register_port(port, ENDPOINTS_GROUP);
+		if (new_security.certificate_validation_threads != m_configuration.security.certificate_validation_threads)
+		{
+			m_logger(LL_WARNING) << "The count of certificate validation threads cannot be changed while the core is open: the new value was ignored.";
+		}
 
-		if (m_session_established_callback)
 		{
-			m_session_established_callback(sender);
+			// The validation settings and the certificate material are read by the validation threads.
+			boost::mutex::scoped_lock lock(m_ca_store_mutex);
+
+			m_configuration.security.certificate_validation_method = new_security.certificate_validation_method;
+			m_configuration.security.certificate_validation_callback = new_security.certificate_validation_callback;
+			m_configuration.security.certificate_authority_list = new_security.certificate_authority_list;
+			m_configuration.security.certificate_revocation_validation_method = new_security.certificate_revocation_validation_method;
+			m_configuration.security.certificate_revocation_list_list = new_security.certificate_revocation_list_list;
 		}
-	}
 
-	void core::on_session_lost(const ep_type& sender)
-	{
-		cert_type sig_cert = m_server->get_presentation(sender).signature_certificate();
+		// The CA store is rebuilt on the next validation if the certificate material changed.
+		refresh_ca_store();
 
-		m_logger(LL_INFORMATION) << "Session with " << sender << " lost (" << sig_cert.subject().oneline() << ").";
+		// Switch
+		m_configuration.switch_ = configuration.switch_;
+		m_switch.set_configuration(m_configuration.switch_);
 
-		if (m_session_lost_callback)
+		// Tap adapter
+		const tap_adapter_configuration& new_tap_adapter = configuration.tap_adapter;
+
+		if ((new_tap_adapter.enabled != m_configuration.tap_adapter.enabled) || !(new_tap_adapter.ipv4_address_prefix_length == m_configuration.tap_adapter.ipv4_address_prefix_length) || !(new_tap_adapter.ipv6_address_prefix_length == m_configuration.tap_adapter.ipv6_address_prefix_length))
 		{
-			m_session_lost_callback(sender);
+			m_logger(LL_WARNING) << "The tap adapter activation and addresses cannot be changed while the core is open: the new values were ignored.";
 		}
 
-		const switch_::port_type port = m_endpoint_switch_port_map[sender];
+		m_configuration.tap_adapter.arp_proxy_enabled = new_tap_adapter.arp_proxy_enabled;
+		m_configuration.tap_adapter.arp_proxy_fake_ethernet_address = new_tap_adapter.arp_proxy_fake_ethernet_address;
+		m_configuration.tap_adapter.dhcp_proxy_enabled = new_tap_adapter.dhcp_proxy_enabled;
+		m_configuration.tap_adapter.dhcp_server_ipv4_address_prefix_length = new_tap_adapter.dhcp_server_ipv4_address_prefix_length;
+		m_configuration.tap_adapter.dhcp_server_ipv6_address_prefix_length = new_tap_adapter.dhcp_server_ipv6_address_prefix_length;
+		m_configuration.tap_adapter.up_callback = new_tap_adapter.up_callback;
+		m_configuration.tap_adapter.down_callback = new_tap_adapter.down_callback;
 
-		if (port)
+		// The proxies are built when the tap adapter is configured: rebuild them if it already is.
+		if (m_tap_adapter_configured)
 		{
-			m_switch.unregister_port(port);
-			m_endpoint_switch_port_map.erase(sender);
+			configure_proxies();
 		}
-	}
 
-	void core::on_data(const ep_type& sender, fscp::channel_number_type channel_number, boost::asio::const_buffer data)
-	{
-		switch (channel_number)
+		// Server
+		if (configuration.server.enabled != m_configuration.server.enabled)
 		{
-			case fscp::CHANNEL_NUMBER_0:
-				on_ethernet_data(sender, data);
-				break;
-			default:
-				m_logger(LL_WARNING) << "Received unhandled " << boost::asio::buffer_size(data) << " byte(s) of data on FSCP channel #" << static_cast<int>(channel_number);
-				break;
+			m_logger(LL_WARNING) << "The server activation cannot be changed while the core is open: the new value was ignored.";
 		}
+
+		const bool server_enabled = m_configuration.server.enabled;
+
+		// The other server settings are used on the next configuration update.
+		m_configuration.server = configuration.server;
+		m_configuration.server.enabled = server_enabled;
+
+		m_logger(LL_INFORMATION) << "New configuration applied.";
 	}
 
-	bool core::on_contact_request(const ep_type& sender, cert_type cert, const ep_type& target)
+	void core::async_greet(const ep_type& target)
 	{
-		if (m_configuration.fscp.accept_contact_requests)
-		{
-			m_logger(LL_INFORMATION) << "Received contact request from " << sender << " for " << cert.subject().oneline() << " (" << target << ")";
+		m_server->async_greet(target, boost::bind(&core::on_hello_response, this, _1, _2, _3), get_hello_timeout(target));
+	}
 
-			return true;
-		}
-		else
+	boost::optional<rtt_estimator> core::get_round_trip_time(const ep_type& host) const
+	{
+		const rtt_estimator_map_type::const_iterator it = m_rtt_estimator_map.find(host);
+
+		if (it == m_rtt_estimator_map.end())
 		{
-			return false;
+			return boost::none;
 		}
+
+		return it->second;
 	}
 
-	void core::on_contact(const ep_type& sender, cert_type cert, const ep_type& target)
+	boost::posix_time::time_duration core::get_hello_timeout(const ep_type& host) const
 	{
-		if (m_configuration.fscp.accept_contacts)
+		if (!m_configuration.fscp.adaptive_hello_timeout)
 		{
-			// We check if the contact is one of our forbidden network list.
-			if (has_address(m_configuration.fscp.never_contact_list.begin(), m_configuration.fscp.never_contact_list.end(), target.address()))
-			{
-				m_logger(LL_WARNING) << "Received forbidden contact from " << sender << ": " << cert.subject().oneline() << " is at " << target << " but won't be contacted.";
-			}
-			else
-			{
-				m_logger(LL_INFORMATION) << "Received contact from " << sender << ": " << cert.subject().oneline() << " is at " << target;
-
-				do_greet(target);
-			}
+			return m_configuration.fscp.hello_timeout;
 		}
-	}
 
-	void core::on_ethernet_data(const ep_type& sender, boost::asio::const_buffer data)
-	{
-		const switch_::port_type port = m_endpoint_switch_port_map[sender];
+		const rtt_estimator_map_type::const_iterator it = m_rtt_estimator_map.find(host);
 
-		if (port)
+		if (it == m_rtt_estimator_map.end())
 		{
-			m_switch.receive_data(port, data);
+			return m_configuration.fscp.hello_timeout;
 		}
-	}
 
-	void core::on_network_error(const ep_type& target, const boost::system::error_code& ec)
-	{
-		m_logger(LL_WARNING) << "Error while sending message to" << target << ": " << ec;
+		return it->second.timeout(m_configuration.fscp.hello_timeout, m_configuration.fscp.min_hello_timeout, m_configuration.fscp.max_hello_timeout);
 	}
 
-	void core::tap_adapter_read_done(asiotap::tap_adapter& _tap_adapter, const boost::system::error_code& ec, size_t cnt)
+	bool core::on_hello_request(const ep_type& sender, bool default_accept)
+	{
+		FREELAN_LOG(m_logger, LL_DEBUG, "Received HELLO_REQUEST from " << sender << ".");
+
+		if (default_accept)
+		{
+			// The remote host started the handshake: we don't need to greet it ourselves.
+			set_pending_greet(sender, HANDSHAKE_TIMEOUT);
+
+			m_server->async_introduce_to(sender);
+
+			return true;
+		}
+
+		return false;
+	}
+
+	void core::on_hello_response(const ep_type& sender, const boost::posix_time::time_duration& time_duration, bool success)
+	{
+		if (success)
+		{
+			FREELAN_LOG(m_logger, LL_DEBUG, "Received HELLO_RESPONSE from " << sender << ". Latency: " << time_duration << ".");
+
+			m_hello_rtt_histogram.record(time_duration);
+
+			rtt_estimator& estimator = m_rtt_estimator_map[sender];
+			estimator.add_sample(time_duration);
+
+			if (m_round_trip_time_callback)
+			{
+				m_round_trip_time_callback(sender, estimator);
+			}
+
+			set_pending_greet(sender, HANDSHAKE_TIMEOUT);
+
+			m_server->async_introduce_to(sender);
+		}
+		else
+		{
+			FREELAN_LOG(m_logger, LL_DEBUG, "Received no HELLO_RESPONSE from " << sender << ". Timeout: " << time_duration << ".");
+
+			rtt_estimator& estimator = m_rtt_estimator_map[sender];
+			estimator.backoff();
+
+			if (m_round_trip_time_callback)
+			{
+				m_round_trip_time_callback(sender, estimator);
+			}
+
+			if (m_configuration.fscp.adaptive_hello_timeout)
+			{
+				// The host is not greeted again before its backed off timeout expires.
+				set_pending_greet(sender, get_hello_timeout(sender));
+			}
+			else
+			{
+				m_pending_greet_map.erase(sender);
+			}
+		}
+
+		update_pending_gauges();
+	}
+
+	bool core::on_presentation(const ep_type& sender, cert_type sig_cert, cert_type enc_cert, bool is_new)
+	{
+		FREELAN_LOG(m_logger, LL_DEBUG, "Received PRESENTATION from " << sender << ". Signature: " << sig_cert.subject().oneline() << ". Cipherment: " << enc_cert.subject().oneline() << ". New presentation: " << is_new << ".");
+
+		const handshake_governor::fingerprint_type fingerprint = get_fingerprint(sig_cert);
+
+		if (m_handshake_governor.is_cooling_down(sender.address(), fingerprint))
+		{
+			FREELAN_LOG(m_logger, LL_DEBUG, "Ignoring PRESENTATION from " << sender << ": this certificate failed validation recently.");
+
+			return false;
+		}
+
+		if (!m_handshake_governor.consume_token(sender.address()))
+		{
+			FREELAN_LOG(m_logger, LL_DEBUG, "Ignoring PRESENTATION from " << sender << ": too many handshake messages from this host.");
+
+			return false;
+		}
+
+		const bool handshake_started = m_handshake_governor.begin_handshake(sender);
+
+		update_pending_gauges();
+
+		if (!handshake_started)
+		{
+			FREELAN_LOG(m_logger, LL_DEBUG, "Ignoring PRESENTATION from " << sender << ": too many handshakes in progress (" << m_handshake_governor.pending_handshake_count() << ").");
+
+			return false;
+		}
+
+		if (m_validation_work)
+		{
+			// The server stores the presentation as soon as we return true and has no way to drop it:
+			// no session is requested or accepted until validation succeeds, and a rejected
+			// presentation loses its entry so that the later session requests are refused.
+			presentation_state& state = m_presentation_state_map[sender];
+			state.generation = ++m_presentation_generation;
+			state.valid = false;
+			state.fingerprint = fingerprint;
+
+			m_validation_io_service.post(boost::bind(&core::do_validate_presentation, this, sender, sig_cert, enc_cert, state.generation));
+
+			return true;
+		}
+
+		if (presentation_is_valid(sender, sig_cert, enc_cert, m_logger))
+		{
+			m_server->async_request_session(sender);
+			return true;
+		}
+
+		m_handshake_governor.end_handshake(sender);
+		m_handshake_governor.report_validation_failure(sender.address(), fingerprint);
+		update_pending_gauges();
+
+		return false;
+	}
+
+	bool core::on_session_request(const ep_type& sender, bool default_accept)
+	{
+		FREELAN_LOG(m_logger, LL_DEBUG, "Received SESSION_REQUEST from " << sender << ".");
+
+		if (default_accept)
+		{
+			if (m_validation_work)
+			{
+				const presentation_state_map_type::const_iterator it = m_presentation_state_map.find(sender);
+
+				if ((it == m_presentation_state_map.end()) || !it->second.valid)
+				{
+					FREELAN_LOG(m_logger, LL_DEBUG, "Ignoring SESSION_REQUEST from " << sender << ": its presentation was not validated.");
+
+					return false;
+				}
+			}
+
+			// Session renewals with established hosts are never throttled.
+			if (!m_server->has_session(sender))
+			{
+				if (!m_handshake_governor.consume_token(sender.address()))
+				{
+					FREELAN_LOG(m_logger, LL_DEBUG, "Ignoring SESSION_REQUEST from " << sender << ": too many handshake messages from this host.");
+
+					return false;
+				}
+
+				const bool handshake_started = m_handshake_governor.begin_handshake(sender);
+
+				update_pending_gauges();
+
+				if (!handshake_started)
+				{
+					FREELAN_LOG(m_logger, LL_DEBUG, "Ignoring SESSION_REQUEST from " << sender << ": too many handshakes in progress (" << m_handshake_governor.pending_handshake_count() << ").");
+
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+	void core::set_binary_logger(boost::shared_ptr<binary_logger> _binary_logger)
+	{
+		if (_binary_logger)
+		{
+			m_binary_log_formats.session_established = _binary_logger->register_format(LL_INFORMATION, "Session established with {}.");
+			m_binary_log_formats.session_lost = _binary_logger->register_format(LL_INFORMATION, "Session with {} lost.");
+			m_binary_log_formats.network_error = _binary_logger->register_format(LL_WARNING, "Error while sending message to {}: {}:{}");
+			m_binary_log_formats.presentation_rejected = _binary_logger->register_format(LL_WARNING, "The presentation of {} was rejected.");
+		}
+
+		m_binary_logger = _binary_logger;
+	}
+
+	void core::set_frame_tracing(unsigned int sampling_interval)
+	{
+		m_switch.set_frame_tracer(NULL);
+
+		if (sampling_interval > 0)
+		{
+			m_frame_tracer.reset(new frame_tracer(m_metrics, sampling_interval));
+			m_switch.set_frame_tracer(m_frame_tracer.get());
+		}
+		else
+		{
+			m_frame_tracer.reset();
+		}
+	}
+
+	void core::set_frame_callback(frame_callback callback)
+	{
+		if (m_frame_callback_switch_port)
+		{
+			m_switch.unregister_port(m_frame_callback_switch_port);
+			m_frame_callback_switch_port.reset();
+		}
+
+		if (callback)
+		{
+			m_frame_callback_switch_port = boost::make_shared<callback_switch_port>(callback);
+			m_switch.register_port(m_frame_callback_switch_port, TAP_ADAPTERS_GROUP);
+		}
+	}
+
+	void core::inject_frame(boost::asio::const_buffer frame)
+	{
+		if (m_frame_tracer)
+		{
+			m_frame_tracer->begin(frame_tracer::FTD_OUTBOUND);
+			m_frame_tracer->mark(frame_tracer::FTS_CLASSIFICATION);
+		}
+
+		m_switch.receive_data(m_frame_callback_switch_port, frame);
+
+		if (m_frame_tracer)
+		{
+			m_frame_tracer->end();
+		}
+	}
+
+	void core::on_session_established(const ep_type& sender)
+	{
+		cert_type sig_cert = m_server->get_presentation(sender).signature_certificate();
+
+		m_logger(LL_INFORMATION) << "Session established with " << sender << " (" << sig_cert.subject().oneline() << ").";
+
+		if (m_binary_logger)
+		{
+			(*m_binary_logger)(m_binary_log_formats.session_established) << sender;
+		}
+
+		const switch_::port_type port = boost::make_shared<endpoint_switch_port>(sender, boost::bind(&core::send_ethernet_data, this, _1, _2));
+
+		m_endpoint_switch_port_map[sender] = port;
+		m_switch.register_port(port, ENDPOINTS_GROUP);
+
+		FREELAN_PROBE2(session_established, sender.data(), sender.size());
+
+		m_sessions_established_counter.increment();
+		m_sessions_gauge.set(m_endpoint_switch_port_map.size());
+
+		m_pending_greet_map.erase(sender);
+
+		boost::posix_time::time_duration handshake_duration;
+
+		const bool handshake_ended = m_handshake_governor.end_handshake(sender, handshake_duration);
+
+		update_pending_gauges();
+
+		if (handshake_ended)
+		{
+			m_handshake_duration_histogram.record(handshake_duration);
+		}
+
+		if (m_session_established_callback)
+		{
+			m_session_established_callback(sender);
+		}
+	}
+
+	void core::on_session_lost(const ep_type& sender)
+	{
+		cert_type sig_cert = m_server->get_presentation(sender).signature_certificate();
+
+		m_logger(LL_INFORMATION) << "Session with " << sender << " lost (" << sig_cert.subject().oneline() << ").";
+
+		if (m_binary_logger)
+		{
+			(*m_binary_logger)(m_binary_log_formats.session_lost) << sender;
+		}
+
+		// The peer might be reachable again soon: we don't want to wait for the backoff to expire.
+		m_dynamic_contact_state_map.erase(sig_cert);
+
+		if (m_session_lost_callback)
+		{
+			m_session_lost_callback(sender);
+		}
+
+		const switch_::port_type port = m_endpoint_switch_port_map[sender];
+
+		if (port)
+		{
+			m_switch.unregister_port(port);
+			m_endpoint_switch_port_map.erase(sender);
+		}
+
+		FREELAN_PROBE2(session_lost, sender.data(), sender.size());
+
+		m_path_prober_map.erase(sender);
+		m_presentation_state_map.erase(sender);
+
+		m_sessions_lost_counter.increment();
+		m_sessions_gauge.set(m_endpoint_switch_port_map.size());
+	}
+
+	void core::on_data(const ep_type& sender, fscp::channel_number_type channel_number, boost::asio::const_buffer data)
+	{
+		switch (channel_number)
+		{
+			case fscp::CHANNEL_NUMBER_0:
+				on_ethernet_data(sender, data);
+				break;
+			case fscp::CHANNEL_NUMBER_1:
+				on_probe_data(sender, data);
+				break;
+			default:
+				FREELAN_LOG_LIMITED(m_logger, LL_WARNING, "Received unhandled " << boost::asio::buffer_size(data) << " byte(s) of data on FSCP channel #" << static_cast<int>(channel_number));
+				break;
+		}
+	}
+
+	bool core::on_contact_request(const ep_type& sender, cert_type cert, const ep_type& target)
+	{
+		if (m_configuration.fscp.accept_contact_requests)
+		{
+			m_logger(LL_INFORMATION) << "Received contact request from " << sender << " for " << cert.subject().oneline() << " (" << target << ")";
+
+			return true;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	void core::on_contact(const ep_type& sender, cert_type cert, const ep_type& target)
+	{
+		if (m_configuration.fscp.accept_contacts)
+		{
+			// We check if the contact is one of our forbidden network list.
+			if (m_never_contact_list.has_address(target.address()))
+			{
+				FREELAN_LOG_LIMITED(m_logger, LL_WARNING, "Received forbidden contact from " << sender << ": " << cert.subject().oneline() << " is at " << target << " but won't be contacted.");
+			}
+			else
+			{
+				m_logger(LL_INFORMATION) << "Received contact from " << sender << ": " << cert.subject().oneline() << " is at " << target;
+
+				do_greet(target);
+			}
+		}
+	}
+
+	void core::on_ethernet_data(const ep_type& sender, boost::asio::const_buffer data)
+	{
+		if (m_frame_tracer)
+		{
+			m_frame_tracer->begin(frame_tracer::FTD_INBOUND);
+		}
+
+		const endpoint_switch_port_map_type::const_iterator port_entry = m_endpoint_switch_port_map.find(sender);
+
+		if (port_entry != m_endpoint_switch_port_map.end())
+		{
+			m_endpoint_received_frames_counter.increment();
+			m_endpoint_received_bytes_counter.increment(boost::asio::buffer_size(data));
+
+			if (m_frame_tracer)
+			{
+				m_frame_tracer->mark(frame_tracer::FTS_CLASSIFICATION);
+			}
+
+			m_switch.receive_data(port_entry->second, data);
+
+			if (m_frame_tracer)
+			{
+				// The tap adapter writes synchronously: the frame was written.
+				m_frame_tracer->mark(frame_tracer::FTS_HANDOFF);
+			}
+		}
+
+		if (m_frame_tracer)
+		{
+			m_frame_tracer->end();
+		}
+	}
+
+	void core::on_probe_data(const ep_type& sender, boost::asio::const_buffer data)
+	{
+		const boost::posix_time::ptime receive_time = boost::posix_time::microsec_clock::universal_time();
+
+		switch (path_prober::get_message_type(data))
+		{
+			case path_prober::MT_REQUEST:
+				{
+					boost::array<uint8_t, path_prober::MESSAGE_SIZE> response;
+
+					const size_t response_size = path_prober::write_response(data, receive_time, boost::asio::buffer(response));
+
+					m_server->async_send_data(sender, fscp::CHANNEL_NUMBER_1, boost::asio::buffer(response, response_size));
+
+					break;
+				}
+			case path_prober::MT_RESPONSE:
+				{
+					const path_prober_map_type::iterator it = m_path_prober_map.find(sender);
+
+					if (it != m_path_prober_map.end())
+					{
+						it->second.handle_response(data, receive_time);
+					}
+
+					break;
+				}
+			case path_prober::MT_INVALID:
+				{
+					FREELAN_LOG_LIMITED(m_logger, LL_WARNING, "Received an invalid " << boost::asio::buffer_size(data) << " byte(s) probe message from " << sender << ".");
+
+					break;
+				}
+		}
+	}
+
+	boost::optional<path_quality> core::get_path_quality(const ep_type& host) const
+	{
+		const path_prober_map_type::const_iterator it = m_path_prober_map.find(host);
+
+		if (it == m_path_prober_map.end())
+		{
+			return boost::none;
+		}
+
+		return it->second.quality();
+	}
+
+	void core::start_path_probing()
+	{
+		if (m_configuration.fscp.path_probe_interval > boost::posix_time::time_duration())
+		{
+			m_path_probe_timer.expires_from_now(m_configuration.fscp.path_probe_interval);
+			m_path_probe_timer.async_wait(make_custom_alloc_handler(m_path_probe_timer_allocator, boost::bind(&core::do_periodic_path_probing, this, boost::asio::placeholders::error)));
+		}
+	}
+
+	void core::do_periodic_path_probing(const boost::system::error_code& ec)
+	{
+		if (ec != boost::asio::error::operation_aborted)
+		{
+			boost::array<uint8_t, path_prober::MESSAGE_SIZE> request;
+
+			BOOST_FOREACH(const endpoint_switch_port_map_type::value_type& entry, m_endpoint_switch_port_map)
+			{
+				const size_t request_size = m_path_prober_map[entry.first].write_request(boost::asio::buffer(request));
+
+				m_server->async_send_data(entry.first, fscp::CHANNEL_NUMBER_1, boost::asio::buffer(request, request_size));
+			}
+
+			start_path_probing();
+		}
+	}
+
+	void core::send_ethernet_data(const ep_type& target, boost::asio::const_buffer data)
+	{
+		m_endpoint_sent_frames_counter.increment();
+		m_endpoint_sent_bytes_counter.increment(boost::asio::buffer_size(data));
+
+		m_server->async_send_data(target, fscp::CHANNEL_NUMBER_0, data);
+
+		if (m_frame_tracer)
+		{
+			m_frame_tracer->mark(frame_tracer::FTS_HANDOFF);
+		}
+	}
+
+	void core::on_network_error(const ep_type& target, const boost::system::error_code& ec)
+	{
+		FREELAN_LOG_LIMITED(m_logger, LL_WARNING, "Error while sending message to " << target << ": " << ec);
+
+		if (m_binary_logger)
+		{
+			(*m_binary_logger)(m_binary_log_formats.network_error) << target << ec.category().name() << ec.value();
+		}
+	}
+
+	void core::tap_adapter_read_done(asiotap::tap_adapter& _tap_adapter, const boost::system::error_code& ec, size_t cnt)
+	{
+		if (!ec)
+		{
+			boost::asio::const_buffer data = boost::asio::buffer(m_tap_adapter_buffer, cnt);
+
+			m_tap_adapter_read_size_histogram.record(cnt);
+
+			if (m_frame_tracer)
+			{
+				m_frame_tracer->begin(frame_tracer::FTD_OUTBOUND);
+			}
+
+			bool handled = false;
+
+			if (m_arp_proxy || m_dhcp_proxy)
+			{
+				m_ethernet_filter.parse(data);
+
+				if (m_arp_proxy && m_arp_filter.get_last_helper())
+				{
+					handled = true;
+					m_arp_filter.clear_last_helper();
+				}
+
+				if (m_dhcp_proxy && m_dhcp_filter.get_last_helper())
+				{
+					handled = true;
+					m_dhcp_filter.clear_last_helper();
+				}
+			}
+
+			if (m_frame_tracer)
+			{
+				m_frame_tracer->mark(frame_tracer::FTS_CLASSIFICATION);
+			}
+
+			if (!handled)
+			{
+				m_switch.receive_data(m_tap_adapter_switch_port, data);
+			}
+
+			if (m_frame_tracer)
+			{
+				m_frame_tracer->end();
+			}
+
+			// Start another read
+			_tap_adapter.async_read(boost::asio::buffer(m_tap_adapter_buffer, m_tap_adapter_buffer.size()), make_custom_alloc_handler(m_tap_adapter_read_allocator, boost::bind(&core::tap_adapter_read_done, this, boost::ref(_tap_adapter), _1, _2)));
+		}
+		else
+		{
+			// If the core is currently stopping, this kind of error is expected.
+			if (m_running)
+			{
+				m_logger(LL_ERROR) << "Read failed on " << _tap_adapter.name() << ". Error: " << ec;
+
+				close();
+			}
+		}
+	}
+
+	void core::do_greet(const ep_type& ep)
+	{
+		if (!m_server->has_session(ep))
+		{
+			if (is_pending_greet(ep))
+			{
+				FREELAN_LOG(m_logger, LL_DEBUG, "A greeting or handshake with " << ep << " is already in progress.");
+			}
+			else
+			{
+				FREELAN_LOG(m_logger, LL_DEBUG, "Sending HELLO_REQUEST to " << ep << "...");
+
+				set_pending_greet(ep, get_hello_timeout(ep));
+
+				async_greet(ep);
+			}
+		}
+	}
+
+	void core::update_pending_gauges()
+	{
+		// The maps are only used in the io_service thread: the gauges let metrics snapshots be taken from any thread.
+		m_pending_greets_gauge.set(m_pending_greet_map.size());
+		m_pending_handshakes_gauge.set(m_handshake_governor.pending_handshake_count());
+	}
+
+	void core::set_pending_greet(const ep_type& ep, const boost::posix_time::time_duration& timeout)
+	{
+		m_pending_greet_map[ep] = boost::posix_time::microsec_clock::universal_time() + timeout;
+
+		update_pending_gauges();
+	}
+
+	bool core::is_pending_greet(const ep_type& ep) const
+	{
+		const pending_greet_map_type::const_iterator it = m_pending_greet_map.find(ep);
+
+		return ((it != m_pending_greet_map.end()) && (it->second > boost::posix_time::microsec_clock::universal_time()));
+	}
+
+	void core::purge_presentation_states()
+	{
+		// Presentations of hosts with neither a session nor a handshake in progress are of no use anymore.
+		for (presentation_state_map_type::iterator it = m_presentation_state_map.begin(); it != m_presentation_state_map.end();)
+		{
+			if (!m_server->has_session(it->first) && !m_handshake_governor.has_pending_handshake(it->first))
+			{
+				m_presentation_state_map.erase(it++);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	void core::purge_pending_greets()
+	{
+		const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+		for (pending_greet_map_type::iterator it = m_pending_greet_map.begin(); it != m_pending_greet_map.end();)
+		{
+			if (it->second <= now)
+			{
+				m_pending_greet_map.erase(it++);
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		// Estimations of hosts we stopped talking to are forgotten after a while.
+		for (rtt_estimator_map_type::iterator it = m_rtt_estimator_map.begin(); it != m_rtt_estimator_map.end();)
+		{
+			const bool is_stale = (now - it->second.last_update() > RTT_ESTIMATION_LIFETIME);
+
+			if (is_stale && !m_server->has_session(it->first) && (m_pending_greet_map.find(it->first) == m_pending_greet_map.end()))
+			{
+				m_rtt_estimator_map.erase(it++);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	void core::do_greet(const boost::system::error_code& ec, boost::asio::ip::udp::resolver::iterator it, const freelan::fscp_configuration::endpoint& ep)
 	{
 		if (!ec)
 		{
-			boost::asio::const_buffer data = boost::asio::buffer(m_tap_adapter_buffer, cnt);
+			do_greet(*it);
+		}
+		else
+		{
+			m_logger(LL_WARNING) << "Failed to resolve " << ep << ": " << ec;
+		}
+	}
+
+	void core::do_contact()
+	{
+		std::for_each(m_configuration.fscp.contact_list.begin(), m_configuration.fscp.contact_list.end(), boost::bind(&core::do_contact, this, _1));
+	}
+
+	void core::do_contact(const fscp_configuration::endpoint& ep)
+	{
+		typedef boost::asio::ip::udp::resolver::query query;
+
+		boost::apply_visitor(
+		    endpoint_async_resolve_visitor(
+		        m_resolver,
+		        to_protocol(m_configuration.fscp.hostname_resolution_protocol),
+		        query::address_configured,
+		        DEFAULT_SERVICE,
+		        boost::bind(&core::do_greet, this, _1, _2, ep)
+		    ),
+		    ep
+		);
+	}
+
+	void core::do_periodic_contact(const boost::system::error_code& ec)
+	{
+		if (ec != boost::asio::error::operation_aborted)
+		{
+			purge_pending_greets();
+			m_handshake_governor.purge();
+			purge_presentation_states();
+			update_pending_gauges();
+
+			// The last flood of a rate limited log site must be reported even if nothing else is logged.
+			m_logger.flush_suppressed_entries();
+
+			do_contact();
+
+			m_contact_timer.expires_from_now(CONTACT_PERIOD);
+			m_contact_timer.async_wait(make_custom_alloc_handler(m_contact_timer_allocator, boost::bind(&core::do_periodic_contact, this, boost::asio::placeholders::error)));
+		}
+	}
+
+	void core::do_dynamic_contact()
+	{
+		// We don't ask for certificates we already have a session with.
+		std::set<cert_type, certificate_less> session_certificates;
+
+		BOOST_FOREACH(const endpoint_switch_port_map_type::value_type& entry, m_endpoint_switch_port_map)
+		{
+			session_certificates.insert(m_server->get_presentation(entry.first).signature_certificate());
+		}
+
+		dynamic_contact_state_map_type dynamic_contact_state_map;
+		cert_list_type cert_list;
+
+		BOOST_FOREACH(const cert_type& cert, m_configuration.fscp.dynamic_contact_list)
+		{
+			if (session_certificates.find(cert) != session_certificates.end())
+			{
+				continue;
+			}
+
+			dynamic_contact_state state;
+
+			const dynamic_contact_state_map_type::const_iterator it = m_dynamic_contact_state_map.find(cert);
+
+			if (it != m_dynamic_contact_state_map.end())
+			{
+				state = it->second;
+			}
+
+			if (state.skip > 0)
+			{
+				--state.skip;
+			}
+			else
+			{
+				cert_list.push_back(cert);
+
+				// Each unanswered request doubles the count of periods to wait before the next one.
+				state.skip = state.interval - 1;
+				state.interval = std::min(state.interval * 2, DYNAMIC_CONTACT_MAX_INTERVAL);
+
+				if (cert_list.size() >= DYNAMIC_CONTACT_BATCH_SIZE)
+				{
+					do_dynamic_contact(cert_list);
+					cert_list.clear();
+				}
+			}
+
+			dynamic_contact_state_map[cert] = state;
+		}
+
+		if (!cert_list.empty())
+		{
+			do_dynamic_contact(cert_list);
+		}
+
+		// Certificates that were removed from the list or that now have a session are forgotten.
+		m_dynamic_contact_state_map.swap(dynamic_contact_state_map);
+	}
+
+	void core::do_dynamic_contact(const cert_list_type& cert_list)
+	{
+		m_logger(LL_DEBUG) << "Sending contact request for " << cert_list.size() << " certificate(s)...";
+
+		m_server->async_send_contact_request_to_all(cert_list);
+	}
+
+	void core::do_periodic_dynamic_contact(const boost::system::error_code& ec)
+	{
+		if (ec != boost::asio::error::operation_aborted)
+		{
+			do_dynamic_contact();
+
+			m_dynamic_contact_timer.expires_from_now(DYNAMIC_CONTACT_PERIOD);
+			m_dynamic_contact_timer.async_wait(make_custom_alloc_handler(m_dynamic_contact_timer_allocator, boost::bind(&core::do_periodic_dynamic_contact, this, boost::asio::placeholders::error)));
+		}
+	}
+
+	void core::do_check_configuration(const boost::system::error_code& ec)
+	{
+		using namespace cryptoplus::pkey;
+		using namespace cryptoplus::x509;
+
+		if (ec != boost::asio::error::operation_aborted)
+		{
+			m_logger(LL_DEBUG) << "Checking certificate expiration...";
+
+			const certificate sig_cert = m_configuration.security.identity->signature_certificate();
+			const boost::posix_time::ptime not_after = sig_cert.not_after().to_ptime();
+			const boost::posix_time::time_duration time_left = not_after - boost::posix_time::second_clock::universal_time();
+
+			if (time_left <= CERTIFICATE_RENEWAL_DELAY)
+			{
+				m_logger(LL_INFORMATION) << "Certificate expires in " << time_left << ". Renewing...";
+
+				async_update_server_configuration(CI_SIGN);
+			}
+			else
+			{
+				m_logger(LL_DEBUG) << "Certificate doesn't expire yet. Checking again at " << boost::posix_time::to_simple_string(not_after - CERTIFICATE_RENEWAL_DELAY) << ".";
+
+				m_check_configuration_timer.expires_at(not_after - CERTIFICATE_RENEWAL_DELAY);
+				m_check_configuration_timer.async_wait(make_custom_alloc_handler(m_check_configuration_timer_allocator, boost::bind(&core::do_check_configuration, this, boost::asio::placeholders::error)));
+			}
+		}
+	}
+
+	void core::create_server()
+	{
+		assert(m_configuration.security.identity);
+
+		m_server.reset(new fscp::server(m_io_service, *m_configuration.security.identity));
+
+		m_server->set_hello_message_callback(boost::bind(&core::on_hello_request, this, _1, _2));
+		m_server->set_presentation_message_callback(boost::bind(&core::on_presentation, this, _1, _2, _3, _4));
+		m_server->set_session_request_message_callback(boost::bind(&core::on_session_request, this, _1, _2));
+		m_server->set_session_established_callback(boost::bind(&core::on_session_established, this, _1));
+		m_server->set_session_lost_callback(boost::bind(&core::on_session_lost, this, _1));
+		m_server->set_data_message_callback(boost::bind(&core::on_data, this, _1, _2, _3));
+		m_server->set_contact_request_message_callback(boost::bind(&core::on_contact_request, this, _1, _2, _3));
+		m_server->set_contact_message_callback(boost::bind(&core::on_contact, this, _1, _2, _3));
+		m_server->set_network_error_callback(boost::bind(&core::on_network_error, this, _1, _2));
+	}
+
+	void core::create_tap_adapter()
+	{
+		if (m_configuration.tap_adapter.enabled)
+		{
+			m_tap_adapter.reset(new asiotap::tap_adapter(m_io_service));
+
+			m_tap_adapter_switch_port = boost::make_shared<tap_adapter_switch_port>(boost::ref(*m_tap_adapter));
+			m_switch.register_port(m_tap_adapter_switch_port, TAP_ADAPTERS_GROUP);
+		}
+	}
+
+	void core::open_tap_adapter()
+	{
+		// Warning !
+		// This function may be called in another thread than the io_service thread.
+
+		m_tap_adapter->open();
+	}
+
+	void core::release_tap_adapter_switch_port()
+	{
+		// The port refers to the tap adapter: it must not outlive its opening.
+		if (m_tap_adapter_switch_port)
+		{
+			m_switch.unregister_port(m_tap_adapter_switch_port);
+			m_tap_adapter_switch_port.reset();
+		}
+	}
 
-			bool handled = false;
+	void core::on_proxy_data(boost::asio::const_buffer data)
+	{
+		if (m_tap_adapter)
+		{
+			m_tap_adapter->write(data);
+		}
+	}
 
-			if (m_arp_proxy || m_dhcp_proxy)
+	bool core::on_arp_request(const boost::asio::ip::address_v4& logical_address, ethernet_address_type& ethernet_address)
+	{
+		if (!m_configuration.tap_adapter.ipv4_address_prefix_length.is_null())
+		{
+			if (logical_address != m_configuration.tap_adapter.ipv4_address_prefix_length.address())
 			{
-				m_ethernet_filter.parse(data);
+				ethernet_address = m_configuration.tap_adapter.arp_proxy_fake_ethernet_address;
 
-				if (m_arp_proxy && m_arp_filter.get_last_helper())
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	const char* core::open_stage_name(open_stage stage)
+	{
+		switch (stage)
+		{
+			case OS_RESOLUTION:
+				return "listen endpoint resolution";
+			case OS_SERVER_CONFIGURATION:
+				return "server configuration";
+			case OS_CA_STORE:
+				return "CA store";
+			case OS_TAP_ADAPTER:
+				return "tap adapter";
+			case OS_SERVER:
+				return "FSCP server";
+			case OS_FINALIZATION:
+				return "finalization";
+			case OS_COUNT:
+				break;
+		}
+
+		assert(false);
+		throw std::logic_error("Unexpected value");
+	}
+
+	void core::resolve_listen_endpoint()
+	{
+		typedef boost::asio::ip::udp::resolver::query query;
+
+		m_listen_endpoint = boost::apply_visitor(endpoint_resolve_visitor(m_resolver, to_protocol(m_configuration.fscp.hostname_resolution_protocol), query::address_configured | query::passive, DEFAULT_SERVICE), m_configuration.fscp.listen_on);
+
+		m_logger(LL_DEBUG) << "Core opening on " << *m_listen_endpoint << "...";
+	}
+
+	void core::check_configuration()
+	{
+		if (m_configuration_update_callback)
+		{
+			m_configuration_update_callback(m_configuration);
+		}
+
+		if (!m_configuration.security.identity)
+		{
+			throw std::runtime_error("No user certificate or private key set. Unable to continue.");
+		}
+	}
+
+	core::ca_store_key core::make_ca_store_key(const security_configuration& security)
+	{
+		ca_store_key key;
+
+		key.certificate_authority_list = security.certificate_authority_list;
+		key.certificate_revocation_list_list = security.certificate_revocation_list_list;
+		key.certificate_revocation_validation_method = security.certificate_revocation_validation_method;
+
+		return key;
+	}
+
+	bool core::is_same_ca_store_key(const ca_store_key& lhs, const ca_store_key& rhs)
+	{
+		// The certificates and CRLs are compared by identity: comparing their content would cost as much as rebuilding the store.
+		if (lhs.certificate_revocation_validation_method != rhs.certificate_revocation_validation_method)
+		{
+			return false;
+		}
+
+		if ((lhs.certificate_authority_list.size() != rhs.certificate_authority_list.size()) || (lhs.certificate_revocation_list_list.size() != rhs.certificate_revocation_list_list.size()))
+		{
+			return false;
+		}
+
+		for (size_t i = 0; i < lhs.certificate_authority_list.size(); ++i)
+		{
+			if (lhs.certificate_authority_list[i].raw() != rhs.certificate_authority_list[i].raw())
+			{
+				return false;
+			}
+		}
+
+		for (size_t i = 0; i < lhs.certificate_revocation_list_list.size(); ++i)
+		{
+			if (lhs.certificate_revocation_list_list[i].raw() != rhs.certificate_revocation_list_list[i].raw())
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	cryptoplus::x509::store core::create_ca_store(const ca_store_key& key)
+	{
+		cryptoplus::x509::store ca_store = cryptoplus::x509::store::create();
+
+		BOOST_FOREACH(const cert_type& cert, key.certificate_authority_list)
+		{
+			ca_store.add_certificate(cert);
+		}
+
+		BOOST_FOREACH(const crl_type& crl, key.certificate_revocation_list_list)
+		{
+			ca_store.add_certificate_revocation_list(crl);
+		}
+
+		switch (key.certificate_revocation_validation_method)
+		{
+			case security_configuration::CRVM_LAST:
 				{
-					handled = true;
-					m_arp_filter.clear_last_helper();
+					ca_store.set_verification_flags(X509_V_FLAG_CRL_CHECK);
+					break;
+				}
+			case security_configuration::CRVM_ALL:
+				{
+					ca_store.set_verification_flags(X509_V_FLAG_CRL_CHECK | X509_V_FLAG_CRL_CHECK_ALL);
+					break;
+				}
+			case security_configuration::CRVM_NONE:
+				{
+					break;
 				}
+		}
 
-				if (m_dhcp_proxy && m_dhcp_filter.get_last_helper())
+		return ca_store;
+	}
+
+	bool core::refresh_ca_store()
+	{
+		boost::mutex::scoped_lock lock(m_ca_store_mutex);
+
+		if (m_ca_store && is_same_ca_store_key(m_ca_store_key, make_ca_store_key(m_configuration.security)))
+		{
+			m_logger(LL_DEBUG) << "Reusing the cached CA store.";
+
+			return true;
+		}
+
+		m_ca_store = cryptoplus::x509::store();
+		m_ca_store_key = ca_store_key();
+
+		return false;
+	}
+
+	cryptoplus::x509::store core::get_ca_store(freelan::logger& _logger)
+	{
+		// Warning !
+		// This function may be called in another thread than the io_service thread.
+
+		boost::mutex::scoped_lock lock(m_ca_store_mutex);
+
+		if (!m_ca_store)
+		{
+			m_ca_store_key = make_ca_store_key(m_configuration.security);
+
+			_logger(LL_DEBUG) << "Building the CA store from " << m_ca_store_key.certificate_authority_list.size() << " certificate(s) and " << m_ca_store_key.certificate_revocation_list_list.size() << " CRL(s)...";
+
+			m_ca_store = create_ca_store(m_ca_store_key);
+		}
+
+		return m_ca_store;
+	}
+
+	void core::install_ca_store(cryptoplus::x509::store ca_store, const ca_store_key& key)
+	{
+		boost::mutex::scoped_lock lock(m_ca_store_mutex);
+
+		m_ca_store = ca_store;
+		m_ca_store_key = key;
+
+		// Authority certificates received from the server meanwhile must be added as well.
+		const cert_list_type& ca_list = m_configuration.security.certificate_authority_list;
+
+		for (size_t i = m_ca_store_key.certificate_authority_list.size(); i < ca_list.size(); ++i)
+		{
+			m_ca_store.add_certificate(ca_list[i]);
+			m_ca_store_key.certificate_authority_list.push_back(ca_list[i]);
+		}
+	}
+
+	void core::start_contact_loop()
+	{
+		do_contact();
+		m_contact_timer.async_wait(make_custom_alloc_handler(m_contact_timer_allocator, boost::bind(&core::do_periodic_contact, this, boost::asio::placeholders::error)));
+		m_dynamic_contact_timer.async_wait(make_custom_alloc_handler(m_dynamic_contact_timer_allocator, boost::bind(&core::do_periodic_dynamic_contact, this, boost::asio::placeholders::error)));
+	}
+
+	void core::configure_tap_adapter()
+	{
+		// IPv4 address
+		if (!m_configuration.tap_adapter.ipv4_address_prefix_length.is_null())
+		{
+			try
+			{
+#ifdef WINDOWS
+				// Quick fix for Windows:
+				// Directly setting the IPv4 address/prefix length doesn't work like it should on Windows.
+				// We disable direct setting if DHCP is enabled.
+
+				if (!m_configuration.tap_adapter.dhcp_proxy_enabled)
 				{
-					handled = true;
-					m_dhcp_filter.clear_last_helper();
+					m_tap_adapter->add_ip_address_v4(
+					    m_configuration.tap_adapter.ipv4_address_prefix_length.address(),
+					    m_configuration.tap_adapter.ipv4_address_prefix_length.prefix_length()
+					);
 				}
+#else
+				m_tap_adapter->add_ip_address_v4(
+				    m_configuration.tap_adapter.ipv4_address_prefix_length.address(),
+				    m_configuration.tap_adapter.ipv4_address_prefix_length.prefix_length()
+				);
+#endif
+			}
+			catch (std::runtime_error& ex)
+			{
+				m_logger(LL_WARNING) << "Cannot set IPv4 address: " << ex.what();
+			}
+		}
+
+		// IPv6 address
+		if (!m_configuration.tap_adapter.ipv6_address_prefix_length.is_null())
+		{
+			try
+			{
+				m_tap_adapter->add_ip_address_v6(
+				    m_configuration.tap_adapter.ipv6_address_prefix_length.address(),
+				    m_configuration.tap_adapter.ipv6_address_prefix_length.prefix_length()
+				);
+			}
+			catch (std::runtime_error& ex)
+			{
+				m_logger(LL_WARNING) << "Cannot set IPv6 address: " << ex.what();
+			}
+		}
+
+		m_tap_adapter->set_connected_state(true);
+
+		m_tap_adapter->async_read(boost::asio::buffer(m_tap_adapter_buffer, m_tap_adapter_buffer.size()), make_custom_alloc_handler(m_tap_adapter_read_allocator, boost::bind(&core::tap_adapter_read_done, this, boost::ref(*m_tap_adapter), _1, _2)));
+
+		configure_proxies();
+
+		m_tap_adapter_configured = true;
+
+		if (m_configuration.tap_adapter.up_callback)
+		{
+			m_configuration.tap_adapter.up_callback(*this, *m_tap_adapter);
+		}
+	}
+
+	void core::configure_proxies()
+	{
+		// The ARP proxy
+		if (m_configuration.tap_adapter.arp_proxy_enabled)
+		{
+			m_arp_proxy.reset(new arp_proxy_type(boost::asio::buffer(m_proxy_buffer), boost::bind(&core::on_proxy_data, this, _1), m_arp_filter));
+			m_arp_proxy->set_arp_request_callback(boost::bind(&core::on_arp_request, this, _1, _2));
+		}
+		else
+		{
+			m_arp_proxy.reset();
+		}
+
+		// The DHCP proxy
+		if (m_configuration.tap_adapter.dhcp_proxy_enabled)
+		{
+			m_dhcp_proxy.reset(new dhcp_proxy_type(boost::asio::buffer(m_proxy_buffer), boost::bind(&core::on_proxy_data, this, _1), m_dhcp_filter));
+			m_dhcp_proxy->set_hardware_address(m_tap_adapter->ethernet_address());
+
+			if (!m_configuration.tap_adapter.dhcp_server_ipv4_address_prefix_length.is_null())
+			{
+				m_dhcp_proxy->set_software_address(m_configuration.tap_adapter.dhcp_server_ipv4_address_prefix_length.address());
+			}
+
+			if (!m_configuration.tap_adapter.ipv4_address_prefix_length.is_null())
+			{
+				m_dhcp_proxy->add_entry(
+				    m_tap_adapter->ethernet_address(),
+				    m_configuration.tap_adapter.ipv4_address_prefix_length.address(),
+				    m_configuration.tap_adapter.ipv4_address_prefix_length.prefix_length()
+				);
+			}
+		}
+		else
+		{
+			m_dhcp_proxy.reset();
+		}
+	}
+
+	void core::start_open_stage(boost::shared_ptr<open_context> context, open_stage stage, boost::function<void ()> func, bool threaded, bool self_completing)
+	{
+		context->stage_start[stage] = boost::posix_time::microsec_clock::universal_time();
+		context->started |= (1 << stage);
+
+		m_logger(LL_DEBUG) << "Starting " << open_stage_name(stage) << " stage...";
+
+		if (threaded)
+		{
+			boost::thread thread(boost::bind(&core::run_open_stage, this, context, stage, func, self_completing));
+
+			thread.detach();
+		}
+		else
+		{
+			m_io_service.post(boost::bind(&core::run_open_stage, this, context, stage, func, self_completing));
+		}
+	}
+
+	void core::skip_open_stage(boost::shared_ptr<open_context> context, open_stage stage)
+	{
+		context->started |= (1 << stage);
+		context->completed |= (1 << stage);
+	}
+
+	void core::run_open_stage(boost::shared_ptr<open_context> context, open_stage stage, boost::function<void ()> func, bool self_completing)
+	{
+		// Warning !
+		// This function may be called in another thread than the io_service thread.
+
+		boost::exception_ptr error;
+
+		try
+		{
+			func();
+		}
+		catch (...)
+		{
+			error = boost::current_exception();
+		}
+
+		// A self-completing stage reports its own completion, unless it failed to start.
+		if (error || !self_completing)
+		{
+			m_io_service.post(boost::bind(&core::on_open_stage_done, this, context, stage, error));
+		}
+	}
+
+	void core::on_open_stage_done(boost::shared_ptr<open_context> context, open_stage stage, boost::exception_ptr error)
+	{
+		context->timings.stages[stage] = boost::posix_time::microsec_clock::universal_time() - context->stage_start[stage];
+		context->completed |= (1 << stage);
+
+		if (error)
+		{
+			m_logger(LL_ERROR) << "The " << open_stage_name(stage) << " stage failed.";
+
+			if (!context->error)
+			{
+				context->error = error;
+			}
+		}
+		else
+		{
+			m_logger(LL_DEBUG) << "The " << open_stage_name(stage) << " stage completed in " << context->timings.stages[stage] << ".";
+
+			switch (stage)
+			{
+				case OS_CA_STORE:
+					{
+						install_ca_store(context->ca_store, context->ca_key);
+
+						break;
+					}
+				case OS_TAP_ADAPTER:
+					{
+						context->tap_adapter_opened = true;
+						break;
+					}
+				default:
+					{
+						break;
+					}
 			}
+		}
 
-			if (!handled)
+		advance_open(context);
+	}
+
+	void core::advance_open(boost::shared_ptr<open_context> context)
+	{
+		const unsigned int all_stages = (1 << OS_COUNT) - 1;
+		const unsigned int running = context->started & ~context->completed;
+
+		if (context->error)
+		{
+			// We wait for the running stages before reporting the failure.
+			if (running == 0)
 			{
-				m_switch.receive_data(m_tap_adapter_switch_port, data);
+				abort_open(context);
 			}
 
-			// Start another read
-			_tap_adapter.async_read(boost::asio::buffer(m_tap_adapter_buffer, m_tap_adapter_buffer.size()), boost::bind(&core::tap_adapter_read_done, this, boost::ref(_tap_adapter), _1, _2));
+			return;
 		}
-		else
+
+		const bool resolved = (context->completed & (1 << OS_RESOLUTION)) != 0;
+		const bool configured = (context->completed & (1 << OS_SERVER_CONFIGURATION)) != 0;
+
+		if (resolved && !(context->started & (1 << OS_SERVER_CONFIGURATION)))
 		{
-			// If the core is currently stopping, this kind of error is expected.
-			if (m_running)
+			// The server configuration needs the listen endpoint to publish our endpoints.
+			if (m_configuration.server.enabled)
 			{
-				m_logger(LL_ERROR) << "Read failed on " << _tap_adapter.name() << ". Error: " << ec;
+				m_logger(LL_INFORMATION) << "Server mode enabled.";
 
-				close();
+				start_open_stage(context, OS_SERVER_CONFIGURATION, boost::bind(&core::update_server_configuration, this, static_cast<int>(CI_ALL), true), true);
 			}
+			else
+			{
+				skip_open_stage(context, OS_SERVER_CONFIGURATION);
+			}
+
+			advance_open(context);
+
+			return;
 		}
-	}
 
-	void core::do_greet(const ep_type& ep)
-	{
-		if (!m_server->has_session(ep))
+		if (configured && !(context->started & (1 << OS_SERVER)))
 		{
-			m_logger(LL_DEBUG) << "Sending HELLO_REQUEST to " << ep << "...";
+			// The server configuration might have changed our identity.
+			start_open_stage(context, OS_SERVER, boost::bind(&core::open_server, this), false);
 
-			async_greet(ep);
+			return;
 		}
-	}
 
-	void core::do_greet(const boost::system::error_code& ec, boost::asio::ip::udp::resolver::iterator it, const freelan::fscp_configuration::endpoint& ep)
-	{
-		if (!ec)
+		if ((context->completed == (all_stages & ~(1 << OS_FINALIZATION))) && !(context->started & (1 << OS_FINALIZATION)))
 		{
-			do_greet(*it);
+			start_open_stage(context, OS_FINALIZATION, boost::bind(&core::finalize_open, this), false);
+
+			return;
 		}
-		else
+
+		if (context->completed == all_stages)
 		{
-			m_logger(LL_WARNING) << "Failed to resolve " << ep << ": " << ec;
+			context->timings.total = boost::posix_time::microsec_clock::universal_time() - context->start_time;
+
+			m_logger(LL_DEBUG) << "Core opened in " << context->timings.total << ".";
+
+			if (context->handler)
+			{
+				context->handler(boost::exception_ptr(), context->timings);
+			}
 		}
 	}
 
-	void core::do_contact()
+	void core::abort_open(boost::shared_ptr<open_context> context)
 	{
-		std::for_each(m_configuration.fscp.contact_list.begin(), m_configuration.fscp.contact_list.end(), boost::bind(&core::do_contact, this, _1));
+		m_logger(LL_DEBUG) << "Core opening aborted.";
+
+		m_contact_timer.cancel();
+		m_dynamic_contact_timer.cancel();
+		m_path_probe_timer.cancel();
+		m_check_configuration_timer.cancel();
+
+		stop_validation_threads();
+
+		m_pending_greet_map.clear();
+		m_handshake_governor.clear();
+		m_presentation_state_map.clear();
+		update_pending_gauges();
+
+		if (m_server)
+		{
+			m_server->close();
+		}
+
+		m_dhcp_proxy.reset();
+		m_arp_proxy.reset();
+		m_tap_adapter_configured = false;
+
+		if (m_tap_adapter && context->tap_adapter_opened)
+		{
+			m_tap_adapter->close();
+		}
+
+		release_tap_adapter_switch_port();
+
+		m_listen_endpoint = boost::none;
+
+		context->timings.total = boost::posix_time::microsec_clock::universal_time() - context->start_time;
+
+		if (context->handler)
+		{
+			context->handler(context->error, context->timings);
+		}
 	}
 
-	void core::do_contact(const fscp_configuration::endpoint& ep)
+	void core::async_resolve_listen_endpoint(boost::shared_ptr<open_context> context)
 	{
 		typedef boost::asio::ip::udp::resolver::query query;
 
@@ -618,157 +1910,110 @@ namespace freelan
 		    endpoint_async_resolve_visitor(
 		        m_resolver,
 		        to_protocol(m_configuration.fscp.hostname_resolution_protocol),
-		        query::address_configured,
+		        query::address_configured | query::passive,
 		        DEFAULT_SERVICE,
-		        boost::bind(&core::do_greet, this, _1, _2, ep)
+		        boost::bind(&core::on_listen_endpoint_resolved, this, context, _1, _2)
 		    ),
-		    ep
+		    m_configuration.fscp.listen_on
 		);
 	}
 
-	void core::do_periodic_contact(const boost::system::error_code& ec)
+	void core::on_listen_endpoint_resolved(boost::shared_ptr<open_context> context, const boost::system::error_code& ec, boost::asio::ip::udp::resolver::iterator it)
 	{
-		if (ec != boost::asio::error::operation_aborted)
-		{
-			do_contact();
+		boost::exception_ptr error;
 
-			m_contact_timer.expires_from_now(CONTACT_PERIOD);
-			m_contact_timer.async_wait(boost::bind(&core::do_periodic_contact, this, boost::asio::placeholders::error));
+		if (ec)
+		{
+			error = boost::copy_exception(boost::system::system_error(ec));
 		}
-	}
+		else
+		{
+			m_listen_endpoint = *it;
 
-	void core::do_dynamic_contact()
-	{
-		std::for_each(m_configuration.fscp.dynamic_contact_list.begin(), m_configuration.fscp.dynamic_contact_list.end(), boost::bind(&core::do_dynamic_contact, this, _1));
-	}
+			m_logger(LL_DEBUG) << "Core opening on " << *m_listen_endpoint << "...";
+		}
 
-	void core::do_dynamic_contact(cert_type cert)
-	{
-		m_server->async_send_contact_request_to_all(cert);
+		on_open_stage_done(context, OS_RESOLUTION, error);
 	}
 
-	void core::do_periodic_dynamic_contact(const boost::system::error_code& ec)
+	void core::build_open_ca_store(boost::shared_ptr<open_context> context)
 	{
-		if (ec != boost::asio::error::operation_aborted)
-		{
-			do_dynamic_contact();
-
-			m_dynamic_contact_timer.expires_from_now(DYNAMIC_CONTACT_PERIOD);
-			m_dynamic_contact_timer.async_wait(boost::bind(&core::do_periodic_dynamic_contact, this, boost::asio::placeholders::error));
-		}
+		context->ca_store = create_ca_store(context->ca_key);
 	}
 
-	void core::do_check_configuration(const boost::system::error_code& ec)
+	void core::open_server()
 	{
-		using namespace cryptoplus::pkey;
-		using namespace cryptoplus::x509;
-
-		if (ec != boost::asio::error::operation_aborted)
-		{
-			m_logger(LL_DEBUG) << "Checking certificate expiration...";
+		check_configuration();
 
-			const certificate sig_cert = m_configuration.security.identity->signature_certificate();
-			const boost::posix_time::ptime not_after = sig_cert.not_after().to_ptime();
-			const boost::posix_time::time_duration time_left = not_after - boost::posix_time::second_clock::universal_time();
+		m_never_contact_list = ip_network_address_list(m_configuration.fscp.never_contact_list.begin(), m_configuration.fscp.never_contact_list.end());
 
-			if (time_left <= CERTIFICATE_RENEWAL_DELAY)
-			{
-				m_logger(LL_INFORMATION) << "Certificate expires in " << time_left << ". Renewing...";
+		create_server();
 
-				async_update_server_configuration(CI_SIGN);
-			}
-			else
-			{
-				m_logger(LL_DEBUG) << "Certificate doesn't expire yet. Checking again at " << boost::posix_time::to_simple_string(not_after - CERTIFICATE_RENEWAL_DELAY) << ".";
+		start_validation_threads();
 
-				m_check_configuration_timer.expires_at(not_after - CERTIFICATE_RENEWAL_DELAY);
-				m_check_configuration_timer.async_wait(boost::bind(&core::do_check_configuration, this, boost::asio::placeholders::error));
-			}
-		}
+		m_server->open(*m_listen_endpoint);
 	}
 
-	void core::create_server()
+	void core::finalize_open()
 	{
-		assert(m_configuration.security.identity);
-
-		m_server.reset(new fscp::server(m_io_service, *m_configuration.security.identity));
-
-		m_server->set_hello_message_callback(boost::bind(&core::on_hello_request, this, _1, _2));
-		m_server->set_presentation_message_callback(boost::bind(&core::on_presentation, this, _1, _2, _3, _4));
-		m_server->set_session_request_message_callback(boost::bind(&core::on_session_request, this, _1, _2));
-		m_server->set_session_established_callback(boost::bind(&core::on_session_established, this, _1));
-		m_server->set_session_lost_callback(boost::bind(&core::on_session_lost, this, _1));
-		m_server->set_data_message_callback(boost::bind(&core::on_data, this, _1, _2, _3));
-		m_server->set_contact_request_message_callback(boost::bind(&core::on_contact_request, this, _1, _2, _3));
-		m_server->set_contact_message_callback(boost::bind(&core::on_contact, this, _1, _2, _3));
-		m_server->set_network_error_callback(boost::bind(&core::on_network_error, this, _1, _2));
-	}
+		start_contact_loop();
+		start_path_probing();
 
-	void core::create_tap_adapter()
-	{
-		if (m_configuration.tap_adapter.enabled)
+		if (m_tap_adapter)
 		{
-			m_tap_adapter.reset(new asiotap::tap_adapter(m_io_service));
-
-			m_tap_adapter_switch_port = boost::make_shared<tap_adapter_switch_port>(boost::ref(*m_tap_adapter));
-			m_switch.register_port(m_tap_adapter_switch_port, TAP_ADAPTERS_GROUP);
+			configure_tap_adapter();
 		}
-	}
 
-	void core::on_proxy_data(boost::asio::const_buffer data)
-	{
-		if (m_tap_adapter)
+		if (m_open_callback)
 		{
-			m_tap_adapter->write(data);
+			m_io_service.post(m_open_callback);
 		}
+
+		m_running = true;
 	}
 
-	bool core::on_arp_request(const boost::asio::ip::address_v4& logical_address, ethernet_address_type& ethernet_address)
+	bool core::certificate_less::operator()(const cert_type& lhs, const cert_type& rhs) const
 	{
-		if (!m_configuration.tap_adapter.ipv4_address_prefix_length.is_null())
-		{
-			if (logical_address != m_configuration.tap_adapter.ipv4_address_prefix_length.address())
-			{
-				ethernet_address = m_configuration.tap_adapter.arp_proxy_fake_ethernet_address;
-
-				return true;
-			}
-		}
-
-		return false;
+		return (X509_cmp(lhs.raw(), rhs.raw()) < 0);
 	}
 
 	int core::certificate_validation_callback(int ok, X509_STORE_CTX* ctx)
 	{
 		cryptoplus::x509::store_context store_context(ctx);
 
-		core* _this = static_cast<core*>(store_context.get_external_data(core::ex_data_index));
+		validation_context* context = static_cast<validation_context*>(store_context.get_external_data(core::ex_data_index));
 
-		return (_this->certificate_validation_method(ok != 0, store_context)) ? 1 : 0;
+		return (context->instance->certificate_validation_method(ok != 0, store_context, *context->logger)) ? 1 : 0;
 	}
 
-	bool core::certificate_validation_method(bool ok, cryptoplus::x509::store_context store_context)
+	bool core::certificate_validation_method(bool ok, cryptoplus::x509::store_context store_context, freelan::logger& _logger)
 	{
-		(void)store_context;
-
 		cert_type cert = store_context.get_current_certificate();
 
-		if (m_logger.level() <= LL_DEBUG)
-		{
-			m_logger(LL_DEBUG) << "Validating " << cert.subject().oneline() << ": " << (ok ? "OK" : "Error");
-		}
+		FREELAN_LOG(_logger, LL_DEBUG, "Validating " << cert.subject().oneline() << ": " << (ok ? "OK" : "Error"));
 
 		if (!ok)
 		{
-			m_logger(LL_WARNING) << "Error when validating " << cert.subject().oneline() << ": " << store_context.get_error_string() << " (depth: " << store_context.get_error_depth() << ")";
+			_logger(LL_WARNING) << "Error when validating " << cert.subject().oneline() << ": " << store_context.get_error_string() << " (depth: " << store_context.get_error_depth() << ")";
 		}
 
 		return ok;
 	}
 
-	bool core::certificate_is_valid(cert_type cert)
+	bool core::certificate_is_valid(cert_type cert, freelan::logger& _logger)
 	{
-		switch (m_configuration.security.certificate_validation_method)
+		security_configuration::certificate_validation_method_type certificate_validation_method;
+		security_configuration::certificate_validation_callback_type certificate_validation_callback;
+
+		{
+			// This function may run in a validation thread while a new configuration is applied.
+			boost::mutex::scoped_lock lock(m_ca_store_mutex);
+
+			certificate_validation_method = m_configuration.security.certificate_validation_method;
+			certificate_validation_callback = m_configuration.security.certificate_validation_callback;
+		}
+
+		switch (certificate_validation_method)
 		{
 			case security_configuration::CVM_DEFAULT:
 				{
@@ -777,13 +2022,14 @@ namespace freelan
 					// Create a store context to proceed to verification
 					x509::store_context store_context = x509::store_context::create();
 
-					store_context.initialize(m_ca_store, cert, NULL);
+					store_context.initialize(get_ca_store(_logger), cert, NULL);
 
 					// Ensure to set the verification callback *AFTER* you called initialize or it will be ignored.
 					store_context.set_verification_callback(&core::certificate_validation_callback);
 
-					// Add a reference to the current instance into the store context.
-					store_context.set_external_data(core::ex_data_index, this);
+					// Add a reference to the current instance and logger into the store context.
+					validation_context context = { this, &_logger };
+					store_context.set_external_data(core::ex_data_index, &context);
 
 					if (!store_context.verify())
 					{
@@ -798,14 +2044,106 @@ namespace freelan
 				}
 		}
 
-		if (m_configuration.security.certificate_validation_callback)
+		if (certificate_validation_callback)
 		{
-			return m_configuration.security.certificate_validation_callback(*this, cert);
+			return certificate_validation_callback(*this, cert);
 		}
 
 		return true;
 	}
 
+	void core::start_validation_threads()
+	{
+		const unsigned int count = m_configuration.security.certificate_validation_threads;
+
+		if (count > 0)
+		{
+			m_validation_io_service.reset();
+			m_validation_work.reset(new boost::asio::io_service::work(m_validation_io_service));
+
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				m_validation_threads.create_thread(boost::bind(&boost::asio::io_service::run, &m_validation_io_service));
+			}
+
+			m_logger(LL_DEBUG) << "Started " << count << " certificate validation thread(s).";
+		}
+	}
+
+	void core::stop_validation_threads()
+	{
+		if (m_validation_work)
+		{
+			// Pending validations are still processed: their results are discarded once the core is closed.
+			m_validation_work.reset();
+			m_validation_threads.join_all();
+		}
+	}
+
+	bool core::presentation_is_valid(const ep_type& sender, cert_type sig_cert, cert_type enc_cert, freelan::logger& _logger)
+	{
+		FREELAN_PROBE2(presentation_validation_start, sender.data(), sender.size());
+
+		const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+		const bool valid = certificate_is_valid(sig_cert, _logger) && certificate_is_valid(enc_cert, _logger);
+
+		m_presentation_validation_duration_histogram.record(boost::posix_time::microsec_clock::universal_time() - start);
+
+		FREELAN_PROBE3(presentation_validation_end, sender.data(), sender.size(), valid ? 1 : 0);
+
+		return valid;
+	}
+
+	void core::do_validate_presentation(const ep_type& sender, cert_type sig_cert, cert_type enc_cert, unsigned int generation)
+	{
+		// Warning !
+		// This function is called in a validation thread: logging must go through the io_service.
+
+		freelan::logger delayed_logger(boost::bind(&core::log, this, _1, _2), m_logger.level());
+
+		const bool valid = presentation_is_valid(sender, sig_cert, enc_cert, delayed_logger);
+
+		m_io_service.post(boost::bind(&core::on_presentation_validated, this, sender, generation, valid));
+	}
+
+	void core::on_presentation_validated(const ep_type& sender, unsigned int generation, bool valid)
+	{
+		// The server accepts presentations before an asynchronous opening is
+		// finalized: the results are matched against the pending presentations,
+		// which closing clears, rather than against the running flag.
+		const presentation_state_map_type::iterator it = m_presentation_state_map.find(sender);
+
+		if ((it == m_presentation_state_map.end()) || (it->second.generation != generation))
+		{
+			// Another presentation superseded this one, or the handshake was abandoned.
+			return;
+		}
+
+		if (valid)
+		{
+			it->second.valid = true;
+
+			m_server->async_request_session(sender);
+		}
+		else
+		{
+			m_logger(LL_WARNING) << "The presentation of " << sender << " was rejected.";
+
+			if (m_binary_logger)
+			{
+				(*m_binary_logger)(m_binary_log_formats.presentation_rejected) << sender;
+			}
+
+			m_handshake_governor.end_handshake(sender);
+			m_handshake_governor.report_validation_failure(sender.address(), it->second.fingerprint);
+
+			m_presentation_state_map.erase(it);
+
+			update_pending_gauges();
+		}
+	}
+
 	void core::async_update_server_configuration(int items)
 	{
 		boost::thread thread(boost::bind(&core::update_server_configuration, this, items, true));
@@ -827,21 +2165,14 @@ namespace freelan
 
 		client _client(m_configuration, delayed ? delayed_logger : m_logger);
 
+		_client.set_metrics(m_metrics);
+
 		_client.authenticate();
 
-		if (CI_GET_AUTHORITY_CERTIFICATE & items)
-		{
-			certificate ca_cert = _client.get_authority_certificate();
+		// The remaining calls are independent: we issue them concurrently.
+		client::batch_request request;
 
-			if (delayed)
-			{
-				m_io_service.post(boost::bind(&core::set_ca_certificate, this, ca_cert));
-			}
-			else
-			{
-				set_ca_certificate(ca_cert);
-			}
-		}
+		request.get_authority_certificate = (CI_GET_AUTHORITY_CERTIFICATE & items) != 0;
 
 		if (CI_JOIN_NETWORK & items)
 		{
@@ -856,46 +2187,91 @@ namespace freelan
 					boost::bind(get_default_port_endpoint, _1, default_port)
 					);
 
-			const network_info ninfo = _client.join_network(m_configuration.server.network, public_endpoint_list);
+			request.network = m_configuration.server.network;
+			request.endpoints = public_endpoint_list;
+		}
+
+		boost::optional<pkey> rsa_key;
+
+		if (CI_SIGN & items)
+		{
+			rsa_key = pkey::from_rsa_key(cryptoplus::pkey::rsa_key::generate_private_key(2048, 17, NULL, NULL, false));
+
+			request.certificate_request = generate_certificate_request(m_configuration, rsa_key->get_rsa_key());
+		}
+
+		const client::batch_response response = _client.perform_batch(request);
 
+		if (response.authority_certificate)
+		{
 			if (delayed)
 			{
-				m_io_service.post(boost::bind(&core::set_network_information, this, ninfo));
+				m_io_service.post(boost::bind(&core::set_ca_certificate, this, *response.authority_certificate));
 			}
 			else
 			{
-				set_network_information(ninfo);
+				set_ca_certificate(*response.authority_certificate);
 			}
 		}
 
-		if (CI_SIGN & items)
+		if (response.ninfo)
 		{
-			pkey rsa_key = pkey::from_rsa_key(cryptoplus::pkey::rsa_key::generate_private_key(2048, 17, NULL, NULL, false));
-
-			certificate_request csr = generate_certificate_request(m_configuration, rsa_key.get_rsa_key());
-
-			certificate cert = _client.renew_certificate(csr);
+			if (delayed)
+			{
+				m_io_service.post(boost::bind(&core::set_network_information, this, *response.ninfo));
+			}
+			else
+			{
+				set_network_information(*response.ninfo);
+			}
+		}
 
+		if (response.certificate)
+		{
 			if (delayed)
 			{
-				m_io_service.post(boost::bind(&core::set_identity, this, fscp::identity_store(cert, rsa_key)));
+				m_io_service.post(boost::bind(&core::set_identity, this, fscp::identity_store(*response.certificate, *rsa_key)));
 			}
 			else
 			{
-				set_identity(fscp::identity_store(cert, rsa_key));
+				set_identity(fscp::identity_store(*response.certificate, *rsa_key));
+			}
+		}
+
+		// The successful calls are applied first: only then is a failure reported.
+		const boost::exception_ptr errors[] = { response.authority_certificate_error, response.ninfo_error, response.certificate_error };
+
+		BOOST_FOREACH(const boost::exception_ptr& error, errors)
+		{
+			if (error)
+			{
+				boost::rethrow_exception(error);
 			}
 		}
 	}
 
 	void core::set_ca_certificate(cert_type ca_cert)
 	{
+		boost::mutex::scoped_lock lock(m_ca_store_mutex);
+
+		cert_list_type& certificate_authority_list = m_configuration.security.certificate_authority_list;
+
+		// Every opening in server mode gets the authority certificate again: adding it twice would change the CA store key and force a rebuild.
+		if (std::find(certificate_authority_list.begin(), certificate_authority_list.end(), ca_cert) != certificate_authority_list.end())
+		{
+			m_logger(LL_DEBUG) << "The authority certificate is already in the trusted certificate list.";
+
+			return;
+		}
+
 		m_logger(LL_INFORMATION) << "Adding authority certificate to the trusted certificate list.";
 
-		m_configuration.security.certificate_authority_list.push_back(ca_cert);
+		certificate_authority_list.push_back(ca_cert);
 
 		if (m_ca_store)
 		{
 			m_ca_store.add_certificate(ca_cert);
+			m_ca_store_key.certificate_authority_list.push_back(ca_cert);
 		}
 	}
 
@@ -951,7 +2327,7 @@ namespace freelan
 		const boost::posix_time::ptime renewal_date = not_after - CERTIFICATE_RENEWAL_DELAY;
 
 		m_check_configuration_timer.expires_at(renewal_date);
-		m_check_configuration_timer.async_wait(boost::bind(&core::do_check_configuration, this, boost::asio::placeholders::error));
+		m_check_configuration_timer.async_wait(make_custom_alloc_handler(m_check_configuration_timer_allocator, boost::bind(&core::do_check_configuration, this, boost::asio::placeholders::error)));
 
 		m_logger(LL_INFORMATION) << "Checking again configuration on " << boost::posix_time::to_simple_string(renewal_date) << ".";
 	}
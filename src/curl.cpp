@@ -60,6 +60,14 @@ namespace freelan
 			}
 		}
 
+		void throw_if_curlsh_error(CURLSHcode errorcode)
+		{
+			if (errorcode != CURLSHE_OK)
+			{
+				throw std::runtime_error(curl_share_strerror(errorcode));
+			}
+		}
+
 		void throw_if_curlm_error(CURLMcode errorcode)
 		{
 			if (errorcode != CURLM_OK)
@@ -104,6 +112,25 @@ namespace freelan
 		return m_slist;
 	}
 
+	curl_share::curl_share() :
+		m_curlsh(curl_share_init())
+	{
+		if (!m_curlsh)
+		{
+			throw std::runtime_error("Unable to allocate a CURLSH structure");
+		}
+	}
+
+	curl_share::~curl_share()
+	{
+		curl_share_cleanup(m_curlsh);
+	}
+
+	void curl_share::share(curl_lock_data data)
+	{
+		throw_if_curlsh_error(curl_share_setopt(m_curlsh, CURLSHOPT_SHARE, data));
+	}
+
 	curl::curl() :
 		m_curl(curl_easy_init()),
 		m_debug_function()
@@ -220,6 +247,28 @@ namespace freelan
 		set_option(CURLOPT_CONNECTTIMEOUT_MS, timeout.total_milliseconds());
 	}
 
+	void curl::set_share(const curl_share& share)
+	{
+		set_option(CURLOPT_SHARE, static_cast<void*>(share.m_curlsh));
+	}
+
+	bool curl::enable_http2()
+	{
+#if LIBCURL_VERSION_NUM >= 0x072f00
+		const curl_version_info_data* const info = curl_version_info(CURLVERSION_NOW);
+
+		if (info->features & CURL_VERSION_HTTP2)
+		{
+			set_option(CURLOPT_HTTP_VERSION, static_cast<long int>(CURL_HTTP_VERSION_2TLS));
+			set_option(CURLOPT_PIPEWAIT, 1L);
+
+			return true;
+		}
+#endif
+
+		return false;
+	}
+
 	void curl::set_http_header(const std::string& header, const std::string& value)
 	{
 		m_http_headers.append(header + ": " + value);
@@ -386,4 +435,60 @@ namespace freelan
 	{
 		throw_if_curlm_error(curl_multi_remove_handle(m_curlm, handle.m_curl));
 	}
+
+	bool curl_multi::enable_multiplexing()
+	{
+#ifdef CURLPIPE_MULTIPLEX
+		// The headers may be more recent than the library, which may also lack HTTP/2.
+		const curl_version_info_data* const version_info = curl_version_info(CURLVERSION_NOW);
+
+		if (!version_info || !(version_info->features & CURL_VERSION_HTTP2))
+		{
+			return false;
+		}
+
+		throw_if_curlm_error(curl_multi_setopt(m_curlm, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX));
+
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	void curl_multi::perform()
+	{
+		int running_handles = 0;
+
+		throw_if_curlm_error(curl_multi_perform(m_curlm, &running_handles));
+
+		while (running_handles > 0)
+		{
+			int numfds = 0;
+
+			throw_if_curlm_error(curl_multi_wait(m_curlm, NULL, 0, 1000, &numfds));
+			throw_if_curlm_error(curl_multi_perform(m_curlm, &running_handles));
+		}
+
+		int msgs_in_queue = 0;
+
+		while (CURLMsg* msg = curl_multi_info_read(m_curlm, &msgs_in_queue))
+		{
+			if (msg->msg == CURLMSG_DONE)
+			{
+				m_results[msg->easy_handle] = msg->data.result;
+			}
+		}
+	}
+
+	CURLcode curl_multi::get_result(const curl& handle) const
+	{
+		const std::map<const CURL*, CURLcode>::const_iterator it = m_results.find(handle.m_curl);
+
+		if (it == m_results.end())
+		{
+			throw std::runtime_error("No result available for the specified handle");
+		}
+
+		return it->second;
+	}
 }
@@ -53,6 +53,8 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/filesystem.hpp>
 
+#include <map>
+
 #include "endpoint.hpp"
 
 namespace freelan
@@ -101,6 +103,46 @@ namespace freelan
 			friend class curl;
 	};
 
+	/**
+	 * \brief A CURLSH wrapper class.
+	 *
+	 * The share interface is used without lock functions: all the handles that
+	 * use a given share must live in the same thread.
+	 */
+	class curl_share
+	{
+		public:
+
+			/**
+			 * \brief Create a CURLSH.
+			 */
+			curl_share();
+
+			/**
+			 * \brief Destroy a CURLSH.
+			 *
+			 * All the handles that use the share must have been destroyed first.
+			 */
+			~curl_share();
+
+			/**
+			 * \brief Share the specified data.
+			 * \param data The data to share.
+			 *
+			 * On error, a std::runtime_error is raised.
+			 */
+			void share(curl_lock_data data);
+
+		private:
+
+			curl_share(const curl_share&);
+			curl_share& operator=(const curl_share&);
+
+			CURLSH* m_curlsh;
+
+			friend class curl;
+	};
+
 	/**
 	 * \brief A CURL wrapper class.
 	 */
@@ -227,6 +269,21 @@ namespace freelan
 			 */
 			void set_connect_timeout(const boost::posix_time::time_duration& timeout);
 
+			/**
+			 * \brief Set the share to use.
+			 * \param share The share. Must remain valid until the curl instance gets destroyed.
+			 */
+			void set_share(const curl_share& share);
+
+			/**
+			 * \brief Enable HTTP/2 negotiation over TLS, if available.
+			 * \return true if HTTP/2 is supported by libcurl, false otherwise.
+			 *
+			 * Once enabled, concurrent requests wait for an existing connection to
+			 * be multiplexed over rather than opening new connections.
+			 */
+			bool enable_http2();
+
 			/**
 			 * \brief Set a HTTP header.
 			 * \param header The header.
@@ -379,12 +436,36 @@ namespace freelan
 			 */
 			void remove_handle(const curl& handle);
 
+			/**
+			 * \brief Enable the multiplexing of transfers, if available.
+			 * \return true if the running libcurl supports HTTP/2 multiplexing, false otherwise.
+			 */
+			bool enable_multiplexing();
+
+			/**
+			 * \brief Perform all the added requests concurrently.
+			 *
+			 * The call blocks until all the transfers completed. The result of each
+			 * transfer can then be retrieved with get_result().
+			 *
+			 * On error, a std::runtime_error is raised.
+			 */
+			void perform();
+
+			/**
+			 * \brief Get the result of a transfer.
+			 * \param handle The handle. Must have been performed with perform() first.
+			 * \return The result of the transfer.
+			 */
+			CURLcode get_result(const curl& handle) const;
+
 		private:
 
 			curl_multi(const curl_multi&);
 			curl_multi& operator=(const curl_multi&);
 
 			CURLM* m_curlm;
+			std::map<const CURL*, CURLcode> m_results;
 	};
 }
 
@@ -45,47 +45,90 @@
 
 #include "endpoint.hpp"
 
+#include <cctype>
+
+#include "parse_operations.hpp"
+#include "stream_operations.hpp"
+
 namespace freelan
 {
-	std::istream& operator>>(std::istream& is, endpoint& value)
+	namespace
 	{
-		if (is)
+		bool is_ipv6_address_character(char c)
 		{
-			ipv6_endpoint ep;
+			return (std::isxdigit(static_cast<unsigned char>(c)) || (c == ':'));
+		}
 
-			if (is >> ep)
+		// Only an IPv6 address can contain a colon before any other non-hexadecimal character.
+		bool may_be_ipv6_address(const char* begin, const char* end)
+		{
+			for (; (begin != end) && is_ipv6_address_character(*begin); ++begin)
 			{
-				value = ep;
-				return is;
+				if (*begin == ':')
+				{
+					return true;
+				}
 			}
 
-			is.clear();
+			return false;
 		}
 
-		if (is)
+		template <typename EndpointType>
+		const char* parse_as(const char* begin, const char* end, endpoint& value, boost::system::error_code& ec)
 		{
-			ipv4_endpoint ep;
+			EndpointType ep;
+
+			const char* const it = parse(begin, end, ep, ec);
 
-			if (is >> ep)
+			if (!ec)
 			{
 				value = ep;
-				return is;
 			}
 
-			is.clear();
+			return it;
 		}
+	}
 
-		if (is)
+	std::istream& operator>>(std::istream& is, endpoint& value)
+	{
+		return read_parsed(is, value);
+	}
+
+	const char* parse(const char* begin, const char* end, endpoint& value, boost::system::error_code& ec)
+	{
+		if (begin == end)
 		{
-			hostname_endpoint ep;
+			ec = make_parse_error();
 
-			if (is >> ep)
+			return begin;
+		}
+
+		// Neither an IPv4 address nor a hostname can start with a bracket.
+		if (*begin == '[')
+		{
+			return parse_as<ipv6_endpoint>(begin, end, value, ec);
+		}
+
+		if (may_be_ipv6_address(begin, end))
+		{
+			const char* const it = parse_as<ipv6_endpoint>(begin, end, value, ec);
+
+			if (!ec)
 			{
-				value = ep;
-				return is;
+				return it;
+			}
+		}
+
+		if (std::isdigit(static_cast<unsigned char>(*begin)))
+		{
+			const char* const it = parse_as<ipv4_endpoint>(begin, end, value, ec);
+
+			if (!ec)
+			{
+				return it;
 			}
 		}
 
-		return is;
+		return parse_as<hostname_endpoint>(begin, end, value, ec);
 	}
 }
@@ -0,0 +1,120 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file frame_tracer.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A frame tracer class.
+ */
+
+#include "frame_tracer.hpp"
+
+#include <cassert>
+
+#include "os.hpp"
+
+#ifdef WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace freelan
+{
+	namespace
+	{
+		const char* const DIRECTION_NAMES[frame_tracer::FTD_COUNT] = { "outbound", "inbound" };
+		const char* const STAGE_NAMES[frame_tracer::FTS_COUNT] = { "classification", "switch_decision", "handoff" };
+		const char* const STAGE_DESCRIPTIONS[frame_tracer::FTS_COUNT] = {
+			"The time it takes to classify a sampled frame.",
+			"The time it takes the switch to choose a target port for a sampled frame, after its classification.",
+			"The time it takes to hand a sampled frame to the FSCP server or to the tap adapter, after the switch decision."
+		};
+	}
+
+	frame_tracer::frame_tracer(metrics_registry& registry, unsigned int sampling_interval) :
+		m_sampling_interval(sampling_interval),
+		m_countdown(sampling_interval),
+		m_tracing(false),
+		m_direction(FTD_OUTBOUND),
+		m_marked_stages(0),
+		m_start(0),
+		m_last_mark(0)
+	{
+		assert(sampling_interval > 0);
+
+		for (unsigned int _direction = 0; _direction < FTD_COUNT; ++_direction)
+		{
+			const std::string prefix = std::string("freelan_frame_") + DIRECTION_NAMES[_direction] + "_";
+
+			for (unsigned int _stage = 0; _stage < FTS_COUNT; ++_stage)
+			{
+				m_stage_histograms[_direction][_stage] = &registry.register_histogram(prefix + STAGE_NAMES[_stage] + "_nanoseconds", STAGE_DESCRIPTIONS[_stage]);
+			}
+
+			m_total_histograms[_direction] = &registry.register_histogram(prefix + "total_nanoseconds", "The time a sampled frame spends in the data path.");
+		}
+	}
+
+	boost::uint64_t frame_tracer::now()
+	{
+#ifdef WINDOWS
+		static LARGE_INTEGER frequency;
+
+		if (frequency.QuadPart == 0)
+		{
+			QueryPerformanceFrequency(&frequency);
+		}
+
+		LARGE_INTEGER value;
+		QueryPerformanceCounter(&value);
+
+		const boost::uint64_t ticks = value.QuadPart;
+		const boost::uint64_t ticks_per_second = frequency.QuadPart;
+
+		return (ticks / ticks_per_second) * 1000000000 + (ticks % ticks_per_second) * 1000000000 / ticks_per_second;
+#else
+		// CLOCK_MONOTONIC is read from the vDSO: it is cheap and, unlike the coarse clocks, precise enough for per-stage latencies.
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+
+		return static_cast<boost::uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+	}
+}
@@ -0,0 +1,181 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file handshake_governor.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A handshake admission control class.
+ */
+
+#include "handshake_governor.hpp"
+
+#include <algorithm>
+
+namespace freelan
+{
+	bool handshake_governor::is_cooling_down(const address_type& address, const fingerprint_type& fingerprint) const
+	{
+		const cooldown_map_type::const_iterator it = m_cooldown_map.find(std::make_pair(address, fingerprint));
+
+		return ((it != m_cooldown_map.end()) && (it->second > now()));
+	}
+
+	bool handshake_governor::consume_token(const address_type& address)
+	{
+		if (m_rate_limit == 0)
+		{
+			return true;
+		}
+
+		const boost::posix_time::ptime current_time = now();
+
+		source_state_map_type::iterator it = m_source_state_map.find(address);
+
+		if (it == m_source_state_map.end())
+		{
+			source_state state;
+			state.tokens = m_rate_limit;
+			state.last_update = current_time;
+
+			it = m_source_state_map.insert(std::make_pair(address, state)).first;
+		}
+		else
+		{
+			// Refill the bucket according to the elapsed time.
+			const double elapsed = static_cast<double>((current_time - it->second.last_update).total_microseconds()) / 1000000.0;
+
+			it->second.tokens = std::min(static_cast<double>(m_rate_limit), it->second.tokens + elapsed * m_rate_limit);
+			it->second.last_update = current_time;
+		}
+
+		if (it->second.tokens < 1.0)
+		{
+			return false;
+		}
+
+		it->second.tokens -= 1.0;
+
+		return true;
+	}
+
+	bool handshake_governor::begin_handshake(const ep_type& ep)
+	{
+		const boost::posix_time::ptime current_time = now();
+
+		const pending_handshake_map_type::iterator it = m_pending_handshake_map.find(ep);
+
+		if (it != m_pending_handshake_map.end())
+		{
+			it->second.expiration = current_time + m_handshake_timeout;
+
+			return true;
+		}
+
+		if ((m_max_pending_handshakes > 0) && (m_pending_handshake_map.size() >= m_max_pending_handshakes))
+		{
+			// Maybe some handshakes were abandoned: let's check again.
+			purge();
+
+			if (m_pending_handshake_map.size() >= m_max_pending_handshakes)
+			{
+				return false;
+			}
+		}
+
+		pending_handshake& handshake = m_pending_handshake_map[ep];
+		handshake.start = current_time;
+		handshake.expiration = current_time + m_handshake_timeout;
+
+		return true;
+	}
+
+	void handshake_governor::report_validation_failure(const address_type& address, const fingerprint_type& fingerprint)
+	{
+		if (m_failure_cooldown <= boost::posix_time::time_duration())
+		{
+			return;
+		}
+
+		m_cooldown_map[std::make_pair(address, fingerprint)] = now() + m_failure_cooldown;
+	}
+
+	void handshake_governor::purge()
+	{
+		const boost::posix_time::ptime current_time = now();
+
+		for (pending_handshake_map_type::iterator it = m_pending_handshake_map.begin(); it != m_pending_handshake_map.end();)
+		{
+			if (it->second.expiration <= current_time)
+			{
+				m_pending_handshake_map.erase(it++);
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		// A source whose bucket would be full again has nothing worth remembering.
+		const boost::posix_time::time_duration refill_time = boost::posix_time::seconds(1);
+
+		for (source_state_map_type::iterator it = m_source_state_map.begin(); it != m_source_state_map.end();)
+		{
+			if (current_time - it->second.last_update >= refill_time)
+			{
+				m_source_state_map.erase(it++);
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		for (cooldown_map_type::iterator it = m_cooldown_map.begin(); it != m_cooldown_map.end();)
+		{
+			if (it->second <= current_time)
+			{
+				m_cooldown_map.erase(it++);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+}
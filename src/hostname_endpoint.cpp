@@ -45,34 +45,11 @@
 
 #include "hostname_endpoint.hpp"
 
-#include <cassert>
-
+#include "parse_operations.hpp"
 #include "stream_operations.hpp"
 
 namespace freelan
 {
-	namespace
-	{
-		std::istream& read_hostname_service(std::istream& is, std::string& hostname, std::string& service)
-		{
-			if (read_hostname(is, hostname))
-			{
-				if (is.good() && (is.peek() == ':'))
-				{
-					is.ignore();
-
-					if (!read_service(is, service))
-					{
-						putback(is, hostname + ':');
-						is.setstate(std::ios_base::failbit);
-					}
-				}
-			}
-
-			return is;
-		}
-	}
-
 	boost::asio::ip::udp::endpoint resolve(const hostname_endpoint& ep, hostname_endpoint::resolver& resolver, hostname_endpoint::resolver::protocol_type protocol, hostname_endpoint::resolver::query::flags flags, const std::string& default_service)
 	{
 		hostname_endpoint::resolver::query query(protocol, ep.hostname(), ep.service().empty() ? default_service : ep.service(), flags);
@@ -101,15 +78,39 @@ namespace freelan
 
 	std::istream& operator>>(std::istream& is, hostname_endpoint& value)
 	{
-		std::string hostname;
-		std::string service;
+		return read_parsed(is, value);
+	}
+
+	const char* parse(const char* begin, const char* end, hostname_endpoint& value, boost::system::error_code& ec)
+	{
+		const char* it = begin;
 
-		if (read_hostname_service(is, hostname, service))
+		if (!parse_hostname(it, end))
 		{
-			value = hostname_endpoint(hostname, service);
+			ec = make_parse_error();
+
+			return begin;
 		}
 
-		return is;
+		const char* const hostname_end = it;
+		const char* service_begin = it;
+
+		if ((it != end) && (*it == ':'))
+		{
+			service_begin = ++it;
+
+			if (!parse_service(it, end))
+			{
+				ec = make_parse_error();
+
+				return begin;
+			}
+		}
+
+		value = hostname_endpoint(std::string(begin, hostname_end), std::string(service_begin, it));
+		ec = boost::system::error_code();
+
+		return it;
 	}
 
 	bool operator==(const hostname_endpoint& lhs, const hostname_endpoint& rhs)
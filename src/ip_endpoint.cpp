@@ -45,6 +45,7 @@
 
 #include "ip_endpoint.hpp"
 
+#include "parse_operations.hpp"
 #include "stream_operations.hpp"
 
 namespace freelan
@@ -52,93 +53,106 @@ namespace freelan
 	namespace
 	{
 		template <typename AddressType>
-		std::istream& read_ip_address_port(std::istream& is, std::string& ip_address, std::string& port);
+		bool parse_ip_address_port(const char*& it, const char* end, AddressType& address, boost::optional<uint16_t>& port);
 
 		template <>
-		std::istream& read_ip_address_port<boost::asio::ip::address_v4>(std::istream& is, std::string& ip_address, std::string& port)
+		bool parse_ip_address_port<boost::asio::ip::address_v4>(const char*& it, const char* end, boost::asio::ip::address_v4& address, boost::optional<uint16_t>& port)
 		{
-			if (is.good())
+			const char* cur = it;
+
+			if (!parse_ip_address(cur, end, address))
 			{
-				if (read_ip_address<boost::asio::ip::address_v4>(is, ip_address))
-				{
-					if (is.good() && (is.peek() == ':'))
-					{
-						is.ignore();
+				return false;
+			}
 
-						if (!read_port(is, port))
-						{
-							putback(is, ip_address + ':');
-							is.setstate(std::ios_base::failbit);
-						}
-					}
+			if ((cur != end) && (*cur == ':'))
+			{
+				uint16_t num_port;
+
+				if (!parse_port(++cur, end, num_port))
+				{
+					return false;
 				}
+
+				port = num_port;
 			}
 
-			return is;
+			it = cur;
+
+			return true;
 		}
 
 		template <>
-		std::istream& read_ip_address_port<boost::asio::ip::address_v6>(std::istream& is, std::string& ip_address, std::string& port)
+		bool parse_ip_address_port<boost::asio::ip::address_v6>(const char*& it, const char* end, boost::asio::ip::address_v6& address, boost::optional<uint16_t>& port)
 		{
-			if (is.good())
+			const char* cur = it;
+
+			if ((cur == end) || (*cur != '['))
 			{
-				if (is.peek() == '[')
+				if (!parse_ip_address(cur, end, address))
 				{
-					is.ignore();
+					return false;
+				}
+			}
+			else
+			{
+				if (!parse_ip_address(++cur, end, address))
+				{
+					return false;
+				}
 
-					if (!read_ip_address<boost::asio::ip::address_v6>(is, ip_address))
-					{
-						is.clear();
-						is.putback('[');
-						is.setstate(std::ios_base::failbit);
-					}
-					else
-					{
-						if (is.peek() != ']')
-						{
-							// End bracket not found: lets put back everything and fail.
-							putback(is, '[' + ip_address);
-							is.setstate(std::ios_base::failbit);
-						}
-						else
-						{
-							is.ignore();
-
-							if (is.good() && (is.peek() == ':'))
-							{
-								is.ignore();
-
-								if (!read_port(is, port))
-								{
-									putback(is, '[' + ip_address + ']' + ':');
-									is.setstate(std::ios_base::failbit);
-								}
-							}
-						}
-					}
+				// End bracket not found.
+				if ((cur == end) || (*cur != ']'))
+				{
+					return false;
 				}
-				else
+
+				if ((++cur != end) && (*cur == ':'))
 				{
-					read_ip_address<boost::asio::ip::address_v6>(is, ip_address);
+					uint16_t num_port;
+
+					if (!parse_port(++cur, end, num_port))
+					{
+						return false;
+					}
+
+					port = num_port;
 				}
 			}
 
-			return is;
+			it = cur;
+
+			return true;
 		}
 	}
 
 	template <typename AddressType>
-	std::istream& operator>>(std::istream& is, ip_endpoint<AddressType>& value)
+	const char* parse(const char* begin, const char* end, ip_endpoint<AddressType>& value, boost::system::error_code& ec)
 	{
-		std::string ip_address;
-		std::string port;
+		const char* it = begin;
+		AddressType address;
+		boost::optional<uint16_t> port;
 
-		if (read_ip_address_port<AddressType>(is, ip_address, port))
+		if (!parse_ip_address_port(it, end, address, port))
 		{
-			value = ip_endpoint<AddressType>(AddressType::from_string(ip_address), port.empty() ? boost::none : boost::optional<uint16_t>(boost::lexical_cast<uint16_t>(port)));
+			ec = make_parse_error();
+
+			return begin;
 		}
 
-		return is;
+		value = ip_endpoint<AddressType>(address, port);
+		ec = boost::system::error_code();
+
+		return it;
+	}
+
+	template const char* parse(const char* begin, const char* end, ipv4_endpoint& value, boost::system::error_code& ec);
+	template const char* parse(const char* begin, const char* end, ipv6_endpoint& value, boost::system::error_code& ec);
+
+	template <typename AddressType>
+	std::istream& operator>>(std::istream& is, ip_endpoint<AddressType>& value)
+	{
+		return read_parsed(is, value);
 	}
 
 	template <>
@@ -45,90 +45,181 @@
 
 #include "ip_network_address.hpp"
 
-#include <boost/bind.hpp>
-#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <cctype>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define FREELAN_HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "parse_operations.hpp"
 #include "stream_operations.hpp"
 
 namespace freelan
 {
 	namespace
 	{
-		template <typename AddressType>
-		std::istream& read_ip_address_prefix_length(std::istream& is, std::string& ip_address, std::string& prefix_length)
+		// The count of addresses converted to words at once by has_addresses()
+		const size_t ADDRESS_BATCH_SIZE = 64;
+
+		bool has_match(const boost::uint32_t* addr, const boost::uint32_t* networks, const boost::uint32_t* masks, size_t count)
+		{
+			size_t i = 0;
+
+#ifdef FREELAN_HAS_SSE2
+			// Four networks per iteration
+			const __m128i vaddr = _mm_set1_epi32(static_cast<int>(*addr));
+
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128i vnetworks = _mm_loadu_si128(reinterpret_cast<const __m128i*>(networks + i));
+				const __m128i vmasks = _mm_loadu_si128(reinterpret_cast<const __m128i*>(masks + i));
+
+				if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(vaddr, vmasks), vnetworks)) != 0)
+					return true;
+			}
+#endif
+
+			for (; i < count; ++i)
+			{
+				if ((*addr & masks[i]) == networks[i])
+					return true;
+			}
+
+			return false;
+		}
+
+		bool has_match(const boost::uint64_t* addr, const boost::uint64_t* networks, const boost::uint64_t* masks, size_t count)
 		{
-			if (is.good())
+#ifdef FREELAN_HAS_SSE2
+			// One network per iteration: the two words fit in a single register
+			const __m128i vaddr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(addr));
+
+			for (size_t i = 0; i < count; ++i)
 			{
-				if (read_ip_address<AddressType>(is, ip_address))
+				const __m128i vnetwork = _mm_loadu_si128(reinterpret_cast<const __m128i*>(networks + 2 * i));
+				const __m128i vmask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(masks + 2 * i));
+
+				if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(vaddr, vmask), vnetwork)) == 0xFFFF)
+					return true;
+			}
+#else
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (((addr[0] & masks[2 * i]) == networks[2 * i]) && ((addr[1] & masks[2 * i + 1]) == networks[2 * i + 1]))
+					return true;
+			}
+#endif
+
+			return false;
+		}
+
+		size_t match(const boost::uint32_t* addrs, size_t count, const boost::uint32_t* network, const boost::uint32_t* mask, bool* results)
+		{
+			size_t matches = 0;
+			size_t i = 0;
+
+#ifdef FREELAN_HAS_SSE2
+			// Four addresses per iteration
+			const __m128i vnetwork = _mm_set1_epi32(static_cast<int>(*network));
+			const __m128i vmask = _mm_set1_epi32(static_cast<int>(*mask));
+
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128i vaddrs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(addrs + i));
+				const int bits = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(vaddrs, vmask), vnetwork)));
+
+				for (size_t j = 0; j < 4; ++j)
 				{
-					if (is.good() && (is.peek() == '/'))
-					{
-						is.ignore();
-
-						if (!read_prefix_length<AddressType>(is, prefix_length))
-						{
-							putback(is, ip_address + '/');
-							is.setstate(std::ios_base::failbit);
-						}
-					}
-					else
-					{
-						putback(is, ip_address);
-						is.setstate(std::ios_base::failbit);
-					}
+					results[i + j] = (((bits >> j) & 1) != 0);
+					matches += results[i + j];
 				}
 			}
+#endif
+
+			for (; i < count; ++i)
+			{
+				results[i] = ((addrs[i] & *mask) == *network);
+				matches += results[i];
+			}
 
-			return is;
+			return matches;
 		}
-	}
 
-	template <typename AddressType>
-	bool base_ip_network_address<AddressType>::has_address(const AddressType& addr) const
-	{
-		const typename AddressType::bytes_type network_bytes = address().to_bytes();
-		const typename AddressType::bytes_type addr_bytes = addr.to_bytes();
+		size_t match(const boost::uint64_t* addrs, size_t count, const boost::uint64_t* network, const boost::uint64_t* mask, bool* results)
+		{
+			size_t matches = 0;
 
-		unsigned int prefix_len = m_prefix_length;
+#ifdef FREELAN_HAS_SSE2
+			// One address per iteration: the two words fit in a single register
+			const __m128i vnetwork = _mm_loadu_si128(reinterpret_cast<const __m128i*>(network));
+			const __m128i vmask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask));
 
-		for (size_t i = 0; i < network_bytes.size(); ++i)
-		{
-			if (prefix_len >= 8)
+			for (size_t i = 0; i < count; ++i)
 			{
-				if (network_bytes[i] != addr_bytes[i])
-					return false;
+				const __m128i vaddr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(addrs + 2 * i));
 
-				prefix_len -= 8;
+				results[i] = (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(vaddr, vmask), vnetwork)) == 0xFFFF);
+				matches += results[i];
 			}
-			else
+#else
+			for (size_t i = 0; i < count; ++i)
 			{
-				const typename AddressType::bytes_type::value_type mask = (static_cast<unsigned char>(0xFF) >> prefix_len) ^ static_cast<unsigned char>(0xFF);
+				results[i] = ((addrs[2 * i] & mask[0]) == network[0]) && ((addrs[2 * i + 1] & mask[1]) == network[1]);
+				matches += results[i];
+			}
+#endif
 
-				if ((network_bytes[i] & mask) != (addr_bytes[i] & mask))
-					return false;
+			return matches;
+		}
+	}
 
-				break;
+	template <typename AddressType>
+	size_t base_ip_network_address<AddressType>::has_addresses(const AddressType* addresses, size_t count, bool* results) const
+	{
+		word_type words[ADDRESS_BATCH_SIZE * traits_type::word_count];
+		size_t matches = 0;
+
+		for (size_t offset = 0; offset < count; offset += ADDRESS_BATCH_SIZE)
+		{
+			const size_t batch_size = std::min(count - offset, ADDRESS_BATCH_SIZE);
+
+			for (size_t i = 0; i < batch_size; ++i)
+			{
+				traits_type::to_words(addresses[offset + i], words + i * traits_type::word_count);
 			}
+
+			matches += match(words, batch_size, m_network_words, m_mask_words, results + offset);
 		}
 
-		return true;
+		return matches;
 	}
 
-	template bool ipv4_network_address::has_address(const boost::asio::ip::address_v4&) const;
-	template bool ipv6_network_address::has_address(const boost::asio::ip::address_v6&) const;
+	template size_t ipv4_network_address::has_addresses(const boost::asio::ip::address_v4*, size_t, bool*) const;
+	template size_t ipv6_network_address::has_addresses(const boost::asio::ip::address_v6*, size_t, bool*) const;
 
 	template <typename AddressType>
-	std::istream& operator>>(std::istream& is, base_ip_network_address<AddressType>& value)
+	bool base_ip_network_address_list<AddressType>::has_address(const AddressType& addr) const
 	{
-		std::string ip_address;
-		std::string prefix_length;
-
-		if (read_ip_address_prefix_length<AddressType>(is, ip_address, prefix_length))
+		if (empty())
 		{
-			value = base_ip_network_address<AddressType>(AddressType::from_string(ip_address), boost::lexical_cast<unsigned int>(prefix_length));
+			return false;
 		}
 
-		return is;
+		word_type words[traits_type::word_count];
+		traits_type::to_words(addr, words);
+
+		return has_match(words, &m_network_words[0], &m_mask_words[0], size());
+	}
+
+	template bool ipv4_network_address_list::has_address(const boost::asio::ip::address_v4&) const;
+	template bool ipv6_network_address_list::has_address(const boost::asio::ip::address_v6&) const;
+
+	template <typename AddressType>
+	std::istream& operator>>(std::istream& is, base_ip_network_address<AddressType>& value)
+	{
+		return read_parsed(is, value);
 	}
 
 	template std::istream& operator>>(std::istream& is, ipv4_network_address& value);
@@ -143,34 +234,67 @@ namespace freelan
 	template std::ostream& operator<<(std::ostream& is, const ipv4_network_address& value);
 	template std::ostream& operator<<(std::ostream& is, const ipv6_network_address& value);
 
+	template <typename AddressType>
+	const char* parse(const char* begin, const char* end, base_ip_network_address<AddressType>& value, boost::system::error_code& ec)
+	{
+		const char* it = begin;
+		AddressType address;
+		unsigned int prefix_length = 0;
+
+		if (!parse_ip_address(it, end, address) || (it == end) || (*it != '/') || !parse_prefix_length<AddressType>(++it, end, prefix_length))
+		{
+			ec = make_parse_error();
+
+			return begin;
+		}
+
+		value = base_ip_network_address<AddressType>(address, prefix_length);
+		ec = boost::system::error_code();
+
+		return it;
+	}
+
+	template const char* parse(const char* begin, const char* end, ipv4_network_address& value, boost::system::error_code& ec);
+	template const char* parse(const char* begin, const char* end, ipv6_network_address& value, boost::system::error_code& ec);
+
 	std::istream& operator>>(std::istream& is, ip_network_address& value)
 	{
-		if (is)
+		return read_parsed(is, value);
+	}
+
+	const char* parse(const char* begin, const char* end, ip_network_address& value, boost::system::error_code& ec)
+	{
+		// The first non-hexadecimal character tells the address family: IPv6 addresses are the only ones to contain a colon before their prefix length.
+		const char* it = begin;
+
+		while ((it != end) && std::isxdigit(static_cast<unsigned char>(*it)))
+		{
+			++it;
+		}
+
+		if ((it != end) && (*it == ':'))
 		{
 			ipv6_network_address ina;
 
-			if (is >> ina)
+			it = parse(begin, end, ina, ec);
+
+			if (!ec)
 			{
 				value = ina;
-				return is;
 			}
-
-			is.clear();
 		}
-
-		if (is)
+		else
 		{
 			ipv4_network_address ina;
 
-			if (is >> ina)
+			it = parse(begin, end, ina, ec);
+
+			if (!ec)
 			{
 				value = ina;
-				return is;
 			}
-
-			is.clear();
 		}
 
-		return is;
+		return it;
 	}
 }
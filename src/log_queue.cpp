@@ -0,0 +1,159 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file log_queue.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An asynchronous log queue.
+ */
+
+#include "log_queue.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <boost/lexical_cast.hpp>
+
+namespace freelan
+{
+	namespace
+	{
+		// The time after which the drain thread checks the queue even if it was not notified.
+		const boost::posix_time::time_duration DRAIN_PERIOD = boost::posix_time::milliseconds(50);
+	}
+
+	const size_t log_queue::MAX_MESSAGE_SIZE;
+
+	log_queue::log_queue(logger::log_callback_type callback, size_t capacity) :
+		m_callback(callback),
+		m_queue(capacity),
+		m_dropped_count(0),
+		m_unreported_dropped_count(0),
+		m_waiting(false),
+		m_stopping(false),
+		m_thread(boost::bind(&log_queue::drain, this))
+	{
+	}
+
+	log_queue::~log_queue()
+	{
+		m_stopping.store(true);
+
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			m_condition.notify_one();
+		}
+
+		m_thread.join();
+	}
+
+	bool log_queue::push(log_level level, const char* msg, size_t msg_len)
+	{
+		entry _entry;
+
+		_entry.level = level;
+		_entry.size = std::min(msg_len, MAX_MESSAGE_SIZE);
+		std::memcpy(_entry.message, msg, _entry.size);
+
+		if (!m_queue.bounded_push(_entry))
+		{
+			m_dropped_count.fetch_add(1, boost::memory_order_relaxed);
+			m_unreported_dropped_count.fetch_add(1, boost::memory_order_relaxed);
+
+			return false;
+		}
+
+		// Only wake the drain thread up if it is asleep: the notification is the only cost on the producer side.
+		if (m_waiting.load())
+		{
+			m_condition.notify_one();
+		}
+
+		return true;
+	}
+
+	void log_queue::drain()
+	{
+		for (;;)
+		{
+			deliver_pending();
+
+			if (m_stopping.load())
+			{
+				// The producers might have pushed entries after the last delivery.
+				deliver_pending();
+
+				break;
+			}
+
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			m_waiting.store(true);
+
+			if (m_queue.empty() && !m_stopping.load())
+			{
+				// A notification can be missed between the emptiness check and the wait: the timeout bounds the delay.
+				m_condition.timed_wait(lock, DRAIN_PERIOD);
+			}
+
+			m_waiting.store(false);
+		}
+	}
+
+	void log_queue::deliver_pending()
+	{
+		entry _entry;
+
+		while (m_queue.pop(_entry))
+		{
+			if (m_callback)
+			{
+				m_callback(_entry.level, std::string(_entry.message, _entry.size));
+			}
+		}
+
+		const unsigned long dropped = m_unreported_dropped_count.exchange(0);
+
+		if ((dropped > 0) && m_callback)
+		{
+			m_callback(LL_WARNING, boost::lexical_cast<std::string>(dropped) + " log entries were dropped: the log queue was full.");
+		}
+	}
+}
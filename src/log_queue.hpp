@@ -0,0 +1,149 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file log_queue.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An asynchronous log queue.
+ */
+
+#ifndef FREELAN_LOG_QUEUE_HPP
+#define FREELAN_LOG_QUEUE_HPP
+
+#include "logger.hpp"
+
+#include <string>
+
+#include <boost/lockfree/queue.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace freelan
+{
+	/**
+	 * \brief A bounded queue of log entries drained by a dedicated thread.
+	 *
+	 * Producers never lock nor allocate: entries are copied into fixed-size
+	 * slots of a lock-free queue. Entries that do not fit are dropped and
+	 * counted. Messages longer than a slot are truncated.
+	 */
+	class log_queue : private boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief The maximum size of a message, in bytes.
+			 */
+			static const size_t MAX_MESSAGE_SIZE = 1000;
+
+			/**
+			 * \brief Create a new log queue and start its drain thread.
+			 * \param callback The callback to call from the drain thread for every entry.
+			 * \param capacity The maximum count of pending entries. Cannot exceed 65535.
+			 */
+			log_queue(logger::log_callback_type callback, size_t capacity);
+
+			/**
+			 * \brief Drain the pending entries and stop the drain thread.
+			 */
+			~log_queue();
+
+			/**
+			 * \brief Push an entry.
+			 * \param level The log level.
+			 * \param msg The message.
+			 * \return true on success, false if the entry was dropped.
+			 *
+			 * This method can be called from any thread.
+			 */
+			bool push(log_level level, const std::string& msg);
+
+			/**
+			 * \brief Push an entry.
+			 * \param level The log level.
+			 * \param msg The message.
+			 * \param msg_len The length of msg.
+			 * \return true on success, false if the entry was dropped.
+			 *
+			 * This method can be called from any thread.
+			 */
+			bool push(log_level level, const char* msg, size_t msg_len);
+
+			/**
+			 * \brief Get the count of dropped entries since the creation of the queue.
+			 * \return The count of dropped entries.
+			 */
+			unsigned long dropped_count() const;
+
+		private:
+
+			struct entry
+			{
+				log_level level;
+				size_t size;
+				char message[MAX_MESSAGE_SIZE];
+			};
+
+			void drain();
+			void deliver_pending();
+
+			logger::log_callback_type m_callback;
+			boost::lockfree::queue<entry, boost::lockfree::fixed_sized<true> > m_queue;
+			boost::atomic<unsigned long> m_dropped_count;
+			boost::atomic<unsigned long> m_unreported_dropped_count;
+			boost::atomic<bool> m_waiting;
+			boost::atomic<bool> m_stopping;
+			boost::mutex m_mutex;
+			boost::condition_variable m_condition;
+			boost::thread m_thread;
+	};
+
+	inline bool log_queue::push(log_level level, const std::string& msg)
+	{
+		return push(level, msg.data(), msg.size());
+	}
+
+	inline unsigned long log_queue::dropped_count() const
+	{
+		return m_dropped_count.load(boost::memory_order_relaxed);
+	}
+}
+
+#endif /* FREELAN_LOG_QUEUE_HPP */
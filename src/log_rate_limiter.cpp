@@ -0,0 +1,150 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file log_rate_limiter.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A log rate limiter.
+ */
+
+#include "log_rate_limiter.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace freelan
+{
+	bool log_rate_limiter::site_less::operator()(const site_type& lhs, const site_type& rhs) const
+	{
+		if (lhs.line != rhs.line)
+		{
+			return (lhs.line < rhs.line);
+		}
+
+		if (lhs.level != rhs.level)
+		{
+			return (lhs.level < rhs.level);
+		}
+
+		// The same file name might not always be the same pointer.
+		return (std::strcmp(lhs.file, rhs.file) < 0);
+	}
+
+	bool log_rate_limiter::consume_token(log_level level, const char* file, unsigned int line, unsigned long& suppressed_count)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		if ((m_burst == 0) || m_period.is_special() || (m_period.total_microseconds() <= 0))
+		{
+			suppressed_count = 0;
+
+			return true;
+		}
+
+		const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+		const std::pair<bucket_map_type::iterator, bool> result = m_bucket_map.insert(std::make_pair(site_type(level, file, line), bucket_type()));
+		bucket_type& bucket = result.first->second;
+
+		if (result.second)
+		{
+			bucket.tokens = m_burst;
+		}
+		else
+		{
+			const double elapsed = static_cast<double>((now - bucket.last_update).total_microseconds()) / m_period.total_microseconds();
+
+			bucket.tokens = std::min(static_cast<double>(m_burst), bucket.tokens + std::max(0.0, elapsed) * m_burst);
+		}
+
+		bucket.last_update = now;
+
+		if (bucket.tokens < 1.0)
+		{
+			++bucket.suppressed_count;
+
+			return false;
+		}
+
+		bucket.tokens -= 1.0;
+		suppressed_count = bucket.suppressed_count;
+		bucket.suppressed_count = 0;
+
+		return true;
+	}
+
+	void log_rate_limiter::collect_suppressed_sites(suppressed_site_list& sites)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		if (m_bucket_map.empty() || m_period.is_special() || (m_period.total_microseconds() <= 0))
+		{
+			return;
+		}
+
+		const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+		if (!m_next_sweep.is_not_a_date_time() && (now < m_next_sweep))
+		{
+			return;
+		}
+
+		m_next_sweep = now + m_period;
+
+		for (bucket_map_type::iterator it = m_bucket_map.begin(); it != m_bucket_map.end();)
+		{
+			// A site that stayed quiet for a whole period has a full bucket again: there is nothing else to remember.
+			if (now - it->second.last_update >= m_period)
+			{
+				if (it->second.suppressed_count > 0)
+				{
+					const suppressed_site site = { it->first.level, it->first.file, it->first.line, it->second.suppressed_count };
+
+					sites.push_back(site);
+				}
+
+				m_bucket_map.erase(it++);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+}
@@ -0,0 +1,175 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file log_rate_limiter.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A log rate limiter.
+ */
+
+#ifndef FREELAN_LOG_RATE_LIMITER_HPP
+#define FREELAN_LOG_RATE_LIMITER_HPP
+
+#include "logger.hpp"
+
+#include <map>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace freelan
+{
+	/**
+	 * \brief A class that limits the rate of the log entries of every call site.
+	 *
+	 * Every (level, file, line) site has its own token bucket: up to burst
+	 * entries are accepted, and the bucket refills at burst entries per
+	 * period. The entries refused in-between are counted and reported once
+	 * the site is accepted again, or once the site stayed quiet for a whole
+	 * period.
+	 */
+	class log_rate_limiter : private boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief A site whose refused entries were not reported.
+			 */
+			struct suppressed_site
+			{
+				log_level level;
+				const char* file;
+				unsigned int line;
+				unsigned long suppressed_count;
+			};
+
+			/**
+			 * \brief The suppressed site list type.
+			 */
+			typedef std::vector<suppressed_site> suppressed_site_list;
+
+			/**
+			 * \brief Create a new log rate limiter.
+			 * \param burst The count of entries accepted in a row. 0 means no limit.
+			 * \param period The time it takes for the bucket to refill.
+			 */
+			log_rate_limiter(unsigned int burst, const boost::posix_time::time_duration& period);
+
+			/**
+			 * \brief Change the limits.
+			 * \param burst The count of entries accepted in a row. 0 means no limit.
+			 * \param period The time it takes for the bucket to refill.
+			 */
+			void set_limits(unsigned int burst, const boost::posix_time::time_duration& period);
+
+			/**
+			 * \brief Consume a token for the specified site.
+			 * \param level The log level.
+			 * \param file The source file.
+			 * \param line The source line.
+			 * \param suppressed_count The count of entries refused for this site since it was last accepted. Only set on success.
+			 * \return true if the entry can be logged.
+			 *
+			 * This method can be called from any thread.
+			 */
+			bool consume_token(log_level level, const char* file, unsigned int line, unsigned long& suppressed_count);
+
+			/**
+			 * \brief Collect the sites that were refused entries and stayed quiet for a whole period since.
+			 * \param sites The list the sites are appended to. Their suppressed count is reset.
+			 *
+			 * The sites are only scanned once per period, so calling this method often
+			 * is cheap. Quiet sites are forgotten.
+			 *
+			 * This method can be called from any thread.
+			 */
+			void collect_suppressed_sites(suppressed_site_list& sites);
+
+		private:
+
+			struct site_type
+			{
+				site_type(log_level _level, const char* _file, unsigned int _line) : level(_level), file(_file), line(_line) {}
+
+				log_level level;
+				const char* file;
+				unsigned int line;
+			};
+
+			struct site_less
+			{
+				bool operator()(const site_type&, const site_type&) const;
+			};
+
+			struct bucket_type
+			{
+				bucket_type() : tokens(0), suppressed_count(0) {}
+
+				double tokens;
+				boost::posix_time::ptime last_update;
+				unsigned long suppressed_count;
+			};
+
+			typedef std::map<site_type, bucket_type, site_less> bucket_map_type;
+
+			boost::mutex m_mutex;
+			unsigned int m_burst;
+			boost::posix_time::time_duration m_period;
+			bucket_map_type m_bucket_map;
+			boost::posix_time::ptime m_next_sweep;
+	};
+
+	inline log_rate_limiter::log_rate_limiter(unsigned int burst, const boost::posix_time::time_duration& period) :
+		m_burst(burst),
+		m_period(period)
+	{
+	}
+
+	inline void log_rate_limiter::set_limits(unsigned int burst, const boost::posix_time::time_duration& period)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		m_burst = burst;
+		m_period = period;
+	}
+}
+
+#endif /* FREELAN_LOG_RATE_LIMITER_HPP */
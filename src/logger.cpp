@@ -47,20 +47,66 @@
 
 #include <sstream>
 
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/tss.hpp>
+
 #include "logger_stream.hpp"
+#include "log_queue.hpp"
+#include "log_rate_limiter.hpp"
+#include "metrics.hpp"
 
 namespace freelan
 {
+	namespace
+	{
+		// The string passed to the callback in synchronous mode. Reusing it avoids an allocation per entry.
+		struct scratch_message_type
+		{
+			scratch_message_type() : in_use(false) {}
+
+			std::string message;
+			bool in_use;
+		};
+
+		boost::thread_specific_ptr<scratch_message_type> scratch_message;
+
+		class scratch_message_guard
+		{
+			public:
+
+				scratch_message_guard(scratch_message_type& _scratch_message) :
+					m_scratch_message(_scratch_message)
+				{
+					m_scratch_message.in_use = true;
+				}
+
+				~scratch_message_guard()
+				{
+					m_scratch_message.in_use = false;
+				}
+
+			private:
+
+				scratch_message_type& m_scratch_message;
+		};
+	}
+
+	const size_t logger::DEFAULT_QUEUE_CAPACITY = 4096;
+	const unsigned int logger::DEFAULT_RATE_LIMIT_BURST = 5;
+	const boost::posix_time::time_duration logger::DEFAULT_RATE_LIMIT_PERIOD = boost::posix_time::seconds(10);
+
 	logger::logger(log_callback_type callback, log_level _level) :
 		m_callback(callback),
 		m_level(_level),
-		m_os(new std::ostringstream())
+		m_rate_limiter(boost::make_shared<log_rate_limiter>(DEFAULT_RATE_LIMIT_BURST, DEFAULT_RATE_LIMIT_PERIOD)),
+		m_entries_counter(NULL)
 	{
 	}
 
 	logger_stream logger::operator()(log_level _level)
 	{
-		if (_level >= m_level)
+		if (is_enabled(_level))
 		{
 			return logger_stream(*this, _level);
 		}
@@ -72,32 +118,123 @@ namespace freelan
 
 	void logger::log(log_level _level, const std::string& msg)
 	{
-		if (_level >= m_level)
+		if (is_enabled(_level))
 		{
-			if (m_callback)
+			if (m_entries_counter)
+			{
+				m_entries_counter->increment();
+			}
+
+			if (m_queue)
+			{
+				m_queue->push(_level, msg.data(), msg.size());
+			}
+			else if (m_callback)
 			{
 				m_callback(_level, msg);
 			}
 		}
 	}
 
-	void logger::flush(log_level _level)
+	void logger::set_asynchronous(size_t capacity)
+	{
+		m_queue = boost::make_shared<log_queue>(m_callback, capacity);
+	}
+
+	unsigned long logger::dropped_count() const
+	{
+		return m_queue ? m_queue->dropped_count() : 0;
+	}
+
+	void logger::set_rate_limit(unsigned int burst, const boost::posix_time::time_duration& period)
+	{
+		m_rate_limiter->set_limits(burst, period);
+	}
+
+	bool logger::check_rate_limit(log_level _level, const char* file, unsigned int line)
 	{
-		std::ostringstream& oss = static_cast<std::ostringstream&>(os());
+		flush_suppressed_entries();
+
+		unsigned long suppressed_count = 0;
+
+		if (!m_rate_limiter->consume_token(_level, file, line, suppressed_count))
+		{
+			return false;
+		}
 
-		oss << std::flush;
+		if (suppressed_count > 0)
+		{
+			std::ostringstream oss;
+			oss << suppressed_count << " similar message(s) suppressed.";
+
+			const std::string msg = oss.str();
+
+			write(_level, msg.data(), msg.size());
+		}
+
+		return true;
+	}
+
+	void logger::flush_suppressed_entries()
+	{
+		log_rate_limiter::suppressed_site_list sites;
 
-		const std::string msg = oss.str();
-		oss.str("");
+		m_rate_limiter->collect_suppressed_sites(sites);
 
-		if (m_callback)
+		for (log_rate_limiter::suppressed_site_list::const_iterator it = sites.begin(); it != sites.end(); ++it)
 		{
-			m_callback(_level, msg);
+			if (is_enabled(it->level))
+			{
+				std::ostringstream oss;
+				oss << it->suppressed_count << " similar message(s) suppressed (" << it->file << ":" << it->line << ").";
+
+				const std::string msg = oss.str();
+
+				write(it->level, msg.data(), msg.size());
+			}
 		}
 	}
 
-	std::ostream& logger::os()
+	void logger::set_metrics(metrics_registry& registry)
 	{
-		return *m_os;
+		m_entries_counter = &registry.register_counter("freelan_log_entries_total", "The count of log entries.");
+		registry.register_callback("freelan_log_dropped_entries_total", "The count of log entries dropped because the asynchronous queue was full.", MT_COUNTER, boost::bind(&logger::dropped_count, this));
+	}
+
+	void logger::write(log_level _level, const char* msg, size_t msg_len)
+	{
+		if (m_entries_counter)
+		{
+			m_entries_counter->increment();
+		}
+
+		if (m_queue)
+		{
+			m_queue->push(_level, msg, msg_len);
+		}
+		else if (m_callback)
+		{
+			scratch_message_type* _scratch_message = scratch_message.get();
+
+			if (!_scratch_message)
+			{
+				_scratch_message = new scratch_message_type();
+				scratch_message.reset(_scratch_message);
+			}
+
+			if (_scratch_message->in_use)
+			{
+				// The callback logs again: the scratch message is still in use.
+				m_callback(_level, std::string(msg, msg_len));
+			}
+			else
+			{
+				scratch_message_guard guard(*_scratch_message);
+
+				_scratch_message->message.assign(msg, msg_len);
+
+				m_callback(_level, _scratch_message->message);
+			}
+		}
 	}
 }
@@ -45,6 +45,105 @@
 
 #include "logger_stream.hpp"
 
+#include <cstring>
+
+#include <boost/thread/tss.hpp>
+
 namespace freelan
 {
+	const size_t logger_stream::BUFFER_SIZE;
+
+	logger_stream::logger_stream(const logger_stream& other) :
+		m_logger(other.m_logger),
+		m_level(other.m_level),
+		m_os(other.m_os),
+		m_previous_buffer(other.m_previous_buffer)
+	{
+		other.m_logger = NULL;
+
+		if (m_logger)
+		{
+			m_buffer = boost::in_place();
+
+			// Nothing was usually written yet: this is only a copy when the compiler did not elide the transfer.
+			m_buffer->sputn(other.m_buffer->data(), other.m_buffer->size());
+
+			m_os->rdbuf(&*m_buffer);
+		}
+	}
+
+	logger_stream::~logger_stream()
+	{
+		if (m_logger)
+		{
+			// An entry can be logged while another one is formatted on the same thread.
+			m_os->rdbuf(m_previous_buffer);
+
+			m_logger->write(m_level, m_buffer->data(), m_buffer->size());
+		}
+	}
+
+	std::ostream& logger_stream::formatting_stream()
+	{
+		static boost::thread_specific_ptr<std::ostream> stream;
+
+		if (!stream.get())
+		{
+			stream.reset(new std::ostream(NULL));
+		}
+
+		return *stream;
+	}
+
+	void logger_stream::attach()
+	{
+		m_previous_buffer = m_os->rdbuf(&*m_buffer);
+
+		// Restore the default formatting flags in case a previous entry changed them.
+		m_os->flags(std::ios_base::dec | std::ios_base::skipws);
+		m_os->fill(' ');
+		m_os->precision(6);
+		m_os->width(0);
+	}
+
+	logger_stream::buffer::buffer()
+	{
+		setp(m_data, m_data + BUFFER_SIZE);
+	}
+
+	logger_stream::buffer::int_type logger_stream::buffer::overflow(int_type ch)
+	{
+		if (m_overflow.empty())
+		{
+			// The fixed-size buffer is full: we switch to the dynamic one.
+			m_overflow.assign(pbase(), pptr());
+			setp(NULL, NULL);
+		}
+
+		if (!traits_type::eq_int_type(ch, traits_type::eof()))
+		{
+			m_overflow.push_back(traits_type::to_char_type(ch));
+		}
+
+		return traits_type::not_eof(ch);
+	}
+
+	std::streamsize logger_stream::buffer::xsputn(const char* s, std::streamsize n)
+	{
+		const std::streamsize available = epptr() - pptr();
+
+		if (pptr() && (n <= available))
+		{
+			std::memcpy(pptr(), s, static_cast<size_t>(n));
+			pbump(static_cast<int>(n));
+		}
+		else
+		{
+			overflow(traits_type::eof());
+
+			m_overflow.append(s, static_cast<size_t>(n));
+		}
+
+		return n;
+	}
 }
@@ -0,0 +1,369 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file metrics.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief The metrics classes.
+ */
+
+#include "metrics.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/make_shared.hpp>
+
+namespace freelan
+{
+	namespace
+	{
+		const unsigned int SUB_BUCKET_BITS = 3;
+
+		unsigned int highest_bit(boost::uint64_t value)
+		{
+#ifdef __GNUC__
+			return 63 - __builtin_clzll(value);
+#else
+			unsigned int result = 0;
+
+			while (value >>= 1)
+			{
+				++result;
+			}
+
+			return result;
+#endif
+		}
+
+		const char* metric_type_name(metric_type type)
+		{
+			switch (type)
+			{
+				case MT_COUNTER:
+					return "counter";
+				case MT_GAUGE:
+					return "gauge";
+				case MT_HISTOGRAM:
+					return "histogram";
+			}
+
+			return "untyped";
+		}
+
+		void write_escaped_help(std::ostream& os, const std::string& help)
+		{
+			for (std::string::const_iterator it = help.begin(); it != help.end(); ++it)
+			{
+				switch (*it)
+				{
+					case '\\':
+						os << "\\\\";
+						break;
+					case '\n':
+						os << "\\n";
+						break;
+					default:
+						os << *it;
+						break;
+				}
+			}
+		}
+	}
+
+	const unsigned int histogram::SUB_BUCKET_COUNT;
+	const size_t histogram::BUCKET_COUNT;
+
+	boost::uint64_t histogram_snapshot::value_at_quantile(double quantile) const
+	{
+		if (count == 0)
+		{
+			return 0;
+		}
+
+		const boost::uint64_t rank = std::max<boost::uint64_t>(1, static_cast<boost::uint64_t>(std::ceil(quantile * count)));
+		boost::uint64_t cumulative_count = 0;
+
+		for (size_t index = 0; index < buckets.size(); ++index)
+		{
+			cumulative_count += buckets[index];
+
+			if (cumulative_count >= rank)
+			{
+				return histogram::bucket_upper_bound(index);
+			}
+		}
+
+		return histogram::bucket_upper_bound(buckets.size() - 1);
+	}
+
+	size_t histogram::bucket_index(boost::uint64_t value)
+	{
+		if (value < SUB_BUCKET_COUNT)
+		{
+			return static_cast<size_t>(value);
+		}
+
+		const unsigned int exponent = highest_bit(value);
+		const unsigned int shift = exponent - SUB_BUCKET_BITS;
+
+		return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT + static_cast<size_t>((value >> shift) & (SUB_BUCKET_COUNT - 1));
+	}
+
+	boost::uint64_t histogram::bucket_upper_bound(size_t index)
+	{
+		if (index < SUB_BUCKET_COUNT)
+		{
+			return index;
+		}
+
+		const unsigned int shift = static_cast<unsigned int>(index / SUB_BUCKET_COUNT - 1);
+		const boost::uint64_t lower_bound = static_cast<boost::uint64_t>(SUB_BUCKET_COUNT + index % SUB_BUCKET_COUNT) << shift;
+
+		return lower_bound + ((static_cast<boost::uint64_t>(1) << shift) - 1);
+	}
+
+	histogram::histogram() :
+		m_count(0),
+		m_sum(0)
+	{
+		for (size_t index = 0; index < m_buckets.size(); ++index)
+		{
+			m_buckets[index].store(0, boost::memory_order_relaxed);
+		}
+	}
+
+	histogram_snapshot histogram::snapshot() const
+	{
+		histogram_snapshot result;
+
+		result.buckets.resize(m_buckets.size());
+
+		for (size_t index = 0; index < m_buckets.size(); ++index)
+		{
+			result.buckets[index] = m_buckets[index].load(boost::memory_order_relaxed);
+			result.count += result.buckets[index];
+		}
+
+		// The sum is read separately: it might be slightly off if values are recorded concurrently.
+		result.sum = m_sum.load(boost::memory_order_relaxed);
+
+		return result;
+	}
+
+	counter& metrics_registry::register_counter(const std::string& name, const std::string& help)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		entry& _entry = get_entry(name, help, MT_COUNTER);
+
+		if (!_entry.counter)
+		{
+			_entry.counter = boost::make_shared<freelan::counter>();
+		}
+
+		return *_entry.counter;
+	}
+
+	gauge& metrics_registry::register_gauge(const std::string& name, const std::string& help)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		entry& _entry = get_entry(name, help, MT_GAUGE);
+
+		if (!_entry.gauge)
+		{
+			_entry.gauge = boost::make_shared<freelan::gauge>();
+		}
+
+		return *_entry.gauge;
+	}
+
+	histogram& metrics_registry::register_histogram(const std::string& name, const std::string& help)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		entry& _entry = get_entry(name, help, MT_HISTOGRAM);
+
+		if (!_entry.histogram)
+		{
+			_entry.histogram = boost::make_shared<freelan::histogram>();
+		}
+
+		return *_entry.histogram;
+	}
+
+	void metrics_registry::register_callback(const std::string& name, const std::string& help, metric_type type, value_callback callback)
+	{
+		if (type == MT_HISTOGRAM)
+		{
+			throw std::runtime_error("A histogram cannot be computed by a callback: " + name);
+		}
+
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		entry& _entry = get_entry(name, help, type);
+
+		if (_entry.counter || _entry.gauge)
+		{
+			throw std::runtime_error("A metric with the same name is already registered: " + name);
+		}
+
+		_entry.callback = callback;
+	}
+
+	void metrics_registry::unregister_callback(const std::string& name)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		const entry_map_type::iterator it = m_entry_map.find(name);
+
+		if ((it != m_entry_map.end()) && it->second.callback)
+		{
+			m_entry_map.erase(it);
+		}
+	}
+
+	metrics_snapshot metrics_registry::snapshot() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		metrics_snapshot result;
+		result.reserve(m_entry_map.size());
+
+		for (entry_map_type::const_iterator it = m_entry_map.begin(); it != m_entry_map.end(); ++it)
+		{
+			metric_snapshot metric;
+
+			metric.name = it->first;
+			metric.help = it->second.help;
+			metric.type = it->second.type;
+			metric.value = 0;
+
+			if (it->second.counter)
+			{
+				metric.value = static_cast<boost::int64_t>(it->second.counter->value());
+			}
+			else if (it->second.gauge)
+			{
+				metric.value = it->second.gauge->value();
+			}
+			else if (it->second.histogram)
+			{
+				metric.distribution = it->second.histogram->snapshot();
+			}
+			else if (it->second.callback)
+			{
+				metric.value = it->second.callback();
+			}
+
+			result.push_back(metric);
+		}
+
+		return result;
+	}
+
+	void metrics_registry::write_prometheus(std::ostream& os) const
+	{
+		const metrics_snapshot metrics = snapshot();
+
+		for (metrics_snapshot::const_iterator metric = metrics.begin(); metric != metrics.end(); ++metric)
+		{
+			os << "# HELP " << metric->name << " ";
+			write_escaped_help(os, metric->help);
+			os << "\n";
+			os << "# TYPE " << metric->name << " " << metric_type_name(metric->type) << "\n";
+
+			if (metric->type != MT_HISTOGRAM)
+			{
+				os << metric->name << " " << metric->value << "\n";
+
+				continue;
+			}
+
+			// Buckets are exposed per power of two, up to the highest non-empty one.
+			const std::vector<boost::uint64_t>& buckets = metric->distribution.buckets;
+			size_t last_index = 0;
+
+			for (size_t index = 0; index < buckets.size(); ++index)
+			{
+				if (buckets[index] > 0)
+				{
+					last_index = index;
+				}
+			}
+
+			last_index = std::min(buckets.size() - 1, last_index - last_index % histogram::SUB_BUCKET_COUNT + histogram::SUB_BUCKET_COUNT - 1);
+
+			boost::uint64_t cumulative_count = 0;
+
+			for (size_t index = 0; index <= last_index; ++index)
+			{
+				cumulative_count += buckets[index];
+
+				if (index % histogram::SUB_BUCKET_COUNT == histogram::SUB_BUCKET_COUNT - 1)
+				{
+					os << metric->name << "_bucket{le=\"" << histogram::bucket_upper_bound(index) << "\"} " << cumulative_count << "\n";
+				}
+			}
+
+			os << metric->name << "_bucket{le=\"+Inf\"} " << metric->distribution.count << "\n";
+			os << metric->name << "_sum " << metric->distribution.sum << "\n";
+			os << metric->name << "_count " << metric->distribution.count << "\n";
+		}
+	}
+
+	metrics_registry::entry& metrics_registry::get_entry(const std::string& name, const std::string& help, metric_type type)
+	{
+		const std::pair<entry_map_type::iterator, bool> result = m_entry_map.insert(std::make_pair(name, entry()));
+
+		if (result.second)
+		{
+			result.first->second.help = help;
+			result.first->second.type = type;
+		}
+		else if (result.first->second.type != type)
+		{
+			throw std::runtime_error("A metric with the same name but another type is already registered: " + name);
+		}
+
+		return result.first->second;
+	}
+}
@@ -0,0 +1,264 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file metrics_exporter.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A metrics exporter class.
+ */
+
+#include "metrics_exporter.hpp"
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
+namespace freelan
+{
+	namespace
+	{
+		// Requests are only read to be polite with HTTP clients: we never need more than this.
+		const size_t MAX_REQUEST_SIZE = 4096;
+
+		// The time a client gets to send its request and read the response.
+		const boost::posix_time::time_duration CONNECTION_TIMEOUT = boost::posix_time::seconds(5);
+
+		// The pause before accepting again when we ran out of descriptors or memory.
+		const boost::posix_time::time_duration ACCEPT_RETRY_DELAY = boost::posix_time::seconds(1);
+
+		bool is_resource_exhaustion(const boost::system::error_code& ec)
+		{
+			return (
+			    (ec == boost::asio::error::no_descriptors) ||
+			    (ec == boost::system::error_code(ENFILE, boost::system::system_category())) ||
+			    (ec == boost::asio::error::no_buffer_space) ||
+			    (ec == boost::asio::error::no_memory)
+			);
+		}
+
+		bool is_transient(const boost::system::error_code& ec)
+		{
+			return (
+			    (ec == boost::asio::error::connection_aborted) ||
+			    (ec == boost::asio::error::interrupted) ||
+			    (ec == boost::asio::error::try_again) ||
+			    (ec == boost::asio::error::would_block)
+			);
+		}
+	}
+
+	struct metrics_exporter::connection
+	{
+		connection(boost::asio::io_service& io_service) :
+			socket(io_service),
+			request(MAX_REQUEST_SIZE),
+			timer(io_service)
+		{
+		}
+
+		boost::asio::local::stream_protocol::socket socket;
+		boost::asio::streambuf request;
+		std::string response;
+		boost::asio::deadline_timer timer;
+	};
+
+	metrics_exporter::metrics_exporter(boost::asio::io_service& io_service, const metrics_registry& registry) :
+		m_io_service(io_service),
+		m_registry(registry),
+		m_acceptor(io_service),
+		m_accept_retry_timer(io_service)
+	{
+	}
+
+	void metrics_exporter::open(const std::string& path)
+	{
+		close();
+
+		struct stat path_stat;
+
+		// Only a stale socket may be replaced: we must never delete an unrelated file.
+		if (::stat(path.c_str(), &path_stat) == 0)
+		{
+			if (!S_ISSOCK(path_stat.st_mode))
+			{
+				throw std::runtime_error("Cannot serve the metrics on \"" + path + "\": the file exists and is not a socket");
+			}
+
+			std::remove(path.c_str());
+		}
+		else if (errno != ENOENT)
+		{
+			throw std::runtime_error("Cannot serve the metrics on \"" + path + "\": " + std::strerror(errno));
+		}
+
+		const boost::asio::local::stream_protocol::endpoint endpoint(path);
+
+		m_acceptor.open(endpoint.protocol());
+		m_acceptor.bind(endpoint);
+		m_acceptor.listen();
+
+		m_path = path;
+
+		async_accept();
+	}
+
+	void metrics_exporter::close()
+	{
+		m_accept_retry_timer.cancel();
+
+		if (m_acceptor.is_open())
+		{
+			boost::system::error_code ec;
+
+			m_acceptor.close(ec);
+		}
+
+		if (!m_path.empty())
+		{
+			std::remove(m_path.c_str());
+			m_path.clear();
+		}
+	}
+
+	void metrics_exporter::async_accept()
+	{
+		const connection_ptr _connection = boost::make_shared<connection>(boost::ref(m_io_service));
+
+		m_acceptor.async_accept(_connection->socket, boost::bind(&metrics_exporter::handle_accept, this, _connection, boost::asio::placeholders::error));
+	}
+
+	void metrics_exporter::handle_accept(connection_ptr _connection, const boost::system::error_code& ec)
+	{
+		if (ec == boost::asio::error::operation_aborted)
+		{
+			return;
+		}
+
+		if (!ec)
+		{
+			_connection->timer.expires_from_now(CONNECTION_TIMEOUT);
+			_connection->timer.async_wait(boost::bind(&metrics_exporter::handle_timeout, _connection, boost::asio::placeholders::error));
+
+			boost::asio::async_read_until(_connection->socket, _connection->request, "\r\n\r\n", boost::bind(&metrics_exporter::handle_read, this, _connection, boost::asio::placeholders::error));
+		}
+		else if (is_resource_exhaustion(ec))
+		{
+			// Accepting again right away would fail the same way, in a busy loop.
+			m_accept_retry_timer.expires_from_now(ACCEPT_RETRY_DELAY);
+			m_accept_retry_timer.async_wait(boost::bind(&metrics_exporter::handle_accept_retry, this, boost::asio::placeholders::error));
+
+			return;
+		}
+		else if (!is_transient(ec))
+		{
+			// The acceptor is unusable: we stop serving.
+			return;
+		}
+
+		async_accept();
+	}
+
+	void metrics_exporter::handle_accept_retry(const boost::system::error_code& ec)
+	{
+		if (!ec && m_acceptor.is_open())
+		{
+			async_accept();
+		}
+	}
+
+	void metrics_exporter::handle_read(connection_ptr _connection, const boost::system::error_code& ec)
+	{
+		// Clients that don't speak HTTP just close their side or send too much: they get the metrics anyway.
+		if (ec && (ec != boost::asio::error::eof) && (ec != boost::asio::error::not_found))
+		{
+			_connection->timer.cancel();
+
+			return;
+		}
+
+		std::ostringstream body;
+		m_registry.write_prometheus(body);
+
+		const std::string _body = body.str();
+
+		std::ostringstream response;
+		response << "HTTP/1.0 200 OK\r\n";
+		response << "Content-Type: text/plain; version=0.0.4\r\n";
+		response << "Content-Length: " << _body.size() << "\r\n";
+		response << "\r\n";
+		response << _body;
+
+		_connection->response = response.str();
+
+		boost::asio::async_write(_connection->socket, boost::asio::buffer(_connection->response), boost::bind(&metrics_exporter::handle_write, _connection, boost::asio::placeholders::error));
+	}
+
+	void metrics_exporter::handle_write(connection_ptr _connection, const boost::system::error_code&)
+	{
+		boost::system::error_code ec;
+
+		_connection->timer.cancel();
+		_connection->socket.shutdown(boost::asio::local::stream_protocol::socket::shutdown_both, ec);
+		_connection->socket.close(ec);
+	}
+
+	void metrics_exporter::handle_timeout(connection_ptr _connection, const boost::system::error_code& ec)
+	{
+		if (ec == boost::asio::error::operation_aborted)
+		{
+			return;
+		}
+
+		// The pending read or write completes with an error and releases the connection.
+		boost::system::error_code close_ec;
+
+		_connection->socket.close(close_ec);
+	}
+}
+
+#endif
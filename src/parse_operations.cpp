@@ -0,0 +1,302 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file parse_operations.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Character range parsing functions.
+ */
+
+#include "parse_operations.hpp"
+
+#include <cctype>
+#include <cstring>
+
+namespace freelan
+{
+	namespace
+	{
+		// Large enough for any textual IPv4 or IPv6 address (INET6_ADDRSTRLEN is 46)
+		const size_t IP_ADDRESS_MAX_SIZE = 63;
+
+		// Hostname labels are 63 characters long at most
+		const size_t HOSTNAME_LABEL_MAX_SIZE = 63;
+
+		// Hostnames are at most 255 characters long
+		const size_t HOSTNAME_MAX_SIZE = 255;
+
+		bool is_digit(char c)
+		{
+			return (std::isdigit(static_cast<unsigned char>(c)) != 0);
+		}
+
+		bool is_alnum(char c)
+		{
+			return (std::isalnum(static_cast<unsigned char>(c)) != 0);
+		}
+
+		template <typename AddressType>
+		bool is_ip_address_character(char c);
+
+		template <>
+		bool is_ip_address_character<boost::asio::ip::address_v4>(char c)
+		{
+			return (is_digit(c) || (c == '.'));
+		}
+
+		template <>
+		bool is_ip_address_character<boost::asio::ip::address_v6>(char c)
+		{
+			return (std::isxdigit(static_cast<unsigned char>(c)) || (c == ':'));
+		}
+
+		template <typename AddressType>
+		bool check_prefix_length(unsigned int prefix_length);
+
+		template <>
+		bool check_prefix_length<boost::asio::ip::address_v4>(unsigned int prefix_length)
+		{
+			return (prefix_length < 32);
+		}
+
+		template <>
+		bool check_prefix_length<boost::asio::ip::address_v6>(unsigned int prefix_length)
+		{
+			return (prefix_length < 128);
+		}
+
+		bool is_hostname_label_character(char c)
+		{
+			return is_alnum(c) || (c == '-');
+		}
+
+		// Parse a decimal number, failing as soon as it exceeds max_value
+		bool parse_number(const char*& it, const char* end, unsigned int max_value, unsigned int& value)
+		{
+			const char* cur = it;
+			unsigned int result = 0;
+
+			while ((cur != end) && is_digit(*cur))
+			{
+				result = result * 10 + static_cast<unsigned int>(*cur - '0');
+
+				if (result > max_value)
+				{
+					return false;
+				}
+
+				++cur;
+			}
+
+			if (cur == it)
+			{
+				return false;
+			}
+
+			value = result;
+			it = cur;
+
+			return true;
+		}
+
+		bool parse_hostname_label(const char*& it, const char* end)
+		{
+			// Parse hostname labels according to RFC1123
+
+			if ((it == end) || !is_alnum(*it))
+			{
+				return false;
+			}
+
+			const char* cur = it;
+			bool only_digits = true;
+
+			for (; (cur != end) && is_hostname_label_character(*cur); ++cur)
+			{
+				only_digits = only_digits && is_digit(*cur);
+			}
+
+			// Check if the label is too long, if the last character is not a regular character or if it contains only digits
+			if ((static_cast<size_t>(cur - it) > HOSTNAME_LABEL_MAX_SIZE) || !is_alnum(*(cur - 1)) || only_digits)
+			{
+				return false;
+			}
+
+			it = cur;
+
+			return true;
+		}
+	}
+
+	template <typename AddressType>
+	bool parse_ip_address(const char*& it, const char* end, AddressType& address)
+	{
+		const char* cur = it;
+
+		while ((cur != end) && is_ip_address_character<AddressType>(*cur))
+		{
+			++cur;
+		}
+
+		const size_t size = static_cast<size_t>(cur - it);
+
+		if ((size == 0) || (size > IP_ADDRESS_MAX_SIZE))
+		{
+			return false;
+		}
+
+		// The address parser requires a null-terminated string: a stack buffer avoids any allocation.
+		char buf[IP_ADDRESS_MAX_SIZE + 1];
+		std::memcpy(buf, it, size);
+		buf[size] = '\0';
+
+		boost::system::error_code ec;
+		const AddressType result = AddressType::from_string(buf, ec);
+
+		if (ec)
+		{
+			return false;
+		}
+
+		address = result;
+		it = cur;
+
+		return true;
+	}
+
+	template bool parse_ip_address<boost::asio::ip::address_v4>(const char*& it, const char* end, boost::asio::ip::address_v4& address);
+	template bool parse_ip_address<boost::asio::ip::address_v6>(const char*& it, const char* end, boost::asio::ip::address_v6& address);
+
+	bool parse_port(const char*& it, const char* end, uint16_t& port)
+	{
+		unsigned int value = 0;
+
+		if (!parse_number(it, end, 65535, value))
+		{
+			return false;
+		}
+
+		port = static_cast<uint16_t>(value);
+
+		return true;
+	}
+
+	template <typename AddressType>
+	bool parse_prefix_length(const char*& it, const char* end, unsigned int& prefix_length)
+	{
+		const char* cur = it;
+		unsigned int value = 0;
+
+		if (!parse_number(cur, end, 1024, value) || !check_prefix_length<AddressType>(value))
+		{
+			return false;
+		}
+
+		prefix_length = value;
+		it = cur;
+
+		return true;
+	}
+
+	template bool parse_prefix_length<boost::asio::ip::address_v4>(const char*& it, const char* end, unsigned int& prefix_length);
+	template bool parse_prefix_length<boost::asio::ip::address_v6>(const char*& it, const char* end, unsigned int& prefix_length);
+
+	bool parse_hostname(const char*& it, const char* end)
+	{
+		// Parse hostnames labels according to RFC952 and RFC1123
+
+		const char* cur = it;
+
+		if (!parse_hostname_label(cur, end))
+		{
+			return false;
+		}
+
+		while ((cur != end) && (*cur == '.'))
+		{
+			++cur;
+
+			if (!parse_hostname_label(cur, end))
+			{
+				return false;
+			}
+		}
+
+		if (static_cast<size_t>(cur - it) > HOSTNAME_MAX_SIZE)
+		{
+			return false;
+		}
+
+		it = cur;
+
+		return true;
+	}
+
+	bool parse_service(const char*& it, const char* end)
+	{
+		const char* cur = it;
+		bool only_digits = true;
+
+		for (; (cur != end) && is_alnum(*cur); ++cur)
+		{
+			only_digits = only_digits && is_digit(*cur);
+		}
+
+		if (cur == it)
+		{
+			return false;
+		}
+
+		// Numeric services must be valid port numbers
+		if (only_digits)
+		{
+			const char* num = it;
+			uint16_t port;
+
+			if (!parse_port(num, cur, port) || (num != cur))
+			{
+				return false;
+			}
+		}
+
+		it = cur;
+
+		return true;
+	}
+}
@@ -0,0 +1,111 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file parse_operations.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Character range parsing functions.
+ */
+
+#ifndef FREELAN_PARSE_OPERATIONS_HPP
+#define FREELAN_PARSE_OPERATIONS_HPP
+
+#include <boost/asio.hpp>
+#include <boost/system/error_code.hpp>
+
+namespace freelan
+{
+	/**
+	 * \brief Get the error code used for parsing failures.
+	 * \return The error code.
+	 */
+	inline boost::system::error_code make_parse_error()
+	{
+		return boost::system::errc::make_error_code(boost::system::errc::invalid_argument);
+	}
+
+	/**
+	 * \brief Parse an IP address.
+	 * \tparam AddressType The address type.
+	 * \param it The current position. Advanced past the address on success.
+	 * \param end The end of the range.
+	 * \param address The result address.
+	 * \return true on success.
+	 */
+	template <typename AddressType>
+	bool parse_ip_address(const char*& it, const char* end, AddressType& address);
+
+	/**
+	 * \brief Parse a port number.
+	 * \param it The current position. Advanced past the port number on success.
+	 * \param end The end of the range.
+	 * \param port The result port.
+	 * \return true on success.
+	 */
+	bool parse_port(const char*& it, const char* end, uint16_t& port);
+
+	/**
+	 * \brief Parse a prefix length.
+	 * \tparam AddressType The address type.
+	 * \param it The current position. Advanced past the prefix length on success.
+	 * \param end The end of the range.
+	 * \param prefix_length The result prefix length.
+	 * \return true on success.
+	 */
+	template <typename AddressType>
+	bool parse_prefix_length(const char*& it, const char* end, unsigned int& prefix_length);
+
+	/**
+	 * \brief Parse a hostname.
+	 * \param it The current position. Advanced past the hostname on success.
+	 * \param end The end of the range.
+	 * \return true on success.
+	 */
+	bool parse_hostname(const char*& it, const char* end);
+
+	/**
+	 * \brief Parse a service string.
+	 * \param it The current position. Advanced past the service on success.
+	 * \param end The end of the range.
+	 * \return true on success.
+	 */
+	bool parse_service(const char*& it, const char* end);
+}
+
+#endif /* FREELAN_PARSE_OPERATIONS_HPP */
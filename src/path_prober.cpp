@@ -0,0 +1,266 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file path_prober.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A path quality prober class.
+ */
+
+#include "path_prober.hpp"
+
+#include <cassert>
+#include <cstring>
+
+namespace freelan
+{
+	namespace
+	{
+		// Message layout: type (1 byte), reserved (3 bytes), sequence (4 bytes), then the request transmit time, the response receive time and the response transmit time (8 bytes each). All values are in network byte order and dates are in microseconds since the epoch.
+		const size_t TYPE_OFFSET = 0;
+		const size_t SEQUENCE_OFFSET = 4;
+		const size_t REQUEST_TRANSMIT_TIME_OFFSET = 8;
+		const size_t RESPONSE_RECEIVE_TIME_OFFSET = 16;
+		const size_t RESPONSE_TRANSMIT_TIME_OFFSET = 24;
+
+		const boost::posix_time::ptime EPOCH(boost::gregorian::date(1970, 1, 1));
+
+		void write_uint32(boost::uint8_t* buf, boost::uint32_t value)
+		{
+			for (size_t i = 0; i < 4; ++i)
+			{
+				buf[i] = static_cast<boost::uint8_t>(value >> (8 * (3 - i)));
+			}
+		}
+
+		boost::uint32_t read_uint32(const boost::uint8_t* buf)
+		{
+			boost::uint32_t value = 0;
+
+			for (size_t i = 0; i < 4; ++i)
+			{
+				value = (value << 8) | buf[i];
+			}
+
+			return value;
+		}
+
+		void write_date(boost::uint8_t* buf, const boost::posix_time::ptime& date)
+		{
+			const boost::uint64_t value = static_cast<boost::uint64_t>((date - EPOCH).total_microseconds());
+
+			for (size_t i = 0; i < 8; ++i)
+			{
+				buf[i] = static_cast<boost::uint8_t>(value >> (8 * (7 - i)));
+			}
+		}
+
+		boost::posix_time::ptime read_date(const boost::uint8_t* buf)
+		{
+			boost::uint64_t value = 0;
+
+			for (size_t i = 0; i < 8; ++i)
+			{
+				value = (value << 8) | buf[i];
+			}
+
+			return EPOCH + boost::posix_time::microseconds(static_cast<boost::int64_t>(value));
+		}
+
+		boost::posix_time::time_duration absolute(const boost::posix_time::time_duration& duration)
+		{
+			return duration.is_negative() ? duration.invert_sign() : duration;
+		}
+	}
+
+	const size_t path_prober::MESSAGE_SIZE;
+	const size_t path_prober::WINDOW_SIZE;
+	const boost::posix_time::time_duration path_prober::PROBE_TIMEOUT = boost::posix_time::seconds(2);
+
+	path_prober::message_type path_prober::get_message_type(boost::asio::const_buffer message)
+	{
+		if (boost::asio::buffer_size(message) != MESSAGE_SIZE)
+		{
+			return MT_INVALID;
+		}
+
+		switch (boost::asio::buffer_cast<const boost::uint8_t*>(message)[TYPE_OFFSET])
+		{
+			case MT_REQUEST:
+				return MT_REQUEST;
+			case MT_RESPONSE:
+				return MT_RESPONSE;
+		}
+
+		return MT_INVALID;
+	}
+
+	size_t path_prober::write_response(boost::asio::const_buffer request, const boost::posix_time::ptime& receive_time, boost::asio::mutable_buffer response)
+	{
+		assert(get_message_type(request) == MT_REQUEST);
+		assert(boost::asio::buffer_size(response) >= MESSAGE_SIZE);
+
+		boost::uint8_t* const buf = boost::asio::buffer_cast<boost::uint8_t*>(response);
+
+		// The sequence and the request transmit time are echoed back.
+		std::memcpy(buf, boost::asio::buffer_cast<const boost::uint8_t*>(request), RESPONSE_RECEIVE_TIME_OFFSET);
+
+		buf[TYPE_OFFSET] = MT_RESPONSE;
+		write_date(buf + RESPONSE_RECEIVE_TIME_OFFSET, receive_time);
+		write_date(buf + RESPONSE_TRANSMIT_TIME_OFFSET, boost::posix_time::microsec_clock::universal_time());
+
+		return MESSAGE_SIZE;
+	}
+
+	path_prober::path_prober() :
+		m_next_sequence(0),
+		m_last_transit(boost::posix_time::not_a_date_time)
+	{
+		m_quality.probes_sent = 0;
+		m_quality.probes_received = 0;
+		m_quality.loss_rate = 0;
+		m_quality.rtt = boost::posix_time::not_a_date_time;
+		m_quality.jitter = boost::posix_time::time_duration();
+		m_quality.forward_delay = boost::posix_time::not_a_date_time;
+		m_quality.backward_delay = boost::posix_time::not_a_date_time;
+		m_quality.clock_offset = boost::posix_time::not_a_date_time;
+	}
+
+	size_t path_prober::write_request(boost::asio::mutable_buffer request)
+	{
+		assert(boost::asio::buffer_size(request) >= MESSAGE_SIZE);
+
+		probe& _probe = m_window[m_next_sequence % WINDOW_SIZE];
+
+		_probe = probe();
+		_probe.sequence = m_next_sequence++;
+		_probe.send_time = boost::posix_time::microsec_clock::universal_time();
+
+		boost::uint8_t* const buf = boost::asio::buffer_cast<boost::uint8_t*>(request);
+
+		std::memset(buf, 0, MESSAGE_SIZE);
+		buf[TYPE_OFFSET] = MT_REQUEST;
+		write_uint32(buf + SEQUENCE_OFFSET, _probe.sequence);
+		write_date(buf + REQUEST_TRANSMIT_TIME_OFFSET, _probe.send_time);
+
+		return MESSAGE_SIZE;
+	}
+
+	bool path_prober::handle_response(boost::asio::const_buffer response, const boost::posix_time::ptime& receive_time)
+	{
+		assert(get_message_type(response) == MT_RESPONSE);
+
+		const boost::uint8_t* const buf = boost::asio::buffer_cast<const boost::uint8_t*>(response);
+
+		const boost::uint32_t sequence = read_uint32(buf + SEQUENCE_OFFSET);
+		probe& _probe = m_window[sequence % WINDOW_SIZE];
+
+		if ((_probe.sequence != sequence) || _probe.send_time.is_not_a_date_time() || _probe.answered)
+		{
+			// Too old, never sent or duplicated.
+			return false;
+		}
+
+		const boost::posix_time::ptime t1 = _probe.send_time;
+		const boost::posix_time::ptime t2 = read_date(buf + RESPONSE_RECEIVE_TIME_OFFSET);
+		const boost::posix_time::ptime t3 = read_date(buf + RESPONSE_TRANSMIT_TIME_OFFSET);
+		const boost::posix_time::ptime t4 = receive_time;
+
+		_probe.answered = true;
+		_probe.rtt = std::max(boost::posix_time::time_duration(), (t4 - t1) - (t3 - t2));
+		_probe.clock_offset = ((t2 - t1) + (t3 - t4)) / 2;
+
+		// The offset of the fastest probe of the window is the most accurate.
+		const probe* best_probe = &_probe;
+
+		for (size_t i = 0; i < m_window.size(); ++i)
+		{
+			if (m_window[i].answered && (m_window[i].rtt < best_probe->rtt))
+			{
+				best_probe = &m_window[i];
+			}
+		}
+
+		m_quality.rtt = _probe.rtt;
+		m_quality.clock_offset = best_probe->clock_offset;
+		m_quality.forward_delay = (t2 - t1) - m_quality.clock_offset;
+		m_quality.backward_delay = (t4 - t3) + m_quality.clock_offset;
+
+		// RFC 3550: J <- J + (|D(i-1, i)| - J) / 16. The clock offset cancels out in the difference.
+		const boost::posix_time::time_duration transit = t2 - t1;
+
+		if (!m_last_transit.is_not_a_date_time())
+		{
+			m_quality.jitter += (absolute(transit - m_last_transit) - m_quality.jitter) / 16;
+		}
+
+		m_last_transit = transit;
+
+		return true;
+	}
+
+	path_quality path_prober::quality() const
+	{
+		path_quality result = m_quality;
+
+		const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+		result.probes_sent = 0;
+		result.probes_received = 0;
+
+		for (size_t i = 0; i < m_window.size(); ++i)
+		{
+			const probe& _probe = m_window[i];
+
+			if (_probe.answered || (!_probe.send_time.is_not_a_date_time() && (now - _probe.send_time > PROBE_TIMEOUT)))
+			{
+				++result.probes_sent;
+
+				if (_probe.answered)
+				{
+					++result.probes_received;
+				}
+			}
+		}
+
+		result.loss_rate = (result.probes_sent > 0) ? 1.0 - static_cast<double>(result.probes_received) / result.probes_sent : 0.0;
+
+		return result;
+	}
+}
@@ -0,0 +1,394 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file pcap_reader.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A pcap and pcapng file reader class.
+ */
+
+#include "pcap_reader.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace freelan
+{
+	namespace
+	{
+		const boost::uint32_t PCAP_MAGIC_MICROSECONDS = 0xa1b2c3d4;
+		const boost::uint32_t PCAP_MAGIC_NANOSECONDS = 0xa1b23c4d;
+		const size_t PCAP_HEADER_SIZE = 24;
+		const size_t PCAP_RECORD_HEADER_SIZE = 16;
+
+		const boost::uint32_t PCAPNG_SECTION_HEADER_BLOCK = 0x0a0d0d0a;
+		const boost::uint32_t PCAPNG_INTERFACE_DESCRIPTION_BLOCK = 0x00000001;
+		const boost::uint32_t PCAPNG_SIMPLE_PACKET_BLOCK = 0x00000003;
+		const boost::uint32_t PCAPNG_ENHANCED_PACKET_BLOCK = 0x00000006;
+		const boost::uint32_t PCAPNG_BYTE_ORDER_MAGIC = 0x1a2b3c4d;
+		const boost::uint16_t PCAPNG_OPTION_END = 0;
+		const boost::uint16_t PCAPNG_OPTION_IF_TSRESOL = 9;
+
+		const boost::uint32_t LINKTYPE_ETHERNET = 1;
+
+		boost::uint32_t swap_uint32(boost::uint32_t value)
+		{
+			return ((value & 0x000000ff) << 24) | ((value & 0x0000ff00) << 8) | ((value & 0x00ff0000) >> 8) | ((value & 0xff000000) >> 24);
+		}
+
+		size_t pad4(size_t value)
+		{
+			return (value + 3) & ~static_cast<size_t>(3);
+		}
+	}
+
+	pcap_reader::pcap_reader(const std::string& path) :
+		m_is_pcapng(false),
+		m_swapped(false),
+		m_offset(0),
+		m_skipped_count(0)
+	{
+		std::ifstream file(path.c_str(), std::ios::binary);
+
+		if (!file)
+		{
+			throw std::runtime_error("Unable to open the capture file: " + path);
+		}
+
+		m_data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+		if (m_data.size() < 4)
+		{
+			throw std::runtime_error("Not a capture file: " + path);
+		}
+
+		// The magic numbers are read in the host byte order, then in the swapped order.
+		m_swapped = false;
+		const boost::uint32_t magic = read_uint32(0);
+
+		if (magic == PCAPNG_SECTION_HEADER_BLOCK)
+		{
+			m_is_pcapng = true;
+		}
+		else if ((magic == PCAP_MAGIC_MICROSECONDS) || (magic == PCAP_MAGIC_NANOSECONDS) || (swap_uint32(magic) == PCAP_MAGIC_MICROSECONDS) || (swap_uint32(magic) == PCAP_MAGIC_NANOSECONDS))
+		{
+			if (m_data.size() < PCAP_HEADER_SIZE)
+			{
+				throw std::runtime_error("Truncated pcap header: " + path);
+			}
+
+			m_swapped = (magic != PCAP_MAGIC_MICROSECONDS) && (magic != PCAP_MAGIC_NANOSECONDS);
+
+			interface_description description;
+			description.is_ethernet = (read_uint32(20) == LINKTYPE_ETHERNET);
+			description.snap_length = read_uint32(16);
+			description.ticks_per_second = (read_uint32(0) == PCAP_MAGIC_NANOSECONDS) ? 1000000000 : 1000000;
+
+			m_interfaces.push_back(description);
+		}
+		else
+		{
+			throw std::runtime_error("Not a capture file: " + path);
+		}
+
+		rewind();
+	}
+
+	bool pcap_reader::read(pcap_frame& frame)
+	{
+		return m_is_pcapng ? read_pcapng(frame) : read_pcap(frame);
+	}
+
+	void pcap_reader::rewind()
+	{
+		m_offset = m_is_pcapng ? 0 : PCAP_HEADER_SIZE;
+		m_skipped_count = 0;
+
+		if (m_is_pcapng)
+		{
+			m_interfaces.clear();
+		}
+	}
+
+	bool pcap_reader::read_pcap(pcap_frame& frame)
+	{
+		while (m_offset + PCAP_RECORD_HEADER_SIZE <= m_data.size())
+		{
+			const boost::uint32_t seconds = read_uint32(m_offset);
+			const boost::uint32_t fraction = read_uint32(m_offset + 4);
+			const boost::uint32_t captured_size = read_uint32(m_offset + 8);
+			const boost::uint32_t original_size = read_uint32(m_offset + 12);
+			const size_t data_offset = m_offset + PCAP_RECORD_HEADER_SIZE;
+
+			if (captured_size > m_data.size() - data_offset)
+			{
+				throw std::runtime_error("Truncated pcap record");
+			}
+
+			m_offset = data_offset + captured_size;
+
+			if (!m_interfaces.front().is_ethernet)
+			{
+				++m_skipped_count;
+
+				continue;
+			}
+
+			frame.timestamp = boost::posix_time::seconds(seconds) + to_time_duration(fraction, m_interfaces.front().ticks_per_second);
+			frame.data = boost::asio::buffer(&m_data[data_offset], captured_size);
+			frame.original_size = original_size;
+
+			return true;
+		}
+
+		return false;
+	}
+
+	bool pcap_reader::read_pcapng(pcap_frame& frame)
+	{
+		while (m_offset + 12 <= m_data.size())
+		{
+			// The byte order is only known once the section header is read.
+			const size_t block_offset = m_offset;
+			const bool is_section_header = (read_uint32(block_offset) == PCAPNG_SECTION_HEADER_BLOCK);
+
+			if (is_section_header)
+			{
+				read_section_header(block_offset, m_data.size() - block_offset);
+			}
+
+			const boost::uint32_t block_type = read_uint32(block_offset);
+			const boost::uint32_t block_size = read_uint32(block_offset + 4);
+
+			if ((block_size < 12) || (block_size % 4 != 0) || (block_size > m_data.size() - block_offset))
+			{
+				throw std::runtime_error("Invalid pcapng block size");
+			}
+
+			const size_t body_offset = block_offset + 8;
+			const size_t body_size = block_size - 12;
+
+			m_offset = block_offset + block_size;
+
+			switch (block_type)
+			{
+				case PCAPNG_SECTION_HEADER_BLOCK:
+					break;
+				case PCAPNG_INTERFACE_DESCRIPTION_BLOCK:
+					{
+						read_interface_description(body_offset, body_size);
+
+						break;
+					}
+				case PCAPNG_ENHANCED_PACKET_BLOCK:
+					{
+						if (body_size < 20)
+						{
+							throw std::runtime_error("Truncated pcapng enhanced packet block");
+						}
+
+						const boost::uint32_t interface_id = read_uint32(body_offset);
+						const boost::uint64_t ticks = (static_cast<boost::uint64_t>(read_uint32(body_offset + 4)) << 32) | read_uint32(body_offset + 8);
+						const boost::uint32_t captured_size = read_uint32(body_offset + 12);
+						const boost::uint32_t original_size = read_uint32(body_offset + 16);
+
+						if ((interface_id >= m_interfaces.size()) || (captured_size > body_size - 20))
+						{
+							throw std::runtime_error("Invalid pcapng enhanced packet block");
+						}
+
+						const interface_description& description = m_interfaces[interface_id];
+
+						if (!description.is_ethernet)
+						{
+							++m_skipped_count;
+
+							break;
+						}
+
+						frame.timestamp = to_time_duration(ticks, description.ticks_per_second);
+						frame.data = boost::asio::buffer(&m_data[body_offset + 20], captured_size);
+						frame.original_size = original_size;
+
+						return true;
+					}
+				case PCAPNG_SIMPLE_PACKET_BLOCK:
+					{
+						if ((body_size < 4) || m_interfaces.empty())
+						{
+							throw std::runtime_error("Invalid pcapng simple packet block");
+						}
+
+						const interface_description& description = m_interfaces.front();
+						const boost::uint32_t original_size = read_uint32(body_offset);
+						size_t captured_size = std::min<size_t>(original_size, body_size - 4);
+
+						if (description.snap_length > 0)
+						{
+							captured_size = std::min<size_t>(captured_size, description.snap_length);
+						}
+
+						if (!description.is_ethernet)
+						{
+							++m_skipped_count;
+
+							break;
+						}
+
+						// Simple packet blocks have no timestamp.
+						frame.timestamp = boost::posix_time::time_duration();
+						frame.data = boost::asio::buffer(&m_data[body_offset + 4], captured_size);
+						frame.original_size = original_size;
+
+						return true;
+					}
+				default:
+					break;
+			}
+		}
+
+		return false;
+	}
+
+	void pcap_reader::read_section_header(size_t offset, size_t size)
+	{
+		if (size < 28)
+		{
+			throw std::runtime_error("Truncated pcapng section header block");
+		}
+
+		m_swapped = false;
+
+		const boost::uint32_t byte_order_magic = read_uint32(offset + 8);
+
+		if (byte_order_magic == PCAPNG_BYTE_ORDER_MAGIC)
+		{
+			m_swapped = false;
+		}
+		else if (swap_uint32(byte_order_magic) == PCAPNG_BYTE_ORDER_MAGIC)
+		{
+			m_swapped = true;
+		}
+		else
+		{
+			throw std::runtime_error("Invalid pcapng byte order magic");
+		}
+
+		// Every section has its own interfaces.
+		m_interfaces.clear();
+	}
+
+	void pcap_reader::read_interface_description(size_t offset, size_t size)
+	{
+		if (size < 8)
+		{
+			throw std::runtime_error("Truncated pcapng interface description block");
+		}
+
+		interface_description description;
+		description.is_ethernet = (read_uint16(offset) == LINKTYPE_ETHERNET);
+		description.snap_length = read_uint32(offset + 4);
+		description.ticks_per_second = 1000000;
+
+		size_t option_offset = offset + 8;
+		const size_t end = offset + size;
+
+		while (option_offset + 4 <= end)
+		{
+			const boost::uint16_t code = read_uint16(option_offset);
+			const boost::uint16_t length = read_uint16(option_offset + 2);
+
+			if ((code == PCAPNG_OPTION_END) || (option_offset + 4 + length > end))
+			{
+				break;
+			}
+
+			if ((code == PCAPNG_OPTION_IF_TSRESOL) && (length >= 1))
+			{
+				const boost::uint8_t resolution = m_data[option_offset + 4];
+				const unsigned int exponent = resolution & 0x7f;
+
+				// The most significant bit tells if the resolution is a power of 2 or a power of 10.
+				description.ticks_per_second = 1;
+
+				for (unsigned int i = 0; (i < exponent) && (description.ticks_per_second < 1000000000000000000ULL); ++i)
+				{
+					description.ticks_per_second *= (resolution & 0x80) ? 2 : 10;
+				}
+			}
+
+			option_offset += 4 + pad4(length);
+		}
+
+		m_interfaces.push_back(description);
+	}
+
+	boost::uint16_t pcap_reader::read_uint16(size_t offset) const
+	{
+		const boost::uint16_t value = static_cast<boost::uint16_t>(m_data[offset] | (m_data[offset + 1] << 8));
+		const boost::uint16_t swapped_value = static_cast<boost::uint16_t>((value >> 8) | (value << 8));
+		const boost::uint16_t one = 1;
+		const bool little_endian = (*reinterpret_cast<const boost::uint8_t*>(&one) == 1);
+
+		// value holds the little-endian interpretation.
+		return (little_endian != m_swapped) ? value : swapped_value;
+	}
+
+	boost::uint32_t pcap_reader::read_uint32(size_t offset) const
+	{
+		const boost::uint32_t value = static_cast<boost::uint32_t>(m_data[offset]) | (static_cast<boost::uint32_t>(m_data[offset + 1]) << 8) | (static_cast<boost::uint32_t>(m_data[offset + 2]) << 16) | (static_cast<boost::uint32_t>(m_data[offset + 3]) << 24);
+		const boost::uint16_t one = 1;
+		const bool little_endian = (*reinterpret_cast<const boost::uint8_t*>(&one) == 1);
+
+		// value holds the little-endian interpretation.
+		return (little_endian != m_swapped) ? value : swap_uint32(value);
+	}
+
+	boost::posix_time::time_duration pcap_reader::to_time_duration(boost::uint64_t ticks, boost::uint64_t ticks_per_second)
+	{
+		const boost::uint64_t seconds = ticks / ticks_per_second;
+		const boost::uint64_t remainder = ticks % ticks_per_second;
+
+		const boost::uint64_t microseconds = (ticks_per_second > 1000000) ? remainder / (ticks_per_second / 1000000) : remainder * 1000000 / ticks_per_second;
+
+		return boost::posix_time::seconds(static_cast<long>(seconds)) + boost::posix_time::microseconds(static_cast<boost::int64_t>(microseconds));
+	}
+}
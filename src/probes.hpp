@@ -0,0 +1,79 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file probes.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief The static tracing probes.
+ *
+ * When FREELAN_ENABLE_PROBES is defined, the FREELAN_PROBEn() macros expand
+ * to USDT probes of the "freelan" provider, which tools like bpftrace or
+ * SystemTap can attach to. A probe that nothing is attached to costs a
+ * single nop. Otherwise, the macros expand to nothing.
+ *
+ * When probes are compiled in, their arguments are evaluated even when
+ * nothing is attached: only pass values that are cheap to compute, like
+ * integers and pointers.
+ */
+
+#ifndef FREELAN_PROBES_HPP
+#define FREELAN_PROBES_HPP
+
+#ifdef FREELAN_ENABLE_PROBES
+
+#include <sys/sdt.h>
+
+#define FREELAN_PROBE0(name) DTRACE_PROBE(freelan, name)
+#define FREELAN_PROBE1(name, arg1) DTRACE_PROBE1(freelan, name, arg1)
+#define FREELAN_PROBE2(name, arg1, arg2) DTRACE_PROBE2(freelan, name, arg1, arg2)
+#define FREELAN_PROBE3(name, arg1, arg2, arg3) DTRACE_PROBE3(freelan, name, arg1, arg2, arg3)
+#define FREELAN_PROBE4(name, arg1, arg2, arg3, arg4) DTRACE_PROBE4(freelan, name, arg1, arg2, arg3, arg4)
+
+#else
+
+// The arguments are not evaluated, but they still count as used.
+#define FREELAN_PROBE0(name) do {} while (false)
+#define FREELAN_PROBE1(name, arg1) do { (void)sizeof(arg1); } while (false)
+#define FREELAN_PROBE2(name, arg1, arg2) do { (void)sizeof(arg1); (void)sizeof(arg2); } while (false)
+#define FREELAN_PROBE3(name, arg1, arg2, arg3) do { (void)sizeof(arg1); (void)sizeof(arg2); (void)sizeof(arg3); } while (false)
+#define FREELAN_PROBE4(name, arg1, arg2, arg3, arg4) do { (void)sizeof(arg1); (void)sizeof(arg2); (void)sizeof(arg3); (void)sizeof(arg4); } while (false)
+
+#endif
+
+#endif /* FREELAN_PROBES_HPP */
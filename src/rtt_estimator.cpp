@@ -0,0 +1,98 @@
+/*
+ * libfreelan - A C++ library to establish peer-to-peer virtual private
+ * networks.
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of libfreelan.
+ *
+ * libfreelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libfreelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use libfreelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file rtt_estimator.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A round-trip time estimator class.
+ */
+
+#include "rtt_estimator.hpp"
+
+#include <algorithm>
+
+namespace freelan
+{
+	namespace
+	{
+		// The backoff stops doubling the timeout long before it could overflow.
+		const unsigned int MAX_BACKOFF_SHIFT = 16;
+	}
+
+	const boost::posix_time::time_duration rtt_estimator::CLOCK_GRANULARITY = boost::posix_time::milliseconds(1);
+
+	void rtt_estimator::add_sample(const boost::posix_time::time_duration& rtt)
+	{
+		if (!has_samples())
+		{
+			m_smoothed_rtt = rtt;
+			m_rtt_variation = rtt / 2;
+		}
+		else
+		{
+			// RTTVAR <- 3/4 * RTTVAR + 1/4 * |SRTT - R'| then SRTT <- 7/8 * SRTT + 1/8 * R'
+			const boost::posix_time::time_duration deviation = (m_smoothed_rtt > rtt) ? (m_smoothed_rtt - rtt) : (rtt - m_smoothed_rtt);
+
+			m_rtt_variation = (m_rtt_variation * 3 + deviation) / 4;
+			m_smoothed_rtt = (m_smoothed_rtt * 7 + rtt) / 8;
+		}
+
+		m_backoff_count = 0;
+		m_last_update = boost::posix_time::microsec_clock::universal_time();
+	}
+
+	boost::posix_time::time_duration rtt_estimator::timeout(const boost::posix_time::time_duration& initial_timeout, const boost::posix_time::time_duration& min_timeout, const boost::posix_time::time_duration& max_timeout) const
+	{
+		boost::posix_time::time_duration result = initial_timeout;
+
+		if (has_samples())
+		{
+			result = m_smoothed_rtt + std::max(CLOCK_GRANULARITY, m_rtt_variation * 4);
+		}
+
+		result = std::max(min_timeout, std::min(max_timeout, result));
+
+		for (unsigned int i = 0; (i < std::min(m_backoff_count, MAX_BACKOFF_SHIFT)) && (result < max_timeout); ++i)
+		{
+			result = result * 2;
+		}
+
+		return std::min(max_timeout, result);
+	}
+}
@@ -45,321 +45,50 @@
 
 #include "stream_operations.hpp"
 
-#include <algorithm>
-
-#include <boost/asio.hpp>
-#include <boost/bind.hpp>
-#include <boost/lexical_cast.hpp>
+#include <cctype>
 
 namespace freelan
 {
-	std::istream& putback(std::istream& is, const std::string& str)
+	std::istream& putback(std::istream& is, const char* begin, const char* end)
 	{
 		std::ios::iostate state = is.rdstate();
-		is.clear();
-
-		std::for_each(str.rbegin(), str.rend(), boost::bind(&std::istream::putback, boost::ref(is), _1));
 
-		is.setstate(state);
-
-		return is;
-	}
-
-	template <typename AddressType>
-	bool is_ip_address_character(char c);
-
-	template <>
-	bool is_ip_address_character<boost::asio::ip::address_v4>(char c)
-	{
-		return (std::isdigit(c) || (c == '.'));
-	}
-
-	template <>
-	bool is_ip_address_character<boost::asio::ip::address_v6>(char c)
-	{
-		return (std::isxdigit(c) || (c == ':'));
-	}
-
-	template <typename AddressType>
-	std::istream& read_ip_address(std::istream& is, std::string& ip_address)
-	{
-		if (is.good())
+		if (begin != end)
 		{
-			if (!is_ip_address_character<AddressType>(is.peek()))
-			{
-				is.setstate(std::ios_base::failbit);
-			}
-			else
-			{
-				std::ostringstream oss;
-
-				do
-				{
-					oss.put(static_cast<char>(is.get()));
-				}
-				while (is.good() && is_ip_address_character<AddressType>(is.peek()));
-
-				if (is)
-				{
-					const std::string& result = oss.str();
-					boost::system::error_code ec;
-
-					AddressType::from_string(result, ec);
-
-					if (ec)
-					{
-						// Unable to parse the IP address: putting back characters.
-						putback(is, result);
-						is.setstate(std::ios_base::failbit);
-					}
-					else
-					{
-						ip_address = result;
-					}
-				}
-			}
+			// Characters are available again: the stream is no longer at its end.
+			state &= ~std::ios::eofbit;
 		}
 
-		return is;
-	}
-
-	template std::istream& read_ip_address<boost::asio::ip::address_v4>(std::istream& is, std::string& ip_address);
-	template std::istream& read_ip_address<boost::asio::ip::address_v6>(std::istream& is, std::string& ip_address);
-
-	std::istream& read_port(std::istream& is, std::string& port)
-	{
-		uint16_t num_port;
+		is.clear();
 
-		if (is >> std::dec >> num_port)
+		while (end != begin)
 		{
-			port = boost::lexical_cast<std::string>(num_port);
+			is.putback(*--end);
 		}
 
-		return is;
-	}
-
-	template <typename AddressType>
-	bool check_prefix_length(unsigned int prefix_length);
-
-	template <>
-	bool check_prefix_length<boost::asio::ip::address_v4>(unsigned int prefix_length)
-	{
-		return (prefix_length < 32);
-	}
-
-	template <>
-	bool check_prefix_length<boost::asio::ip::address_v6>(unsigned int prefix_length)
-	{
-		return (prefix_length < 128);
-	}
-
-	template <typename AddressType>
-	std::istream& read_prefix_length(std::istream& is, std::string& prefix_length)
-	{
-		if (is.good())
-		{
-			if (!isdigit(is.peek()))
-			{
-				is.setstate(std::ios_base::failbit);
-			}
-			else
-			{
-				std::ostringstream oss;
-
-				do
-				{
-					oss.put(static_cast<char>(is.get()));
-				}
-				while (is.good() && isdigit(is.peek()));
-
-				if (is)
-				{
-					const std::string& result = oss.str();
-
-					std::istringstream iss(result);
-					unsigned int num_prefix_length = 0;
-
-					if ((iss >> std::dec >> num_prefix_length) && check_prefix_length<AddressType>(num_prefix_length))
-					{
-						prefix_length = result;
-					}
-					else
-					{
-						putback(is, result);
-						is.setstate(std::ios_base::failbit);
-					}
-				}
-			}
-		}
-
-		return is;
-	}
-
-	template std::istream& read_prefix_length<boost::asio::ip::address_v4>(std::istream& is, std::string& prefix_length);
-	template std::istream& read_prefix_length<boost::asio::ip::address_v6>(std::istream& is, std::string& prefix_length);
-
-	// Hostname labels are 63 characters long at most
-	const size_t HOSTNAME_LABEL_MAX_SIZE = 63;
-
-	// Hostnames are at most 255 characters long
-	const size_t HOSTNAME_MAX_SIZE = 255;
-
-	bool is_hostname_label_regular_character(char c)
-	{
-		return std::isalnum(c);
-	}
-
-	bool is_hostname_label_special_character(char c)
-	{
-		return (c == '-');
-	}
-
-	bool is_hostname_label_character(char c)
-	{
-		return is_hostname_label_regular_character(c) || is_hostname_label_special_character(c);
-	}
-
-	std::istream& read_hostname_label(std::istream& is, std::string& label)
-	{
-		// Parse hostname labels according to RFC1123
-
-		if (is.good())
-		{
-			if (!is_hostname_label_regular_character(is.peek()))
-			{
-				is.setstate(std::ios_base::failbit);
-			}
-			else
-			{
-				std::ostringstream oss;
-
-				do
-				{
-					oss.put(static_cast<char>(is.get()));
-				}
-				while (is.good() && is_hostname_label_character(is.peek()));
-
-				if (is)
-				{
-					const std::string& result = oss.str();
-
-					// Check if the label is too long, if the last character is not a regular character or if it contains only digits
-					if ((result.size() > HOSTNAME_LABEL_MAX_SIZE) || (!is_hostname_label_regular_character(result[result.size() - 1])) || (result.find_first_not_of("0123456789") == std::string::npos))
-					{
-						putback(is, result);
-						is.setstate(std::ios_base::failbit);
-					}
-					else
-					{
-						label = result;
-					}
-				}
-			}
-		}
+		is.setstate(state);
 
 		return is;
 	}
 
-	std::istream& read_hostname(std::istream& is, std::string& hostname)
+	bool is_parse_character(std::istream::int_type c)
 	{
-		// Parse hostnames labels according to RFC952 and RFC1123
-
-		std::string label;
-
-		if (read_hostname_label(is, label))
+		if (c == std::istream::traits_type::eof())
 		{
-			if (is.eof())
-			{
-				// There is nothing more to read: lets use the content of the first label
-				std::swap(hostname, label);
-			}
-			else
-			{
-				std::ostringstream oss(label);
-				oss.seekp(0, std::ios::end);
-
-				while (is.good() && (is.peek() == '.'))
-				{
-					is.ignore();
-					oss.put('.');
-
-					if (!read_hostname_label(is, label))
-					{
-						putback(is, oss.str());
-						is.setstate(std::ios_base::failbit);
-					}
-					else
-					{
-						oss << label;
-					}
-				}
-
-				if (is)
-				{
-					const std::string& result = oss.str();
-
-					if (result.size() > HOSTNAME_MAX_SIZE)
-					{
-						putback(is, result);
-						is.setstate(std::ios_base::failbit);
-					}
-					else
-					{
-						hostname = result;
-					}
-				}
-			}
+			return false;
 		}
 
-		return is;
-	}
-
-	std::istream& read_service(std::istream& is, std::string& service)
-	{
-		if (is.good())
+		switch (c)
 		{
-			if (!isalnum(is.peek()))
-			{
-				is.setstate(std::ios_base::failbit);
-			}
-			else
-			{
-				std::ostringstream oss;
-
-				do
-				{
-					oss.put(static_cast<char>(is.get()));
-				}
-				while (is.good() && isalnum(is.peek()));
-
-				if (is)
-				{
-					const std::string& result = oss.str();
-
-					// Check if the label contains only digits
-					if (result.find_first_not_of("0123456789") == std::string::npos)
-					{
-						std::istringstream iss(result);
-						uint16_t num_service;
-
-						if (iss >> std::dec >> num_service)
-						{
-							service = result;
-						}
-						else
-						{
-							putback(is, result);
-							is.setstate(std::ios_base::failbit);
-						}
-					}
-					else
-					{
-						service = result;
-					}
-				}
-			}
+			case '.':
+			case ':':
+			case '-':
+			case '/':
+			case '[':
+			case ']':
+				return true;
+			default:
+				return (std::isalnum(static_cast<unsigned char>(c)) != 0);
 		}
-
-		return is;
 	}
 }
@@ -49,60 +49,73 @@
 #include <iostream>
 #include <string>
 
+#include <boost/system/error_code.hpp>
+
 namespace freelan
 {
 	/**
-	 * \brief Put back some characters in an input stream.
-	 * \param is The input stream.
-	 * \param str The characters to put back.
-	 * \return is.
+	 * \brief The maximum count of characters read from a stream to parse a value.
 	 */
-	std::istream& putback(std::istream& is, const std::string& str);
+	const size_t STREAM_PARSE_MAX_SIZE = 512;
 
 	/**
-	 * \brief Read an IP address.
-	 * \tparam AddressType The address type.
+	 * \brief Put back some characters in an input stream.
 	 * \param is The input stream.
-	 * \param ip_address The result address.
+	 * \param begin The first character to put back.
+	 * \param end The past-the-end character to put back.
 	 * \return is.
 	 */
-	template <typename AddressType>
-	std::istream& read_ip_address(std::istream& is, std::string& ip_address);
+	std::istream& putback(std::istream& is, const char* begin, const char* end);
 
 	/**
-	 * \brief Read a port number.
-	 * \param is The input stream.
-	 * \param port The result port.
-	 * \return is.
+	 * \brief Check if a character can be part of a parsed value.
+	 * \param c The character.
+	 * \return true if c can be part of an endpoint or a network address.
 	 */
-	std::istream& read_port(std::istream& is, std::string& port);
+	bool is_parse_character(std::istream::int_type c);
 
 	/**
-	 * \brief Read a prefix length.
-	 * \tparam AddressType The address type.
+	 * \brief Read a value from an input stream, using its character range parse() function.
+	 * \tparam ValueType The value type.
 	 * \param is The input stream.
-	 * \param prefix_length The result prefix_length.
+	 * \param value The value.
 	 * \return is.
+	 *
+	 * The characters that were not consumed by the parser are put back into the stream.
 	 */
-	template <typename AddressType>
-	std::istream& read_prefix_length(std::istream& is, std::string& prefix_length);
+	template <typename ValueType>
+	std::istream& read_parsed(std::istream& is, ValueType& value)
+	{
+		if (!is.good())
+		{
+			is.setstate(std::ios_base::failbit);
 
-	/**
-	 * \brief Read a hostname.
-	 * \param is The input stream.
-	 * \param hostname The result hostname.
-	 * \return is.
-	 */
-	std::istream& read_hostname(std::istream& is, std::string& hostname);
+			return is;
+		}
 
-	/**
-	 * \brief Read a service string.
-	 * \param is The input stream.
-	 * \param service The result service.
-	 * \return is.
-	 */
-	std::istream& read_service(std::istream& is, std::string& service);
+		char buf[STREAM_PARSE_MAX_SIZE];
+		size_t size = 0;
+
+		while ((size < sizeof(buf)) && is.good() && is_parse_character(is.peek()))
+		{
+			buf[size++] = static_cast<char>(is.get());
+		}
+
+		boost::system::error_code ec;
+		const char* const parsed_end = parse(buf, buf + size, value, ec);
+
+		if (ec)
+		{
+			putback(is, buf, buf + size);
+			is.setstate(std::ios_base::failbit);
+		}
+		else
+		{
+			putback(is, parsed_end, buf + size);
+		}
+
+		return is;
+	}
 }
 
 #endif /* FREELAN_STREAM_OPERATIONS_HPP */
-
@@ -62,19 +62,32 @@
 #include <asiotap/osi/ethernet_helper.hpp>
 
 #include "tap_adapter_switch_port.hpp"
+#include "probes.hpp"
 
 namespace freelan
 {
 	const unsigned int switch_::MAX_ENTRIES_DEFAULT = 1024;
 
-	void switch_::receive_data(port_type port, boost::asio::const_buffer data)
+	void switch_::receive_data(const port_type& port, boost::asio::const_buffer data)
 	{
 		assert(port);
 
+		FREELAN_PROBE2(switch_frame_ingress, port.get(), boost::asio::buffer_size(data));
+
+		if (m_frames_counter)
+		{
+			m_frames_counter->increment();
+		}
+
 		switch (m_configuration.routing_method)
 		{
 			case switch_configuration::RM_HUB:
 				{
+					if (m_flooded_frames_counter)
+					{
+						m_flooded_frames_counter->increment();
+					}
+
 					send_data_from(port, data);
 
 					break;
@@ -87,7 +100,16 @@ namespace freelan
 
 					if (!is_multicast_address(target_address))
 					{
-						m_ethernet_address_map[to_ethernet_address(ethernet_helper.sender())] = port;
+						const std::pair<ethernet_address_map_type::iterator, bool> source_entry = m_ethernet_address_map.insert(std::make_pair(to_ethernet_address(ethernet_helper.sender()), weak_port_type(port)));
+
+						if (source_entry.second)
+						{
+							FREELAN_PROBE2(switch_address_learned, source_entry.first->first.data(), port.get());
+						}
+						else
+						{
+							source_entry.first->second = port;
+						}
 
 						// We exceeded the maximum count for entries: we delete random entries to fix it.
 						while (m_ethernet_address_map.size() > m_max_entries)
@@ -105,7 +127,19 @@ namespace freelan
 							std::advance(entry, vgen());
 #endif
 
+							FREELAN_PROBE1(switch_address_evicted, entry->first.data());
+
 							m_ethernet_address_map.erase(entry);
+
+							if (m_evicted_addresses_counter)
+							{
+								m_evicted_addresses_counter->increment();
+							}
+						}
+
+						if (m_addresses_gauge)
+						{
+							m_addresses_gauge->set(m_ethernet_address_map.size());
 						}
 
 						// We look in the ethernet address map
@@ -114,7 +148,7 @@ namespace freelan
 
 						if (target_entry != m_ethernet_address_map.end())
 						{
-							port_type target_port = target_entry->second.lock();
+							const port_type target_port = target_entry->second.lock();
 
 							if (target_port)
 							{
@@ -129,37 +163,83 @@ namespace freelan
 						else
 						{
 							// No target entry: we send the message to everybody.
+							if (m_flooded_frames_counter)
+							{
+								m_flooded_frames_counter->increment();
+							}
+
 							send_data_from(port, data);
 						}
 					}
 					else
 					{
 						// Address is multicast: we send to everybody.
+						if (m_flooded_frames_counter)
+						{
+							m_flooded_frames_counter->increment();
+						}
+
 						send_data_from(port, data);
 					}
 				}
 		}
 	}
 
-	void switch_::send_data_from(port_type source_port, boost::asio::const_buffer data)
+	void switch_::set_metrics(metrics_registry& registry)
+	{
+		m_frames_counter = &registry.register_counter("freelan_switch_frames_total", "The count of frames received by the switch.");
+		m_flooded_frames_counter = &registry.register_counter("freelan_switch_flooded_frames_total", "The count of frames sent to all the ports.");
+		m_evicted_addresses_counter = &registry.register_counter("freelan_switch_evicted_addresses_total", "The count of ethernet addresses forgotten because the table was full.");
+		m_addresses_gauge = &registry.register_gauge("freelan_switch_addresses", "The count of learned ethernet addresses.");
+	}
+
+	void switch_::send_data_from(const port_type& source_port, boost::asio::const_buffer data)
 	{
-		BOOST_FOREACH(port_list_type::value_type& entry, m_ports)
+		const port_list_type::const_iterator source_entry = m_ports.find(source_port);
+
+		if (source_entry == m_ports.end())
 		{
-			send_data_from_to(source_port, entry.first, data);
+			return;
+		}
+
+		BOOST_FOREACH(const port_list_type::value_type& entry, m_ports)
+		{
+			if ((entry.first != source_port) && (m_configuration.relay_mode_enabled || (entry.second != source_entry->second)))
+			{
+				send_data_to(entry.first, data);
+			}
 		}
 	}
 
-	void switch_::send_data_from_to(port_type source_port, port_type target_port, boost::asio::const_buffer data)
+	void switch_::send_data_from_to(const port_type& source_port, const port_type& target_port, boost::asio::const_buffer data)
 	{
 		if (source_port != target_port)
 		{
-			if (m_configuration.relay_mode_enabled || (m_ports[source_port] != m_ports[target_port]))
+			const port_list_type::const_iterator source_entry = m_ports.find(source_port);
+			const port_list_type::const_iterator target_entry = m_ports.find(target_port);
+
+			if ((source_entry != m_ports.end()) && (target_entry != m_ports.end()))
 			{
-				target_port->write(data);
+				if (m_configuration.relay_mode_enabled || (source_entry->second != target_entry->second))
+				{
+					send_data_to(target_port, data);
+				}
 			}
 		}
 	}
 
+	void switch_::send_data_to(const port_type& target_port, boost::asio::const_buffer data)
+	{
+		if (m_frame_tracer)
+		{
+			m_frame_tracer->mark(frame_tracer::FTS_SWITCH_DECISION);
+		}
+
+		FREELAN_PROBE2(switch_frame_egress, target_port.get(), boost::asio::buffer_size(data));
+
+		target_port->write(data);
+	}
+
 	switch_::ethernet_address_type switch_::to_ethernet_address(boost::asio::const_buffer buf)
 	{
 		assert(boost::asio::buffer_size(buf) == ethernet_address_type::static_size);